@@ -131,6 +131,10 @@ dump_index(EdPgIdx *idx)
 	printf("gc_tail: %u\n", idx->gc_tail);
 	printf("tree: "); dump_page_array(idx->tree, ed_len(idx->tree));
 	printf("xid: %" PRIu64 "\n", idx->xid);
+	printf("xmin: %" PRIu64 "\n", idx->xmin);
+	printf("xmin_gen: %" PRIu64 "\n", idx->xmin_gen);
+	printf("xmin_valid: %" PRIu64 "\n", idx->xmin_valid);
+	printf("nsnapshots: %" PRIu32 "\n", idx->nsnapshots);
 	printf("vno: %" PRIu64 "\n", idx->vno);
 	printf("slab_block_count: %" PRIu64 "\n", idx->slab_block_count);
 	printf("slab_ino: %" PRIu64 "\n", idx->slab_ino);
@@ -138,7 +142,7 @@ dump_index(EdPgIdx *idx)
 	printf("active: "); dump_page_array(idx->active, idx->nactive);
 	printf("conns:\n");
 
-	uint8_t *end = (uint8_t *)idx + PAGESIZE;
+	uint8_t *end = (uint8_t *)idx + ED_PG_SIZE;
 	EdConn *c = idx->conns;
 	for (int i = 0; i < idx->nconns; i++, c++) {
 		if ((uint8_t *)c + sizeof(*c) > end) {
@@ -157,6 +161,11 @@ dump_index(EdPgIdx *idx)
 			printf("  date: %s", ctime_r(&t, buf));
 		}
 		printf("  xid: %" PRIu64 "\n", c->xid);
+		printf("  readers:");
+		for (int r = 0; r < ED_CONN_READERS; r++) {
+			if (c->rmask & (UINT32_C(1) << r)) { printf(" %" PRIu64, c->readers[r]); }
+		}
+		printf("\n");
 		printf("  pending: "); dump_page_array(c->pending, c->npending);
 	}
 }
@@ -205,7 +214,7 @@ dump_gc(EdPgGc *gc)
 	}
 
 	if (gc->state.nlists > 0) {
-		uint8_t *end = (uint8_t *)gc + PAGESIZE;
+		uint8_t *end = (uint8_t *)gc + ED_PG_SIZE;
 		uint16_t head = gc->state.head;
 		uint16_t nskip = gc->state.nskip;
 
@@ -233,7 +242,7 @@ dump_page(EdPgno no, EdPg *pg)
 
 	if (dump_raw) {
 		if (pg != NULL) {
-			fwrite(pg, 1, PAGESIZE, stdout);
+			fwrite(pg, 1, ED_PG_SIZE, stdout);
 		}
 		return;
 	}
@@ -271,8 +280,8 @@ dump_page(EdPgno no, EdPg *pg)
 	if (dump_hex > 0) {
 		printf("hex: |\n");
 #define ROWSIZE 32
-		size_t b = (size_t)no * PAGESIZE;
-		uint8_t *p = (uint8_t *)pg, *pe = p + PAGESIZE;
+		size_t b = (size_t)no * ED_PG_SIZE;
+		uint8_t *p = (uint8_t *)pg, *pe = p + ED_PG_SIZE;
 		for (; p < pe; p += ROWSIZE, b += ROWSIZE) {
 			printf("  %08zx:", b);
 			uint8_t *re = p + ROWSIZE;
@@ -304,10 +313,10 @@ int
 dump_read_raw(void)
 {
 	EdInput in;
-	int rc = ed_input_read(&in, STDIN_FILENO, PAGESIZE * ED_PG_MAX);
+	int rc = ed_input_read(&in, STDIN_FILENO, ED_PG_SIZE * ED_PG_MAX);
 	if (rc < 0) { errx(1, "failed to read input: %s", ed_strerror(rc)); }
 	uint8_t *p = in.data, *pe = p + in.length;
-	for (; p < pe; p += PAGESIZE) {
+	for (; p < pe; p += ED_PG_SIZE) {
 		EdPg *pg = (EdPg *)p;
 		dump_page(pg->no, pg);
 	}
@@ -339,7 +348,7 @@ dump_pages(int argc, char *const *argv)
 		pages[i].pg = NULL;
 	}
 
-	rc = ed_input_new(&in, argc * PAGESIZE);
+	rc = ed_input_new(&in, argc * ED_PG_SIZE);
 	if (rc < 0) { errx(1, "mmap failed: %s", ed_strerror(rc)); }
 
 	rc = ed_idx_open(&idx, &cfg);
@@ -355,8 +364,8 @@ dump_pages(int argc, char *const *argv)
 			if (pages[i].no >= npages) { continue; }
 			EdPg *pg = ed_pg_map(idx.fd, pages[i].no, 1, true);
 			if (pg != MAP_FAILED) {
-				pages[i].pg = (EdPg *)(in.data + i*PAGESIZE);
-				memcpy(in.data + i*PAGESIZE, pg, PAGESIZE);
+				pages[i].pg = (EdPg *)(in.data + i*ED_PG_SIZE);
+				memcpy(in.data + i*ED_PG_SIZE, pg, ED_PG_SIZE);
 				ed_pg_unmap(pg, 1);
 			}
 		}
@@ -18,6 +18,27 @@ static EdOption get_opts[] = {
 	{0, 0, 0, 0, 0}
 };
 
+static int
+get_write(EdObject *obj, int fd)
+{
+	size_t len, off = 0;
+	ssize_t n;
+
+	// Try to stream the object directly from the slab first. Not all output
+	// types support this, so fall back to writing from the mapped value.
+	while ((n = ed_sendfile(obj, fd, SIZE_MAX)) > 0) {
+		off += (size_t)n;
+	}
+	if (n == 0) { return 0; }
+
+	const uint8_t *data = ed_value(obj, &len);
+	for (; off < len; off += (size_t)n) {
+		n = write(fd, data + off, len - off);
+		if (n < 0) { return -1; }
+	}
+	return 0;
+}
+
 static int
 get_run(const EdCommand *cmd, int argc, char *const *argv)
 {
@@ -116,13 +137,12 @@ get_run(const EdCommand *cmd, int argc, char *const *argv)
 			if (!meta) { warnx("key not found"); }
 		}
 		else {
-			size_t len;
-			const void *data = ed_value(obj, &len);
-			if (write(STDOUT_FILENO, data, len) < 0) {
+			if (get_write(obj, STDOUT_FILENO) < 0) {
 				warn("write failed");
 			}
 			if (meta) {
-				data = ed_meta(obj, &len);
+				size_t len;
+				const void *data = ed_meta(obj, &len);
 				if (write(STDERR_FILENO, data, len) < 0) {
 					warn("write failed");
 				}
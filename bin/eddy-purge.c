@@ -0,0 +1,64 @@
+#include "../lib/eddy-private.h"
+
+#define DEFAULT_BATCH 1000
+
+static const EdUsage purge_usage = {
+	"Removes expired keys from the cache index.",
+	(const char *[]) {
+		"[-v] [-b count] index",
+		NULL
+	},
+	"Keys are removed in batches, each in its own transaction, so writers are\n"
+	"only held up for the length of a single batch. The objects remain in the\n"
+	"slab until overwritten."
+};
+static EdOption purge_opts[] = {
+	{"batch",   "count", 0, 'b', "number of keys to remove per transaction (default " ED_STR(DEFAULT_BATCH) ")"},
+	{"verbose", NULL,    0, 'v', "enable verbose messaging"},
+	{0, 0, 0, 0, 0}
+};
+
+static int
+purge_run(const EdCommand *cmd, int argc, char *const *argv)
+{
+	EdConfig cfg = ed_config_make();
+	EdCache *cache = NULL;
+	size_t batch = DEFAULT_BATCH, total = 0;
+	char *end;
+
+	int ch;
+	while ((ch = ed_opt(argc, argv, cmd)) != -1) {
+		switch (ch) {
+		case 'b':
+			batch = strtoull(optarg, &end, 10);
+			if (*end != '\0' || batch == 0) {
+				errx(1, "%s must be a valid number", argv[optind-1]);
+			}
+			break;
+		case 'v': cfg.flags |= ED_FVERBOSE; break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0) { errx(1, "index file path not provided"); }
+	cfg.index_path = argv[0];
+
+	int rc = ed_cache_open(&cache, &cfg);
+	if (rc < 0) { errx(1, "failed to open index '%s': %s", cfg.index_path, ed_strerror(rc)); }
+
+	// A short batch means the oldest remaining entry is still live.
+	do {
+		rc = ed_cache_purge_expired(cache, batch);
+		if (rc < 0) {
+			warnx("failed to purge: %s", ed_strerror(rc));
+			break;
+		}
+		total += (size_t)rc;
+	} while ((size_t)rc == batch);
+
+	ed_verbose(cfg.flags, "purged %zu expired entries\n", total);
+
+	ed_cache_close(&cache);
+	return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include "../lib/eddy-private.h"
+
+static const EdUsage rebuild_usage = {
+	"Rebuilds the cache index from the objects in the slab.",
+	(const char *[]) {
+		"[-v] [-n] index",
+		NULL
+	},
+	"The index header must be intact, as the key hash seed and time epoch are\n"
+	"reused. All other index pages are discarded, and the newest version of each\n"
+	"key found in the slab is indexed again. The cache must not be in use while\n"
+	"it is being rebuilt."
+};
+static EdOption rebuild_opts[] = {
+	{"verbose",   NULL, 0, 'v', "enable verbose messaging"},
+	{"no-verify", NULL, 0, 'n', "don't verify checksums of the objects found"},
+	{0, 0, 0, 0, 0}
+};
+
+static int
+rebuild_run(const EdCommand *cmd, int argc, char *const *argv)
+{
+	EdConfig cfg = ed_config_make();
+	cfg.flags |= ED_FREPAIR;
+
+	int ch;
+	while ((ch = ed_opt(argc, argv, cmd)) != -1) {
+		switch (ch) {
+		case 'v': cfg.flags |= ED_FVERBOSE; break;
+		case 'n': cfg.flags |= ED_FNOVERIFY; break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0) { errx(1, "index file path not provided"); }
+	cfg.index_path = argv[0];
+
+	EdCache *cache;
+	int rc = ed_cache_open(&cache, &cfg);
+	if (rc < 0) {
+		fprintf(stderr, "failed to rebuild cache: %s\n", ed_strerror(rc));
+		return EXIT_FAILURE;
+	}
+	ed_cache_close(&cache);
+	return EXIT_SUCCESS;
+}
@@ -45,6 +45,9 @@ version_run(const EdCommand *cmd, int argc, char *const *argv)
 #if ED_DUMP
 		printf("- dump\n");
 #endif
+#if ED_AIO
+		printf("- aio\n");
+#endif
 #if ED_DEBUG
 		printf("- dbg\n");
 #endif
@@ -67,6 +70,9 @@ version_run(const EdCommand *cmd, int argc, char *const *argv)
 #if ED_DUMP
 		printf(" +dump");
 #endif
+#if ED_AIO
+		printf(" +aio");
+#endif
 #if ED_DEBUG
 		printf(" +dbg");
 #endif
@@ -343,10 +343,12 @@ ed_parse_size(const char *val, long long *out, size_t block)
 
 #include "eddy-version.c"
 #include "eddy-new.c"
+#include "eddy-rebuild.c"
 #include "eddy-get.c"
 #include "eddy-set.c"
 #include "eddy-update.c"
 #include "eddy-rm.c"
+#include "eddy-purge.c"
 #include "eddy-ls.c"
 #include "eddy-stat.c"
 #if ED_DUMP
@@ -358,10 +360,12 @@ ed_parse_size(const char *val, long long *out, size_t block)
 
 static const EdCommand commands[] = {
 	{"new",     new_opts,     new_run,     &new_usage},
+	{"rebuild", rebuild_opts, rebuild_run, &rebuild_usage},
 	{"get",     get_opts,     get_run,     &get_usage},
 	{"set",     set_opts,     set_run,     &set_usage},
 	{"update",  update_opts,  update_run,  &update_usage},
 	{"rm",      rm_opts,      rm_run,      &rm_usage},
+	{"purge",   purge_opts,   purge_run,   &purge_usage},
 	{"ls",      ls_opts,      ls_run,      &ls_usage},
 	{"stat",    stat_opts,    stat_run,    &stat_usage},
 	{"version", version_opts, version_run, &version_usage},
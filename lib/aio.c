@@ -0,0 +1,379 @@
+#include "eddy-private.h"
+#include "eddy-aio.h"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#define AIO_READ  1
+#define AIO_WRITE 2
+
+#define aio_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define aio_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+typedef struct EdAioSlot EdAioSlot;
+
+struct EdAioSlot {
+	EdObject *   obj;              /**< Object for the in-flight request */
+	void *       udata;            /**< User data for the in-flight request */
+	int          op;               /**< Request type or 0 when free */
+};
+
+struct EdAio {
+	EdCache *    cache;            /**< Reference to the cache handle */
+	int          fd;               /**< Ring file descriptor */
+	int          efd;              /**< Event file descriptor signaled on completion */
+	uint8_t *    bufs;             /**< Registered buffer memory */
+	size_t       bufsize;          /**< Size of each registered buffer */
+	size_t       bufmap;           /**< Mapped size of #bufs */
+	unsigned     depth;            /**< Number of buffer slots */
+	unsigned     nfree;            /**< Number of entries in #free */
+	unsigned     ninflight;        /**< Number of requests not yet reaped */
+	unsigned     sq_pending;       /**< Number of queued entries not yet submitted */
+	unsigned     sq_tail;          /**< Local submission tail */
+	void *       sq_ring;          /**< Mapped submission ring */
+	size_t       sq_ring_size;     /**< Mapped size of #sq_ring */
+	void *       cq_ring;          /**< Mapped completion ring */
+	size_t       cq_ring_size;     /**< Mapped size of #cq_ring */
+	struct io_uring_sqe *sqes;     /**< Mapped submission entries */
+	size_t       sqes_size;        /**< Mapped size of #sqes */
+	unsigned *   sq_head;
+	unsigned *   sq_tailp;
+	unsigned *   sq_mask;
+	unsigned *   sq_array;
+	unsigned *   cq_head;
+	unsigned *   cq_tail;
+	unsigned *   cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned *   free;             /**< Stack of free buffer slots */
+	EdAioSlot    slots[1];         /**< Flexible array of buffer slots */
+};
+
+static int
+aio_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+aio_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int
+aio_register(int fd, unsigned op, const void *arg, unsigned n)
+{
+	return (int)syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+/**
+ * @brief  Maps the submission and completion rings
+ * @param  aio  Engine with an open ring descriptor
+ * @param  p  Parameters returned from the ring setup
+ * @return  0 on success, <0 on error
+ */
+static int
+aio_map(EdAio *aio, const struct io_uring_params *p)
+{
+	aio->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+	aio->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		if (aio->cq_ring_size > aio->sq_ring_size) {
+			aio->sq_ring_size = aio->cq_ring_size;
+		}
+		aio->cq_ring_size = aio->sq_ring_size;
+	}
+
+	aio->sq_ring = mmap(NULL, aio->sq_ring_size, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, aio->fd, IORING_OFF_SQ_RING);
+	if (aio->sq_ring == MAP_FAILED) { return ED_ERRNO; }
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		aio->cq_ring = aio->sq_ring;
+	}
+	else {
+		aio->cq_ring = mmap(NULL, aio->cq_ring_size, PROT_READ|PROT_WRITE,
+				MAP_SHARED|MAP_POPULATE, aio->fd, IORING_OFF_CQ_RING);
+		if (aio->cq_ring == MAP_FAILED) { return ED_ERRNO; }
+	}
+
+	aio->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	aio->sqes = mmap(NULL, aio->sqes_size, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, aio->fd, IORING_OFF_SQES);
+	if (aio->sqes == MAP_FAILED) { return ED_ERRNO; }
+
+	uint8_t *sq = aio->sq_ring, *cq = aio->cq_ring;
+	aio->sq_head = (unsigned *)(sq + p->sq_off.head);
+	aio->sq_tailp = (unsigned *)(sq + p->sq_off.tail);
+	aio->sq_mask = (unsigned *)(sq + p->sq_off.ring_mask);
+	aio->sq_array = (unsigned *)(sq + p->sq_off.array);
+	aio->cq_head = (unsigned *)(cq + p->cq_off.head);
+	aio->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+	aio->cq_mask = (unsigned *)(cq + p->cq_off.ring_mask);
+	aio->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+	aio->sq_tail = *aio->sq_tailp;
+	return 0;
+}
+
+int
+ed_aio_open(EdAio **aiop, EdCache *cache, unsigned depth, size_t bufsize)
+{
+	if (depth == 0 || bufsize == 0) { return ed_esys(EINVAL); }
+	if (cache->nshards > 0) { return ED_ECONFIG_SHARDS; }
+
+	depth = ed_power2(depth);
+	bufsize = ed_align_pg(bufsize);
+
+	EdAio *aio = calloc(1, sizeof(*aio) + (depth-1)*sizeof(aio->slots[0]) +
+			depth*sizeof(aio->free[0]));
+	if (aio == NULL) { return ED_ERRNO; }
+
+	aio->cache = cache;
+	aio->fd = -1;
+	aio->efd = -1;
+	aio->bufs = MAP_FAILED;
+	aio->sq_ring = MAP_FAILED;
+	aio->cq_ring = MAP_FAILED;
+	aio->sqes = MAP_FAILED;
+	aio->depth = depth;
+	aio->bufsize = bufsize;
+	aio->free = (unsigned *)(aio->slots + depth);
+	for (unsigned i = 0; i < depth; i++) {
+		aio->free[aio->nfree++] = depth - i - 1;
+	}
+
+	struct io_uring_params p;
+	struct iovec *iov = NULL;
+	int rc = 0;
+
+	memset(&p, 0, sizeof(p));
+	aio->fd = aio_setup(depth, &p);
+	if (aio->fd < 0) { rc = ED_ERRNO; goto done; }
+
+	rc = aio_map(aio, &p);
+	if (rc < 0) { goto done; }
+
+	// Register the slab so each request avoids the file table lookup.
+	if (aio_register(aio->fd, IORING_REGISTER_FILES, &cache->idx.slabfd, 1) < 0) {
+		rc = ED_ERRNO;
+		goto done;
+	}
+
+	// Register one buffer per slot so the pages are pinned once up front.
+	aio->bufmap = depth * bufsize;
+	aio->bufs = mmap(NULL, aio->bufmap, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANON, -1, 0);
+	if (aio->bufs == MAP_FAILED) { rc = ED_ERRNO; goto done; }
+
+	iov = malloc(depth * sizeof(*iov));
+	if (iov == NULL) { rc = ED_ERRNO; goto done; }
+	for (unsigned i = 0; i < depth; i++) {
+		iov[i].iov_base = aio->bufs + i*bufsize;
+		iov[i].iov_len = bufsize;
+	}
+	if (aio_register(aio->fd, IORING_REGISTER_BUFFERS, iov, depth) < 0) {
+		rc = ED_ERRNO;
+		goto done;
+	}
+
+	aio->efd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (aio->efd < 0) { rc = ED_ERRNO; goto done; }
+	if (aio_register(aio->fd, IORING_REGISTER_EVENTFD, &aio->efd, 1) < 0) {
+		rc = ED_ERRNO;
+		goto done;
+	}
+
+done:
+	free(iov);
+	if (rc < 0) {
+		ed_aio_close(&aio);
+	}
+	*aiop = aio;
+	return rc;
+}
+
+void
+ed_aio_close(EdAio **aiop)
+{
+	EdAio *aio = *aiop;
+	if (aio == NULL) { return; }
+	*aiop = NULL;
+
+	// The kernel may still be writing into the buffers, so drain the ring.
+	if (aio->fd > -1 && aio->cqes != NULL) {
+		EdAioEvent ev[16];
+		if (aio->sq_pending > 0) {
+			ed_aio_submit(aio);
+		}
+		while (aio->ninflight > aio->sq_pending && ed_aio_reap(aio, ev, ed_len(ev), 1) > 0) {}
+	}
+
+	if (aio->efd > -1) { close(aio->efd); }
+	if (aio->sqes != MAP_FAILED) { munmap(aio->sqes, aio->sqes_size); }
+	if (aio->cq_ring != MAP_FAILED && aio->cq_ring != aio->sq_ring) {
+		munmap(aio->cq_ring, aio->cq_ring_size);
+	}
+	if (aio->sq_ring != MAP_FAILED) { munmap(aio->sq_ring, aio->sq_ring_size); }
+	if (aio->fd > -1) { close(aio->fd); }
+	if (aio->bufs != MAP_FAILED) { munmap(aio->bufs, aio->bufmap); }
+	free(aio);
+}
+
+int
+ed_aio_fd(const EdAio *aio)
+{
+	return aio->efd;
+}
+
+static bool
+aio_full(const EdAio *aio)
+{
+	return aio->nfree == 0 || aio->sq_tail - aio_load(aio->sq_head) > *aio->sq_mask;
+}
+
+/**
+ * @brief  Fills the next submission entry for a fixed buffer request
+ *
+ * This must only be called after #aio_full() returns false.
+ *
+ * @param  aio  Engine
+ * @param  op  #AIO_READ or #AIO_WRITE
+ * @param  obj  Object for the request
+ * @param  len  Number of bytes to transfer
+ * @param  pos  Byte offset in the slab
+ * @param  udata  User data for the request
+ */
+static void
+aio_prep(EdAio *aio, int op, EdObject *obj, size_t len, off_t pos, void *udata)
+{
+	unsigned tail = aio->sq_tail, mask = *aio->sq_mask;
+
+	unsigned slot = aio->free[--aio->nfree];
+	struct io_uring_sqe *sqe = &aio->sqes[tail & mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op == AIO_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = 0;
+	sqe->off = (uint64_t)pos;
+	sqe->addr = (uint64_t)(uintptr_t)(aio->bufs + slot*aio->bufsize);
+	sqe->len = (uint32_t)len;
+	sqe->buf_index = (uint16_t)slot;
+	sqe->user_data = slot;
+
+	aio->sq_array[tail & mask] = tail & mask;
+	aio->sq_tail = tail + 1;
+	aio->sq_pending++;
+	aio->ninflight++;
+
+	aio->slots[slot].obj = obj;
+	aio->slots[slot].udata = udata;
+	aio->slots[slot].op = op;
+}
+
+ssize_t
+ed_aio_read(EdAio *aio, EdObject *obj, size_t len, off_t off, void *udata)
+{
+	if (len > aio->bufsize) { len = aio->bufsize; }
+
+	off_t pos;
+	ssize_t n = ed_obj_read_pos(obj, len, off, &pos);
+	if (n <= 0) { return n; }
+	if (aio_full(aio)) { return ed_esys(EAGAIN); }
+
+	aio_prep(aio, AIO_READ, obj, (size_t)n, pos, udata);
+	return n;
+}
+
+ssize_t
+ed_aio_write(EdAio *aio, EdObject *obj, const void *buf, size_t len, void *udata)
+{
+	if (len > aio->bufsize) { return ED_EOBJECT_TOOBIG; }
+	if (aio_full(aio)) { return ed_esys(EAGAIN); }
+
+	// The position must not advance unless the request can be queued.
+	off_t pos;
+	ssize_t n = ed_obj_write_pos(obj, buf, len, &pos);
+	if (n <= 0) { return n; }
+
+	memcpy(aio->bufs + aio->free[aio->nfree-1]*aio->bufsize, buf, (size_t)n);
+	aio_prep(aio, AIO_WRITE, obj, (size_t)n, pos, udata);
+	return n;
+}
+
+int
+ed_aio_submit(EdAio *aio)
+{
+	unsigned n = aio->sq_pending;
+	if (n == 0) { return 0; }
+
+	aio_store(aio->sq_tailp, aio->sq_tail);
+	int rc;
+	do {
+		rc = aio_enter(aio->fd, n, 0, 0);
+	} while (rc < 0 && errno == EINTR);
+	if (rc < 0) { return ED_ERRNO; }
+
+	aio->sq_pending -= (unsigned)rc;
+	return rc;
+}
+
+int
+ed_aio_reap(EdAio *aio, EdAioEvent *ev, unsigned n, unsigned wait)
+{
+	// Clear the event counter before looking at the ring so a completion that
+	// lands afterwards still leaves the descriptor readable.
+	uint64_t cnt;
+	if (read(aio->efd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) {
+		return ED_ERRNO;
+	}
+
+	// Requests that haven't been submitted will never complete.
+	if (wait > n) { wait = n; }
+	if (wait > aio->ninflight - aio->sq_pending) { wait = aio->ninflight - aio->sq_pending; }
+
+	unsigned head = *aio->cq_head, mask = *aio->cq_mask, count = 0;
+	while (count < n) {
+		unsigned tail = aio_load(aio->cq_tail);
+		if (head == tail) {
+			if (count >= wait) { break; }
+			int rc = aio_enter(aio->fd, 0, wait - count, IORING_ENTER_GETEVENTS);
+			if (rc < 0 && errno != EINTR) { return ED_ERRNO; }
+			continue;
+		}
+
+		const struct io_uring_cqe *cqe = &aio->cqes[head & mask];
+		unsigned slot = (unsigned)cqe->user_data;
+		EdAioSlot *s = &aio->slots[slot];
+		ev[count].obj = s->obj;
+		ev[count].udata = s->udata;
+		ev[count].res = cqe->res < 0 ? ed_esys(-cqe->res) : cqe->res;
+		ev[count].slot = (int)slot;
+		if (s->op == AIO_READ) {
+			ev[count].buf = aio->bufs + slot*aio->bufsize;
+		}
+		else {
+			ev[count].buf = NULL;
+			s->op = 0;
+			aio->free[aio->nfree++] = slot;
+		}
+		aio->ninflight--;
+		count++;
+		head++;
+		aio_store(aio->cq_head, head);
+	}
+	return (int)count;
+}
+
+void
+ed_aio_release(EdAio *aio, const EdAioEvent *ev)
+{
+	if (ev->buf == NULL) { return; }
+	EdAioSlot *s = &aio->slots[ev->slot];
+	if (s->op == AIO_READ) {
+		s->op = 0;
+		aio->free[aio->nfree++] = (unsigned)ev->slot;
+	}
+}
+
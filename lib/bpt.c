@@ -1,6 +1,6 @@
 #include "eddy-private.h"
 
-_Static_assert(sizeof(EdBpt) == PAGESIZE,
+_Static_assert(sizeof(EdBpt) == ED_PG_SIZE,
 		"EdBpt size invalid");
 _Static_assert(offsetof(EdBpt, data) % 8 == 0,
 		"EdBpt data not 8-byte aligned");
@@ -16,11 +16,188 @@ _Static_assert(offsetof(EdBpt, data) % 8 == 0,
 #define LEAF_ORDER(esize) \
 	(sizeof(((EdBpt *)0)->data) / (esize))
 
+_Static_assert(BRANCH_ORDER <= UINT16_MAX,
+		"ED_PG_SIZE is too large for the node key count");
+
+#define LEAF_KEY_SIZE 8
+
 #define IS_BRANCH(n) ((n)->base.type == ED_PG_BRANCH)
 #define IS_BRANCH_FULL(n) ((n)->nkeys == (BRANCH_ORDER-1))
 #define IS_LEAF_FULL(n, esize) ((n)->nkeys == LEAF_ORDER(esize))
 #define IS_FULL(n, esize) (IS_BRANCH(n) ? IS_BRANCH_FULL(n) : IS_LEAF_FULL(n, esize))
 
+/*
+ * Nodes left less than a quarter full by a delete are merged with or refilled
+ * from a sibling. Keeping this well below half full avoids repeatedly merging
+ * and splitting the same nodes when the ring deletes and inserts at the same
+ * position.
+ */
+#define LEAF_MIN(esize) (LEAF_ORDER(esize) / 4)
+#define BRANCH_MIN (BRANCH_ORDER / 4)
+
+/**
+ * Number of candidate keys left to the compare kernel once the binary search
+ * has narrowed the range.
+ */
+#ifndef ED_BPT_SEARCH_LINEAR
+# define ED_BPT_SEARCH_LINEAR 8
+#endif
+
+/**
+ * Number of sibling pages requested ahead of the cursor while iterating.
+ */
+#ifndef ED_BPT_PREFETCH
+# define ED_BPT_PREFETCH 8
+#endif
+
+#if !defined(ED_BPT_SIMD) && defined(__x86_64__) && defined(__GNUC__)
+# define ED_BPT_SIMD 1
+#endif
+
+#if ED_BPT_SIMD
+# include <immintrin.h>
+#endif
+
+typedef uint32_t (*KeyCount)(const uint8_t *keys, size_t stride, uint32_t n, uint64_t key);
+
+/**
+ * @brief  Counts the keys that are less than #key
+ * @param  keys  Pointer to the first key
+ * @param  stride  Number of bytes between keys
+ * @param  n  Number of keys
+ * @param  key  Key to compare against
+ * @return  Number of keys less than #key
+ */
+static uint32_t
+key_count_scalar(const uint8_t *keys, size_t stride, uint32_t n, uint64_t key)
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < n; i++, keys += stride) {
+		count += ed_fetch64(keys) < key;
+	}
+	return count;
+}
+
+#if ED_BPT_SIMD
+
+// There is no unsigned 64-bit compare, so both sides are offset by the sign
+// bit and compared as signed values.
+
+__attribute__((target("sse4.2")))
+static uint32_t
+key_count_sse42(const uint8_t *keys, size_t stride, uint32_t n, uint64_t key)
+{
+	const __m128i bias = _mm_set1_epi64x(INT64_MIN);
+	const __m128i k = _mm_xor_si128(_mm_set1_epi64x((int64_t)key), bias);
+	uint32_t count = 0, i = 0;
+	for (; i + 2 <= n; i += 2, keys += 2*stride) {
+		__m128i v = stride == LEAF_KEY_SIZE ?
+			_mm_loadu_si128((const __m128i *)keys) :
+			_mm_set_epi64x((int64_t)ed_fetch64(keys + stride), (int64_t)ed_fetch64(keys));
+		__m128i lt = _mm_cmpgt_epi64(k, _mm_xor_si128(v, bias));
+		count += (uint32_t)__builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(lt)));
+	}
+	if (i < n) {
+		count += ed_fetch64(keys) < key;
+	}
+	return count;
+}
+
+__attribute__((target("avx2")))
+static uint32_t
+key_count_avx2(const uint8_t *keys, size_t stride, uint32_t n, uint64_t key)
+{
+	const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+	const __m256i k = _mm256_xor_si256(_mm256_set1_epi64x((int64_t)key), bias);
+	const __m256i idx = _mm256_set_epi64x(3*(int64_t)stride, 2*(int64_t)stride, (int64_t)stride, 0);
+	uint32_t count = 0, i = 0;
+	for (; i + 4 <= n; i += 4, keys += 4*stride) {
+		__m256i v = stride == LEAF_KEY_SIZE ?
+			_mm256_loadu_si256((const __m256i *)keys) :
+			_mm256_i64gather_epi64((const long long *)keys, idx, 1);
+		__m256i lt = _mm256_cmpgt_epi64(k, _mm256_xor_si256(v, bias));
+		count += (uint32_t)__builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+	}
+	for (; i < n; i++, keys += stride) {
+		count += ed_fetch64(keys) < key;
+	}
+	return count;
+}
+
+#endif
+
+static KeyCount key_count_fn = NULL;
+
+/**
+ * @brief  Counts the keys that are less than #key using the best kernel for the CPU
+ *
+ * The kernel is selected on first use. Concurrent first calls select the same
+ * kernel, so the race to store it is benign.
+ */
+static uint32_t
+key_count(const uint8_t *keys, size_t stride, uint32_t n, uint64_t key)
+{
+	KeyCount fn = __atomic_load_n(&key_count_fn, __ATOMIC_RELAXED);
+	if (fn == NULL) {
+		fn = key_count_scalar;
+#if ED_BPT_SIMD
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) { fn = key_count_avx2; }
+		else if (__builtin_cpu_supports("sse4.2")) { fn = key_count_sse42; }
+#endif
+		__atomic_store_n(&key_count_fn, fn, __ATOMIC_RELAXED);
+	}
+	return fn(keys, stride, n, key);
+}
+
+int
+ed_bpt_count(int kernel, const void *keys, size_t stride, uint32_t n, uint64_t key)
+{
+	KeyCount fn = NULL;
+	switch (kernel) {
+	case ED_BPT_COUNT_SCALAR:
+		fn = key_count_scalar;
+		break;
+#if ED_BPT_SIMD
+	case ED_BPT_COUNT_SSE42:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse4.2")) { fn = key_count_sse42; }
+		break;
+	case ED_BPT_COUNT_AVX2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) { fn = key_count_avx2; }
+		break;
+#endif
+	}
+	if (fn == NULL) { return ed_esys(ENOTSUP); }
+	return (int)fn(keys, stride, n, key);
+}
+
+/**
+ * @brief  Finds the index of the first key that is not less than #key
+ *
+ * A branchless binary search narrows the range down to at most
+ * #ED_BPT_SEARCH_LINEAR keys, which are then counted by the compare kernel.
+ * For repeated keys this gives the index of the first repeat.
+ *
+ * @param  keys  Pointer to the first key
+ * @param  stride  Number of bytes between keys
+ * @param  n  Number of sorted keys
+ * @param  key  Key to search for
+ * @return  Index of the first key >= #key, or #n if all keys are less
+ */
+static uint32_t
+key_search(const uint8_t *keys, size_t stride, uint32_t n, uint64_t key)
+{
+	uint32_t lo = 0;
+	while (n > ED_BPT_SEARCH_LINEAR) {
+		uint32_t half = n / 2;
+		lo = ed_fetch64(keys + (size_t)(lo + half) * stride) < key ? lo + half : lo;
+		n -= half;
+	}
+	return lo + key_count(keys + (size_t)lo * stride, stride, n, key);
+}
+
 static inline uint64_t
 branch_key(EdBpt *b, uint16_t idx)
 {
@@ -62,23 +239,76 @@ branch_index(EdBpt *b, EdPgno *ptr)
 static EdPgno *
 branch_search(EdBpt *b, uint64_t key)
 {
-	// TODO: binary search or SIMD
-	EdPgno *ptr = (EdPgno *)b->data;
-	uint8_t *bkey = b->data + BRANCH_PTR_SIZE;
-	for (uint32_t i = 0, n = b->nkeys; i < n; i++, bkey += BRANCH_ENTRY_SIZE) {
-		uint64_t cmp = ed_fetch64(bkey);
-		if (key < cmp) { break; }
-		ptr = BRANCH_NEXT(ptr);
-		if (key == cmp) { break; }
-	}
-	return ptr;
+	// Keys equal to the branch key belong to the pointer after it.
+	const uint8_t *bkey = b->data + BRANCH_PTR_SIZE;
+	uint32_t n = b->nkeys;
+	uint32_t i = key_search(bkey, BRANCH_ENTRY_SIZE, n, key);
+	if (i < n && ed_fetch64(bkey + i*BRANCH_ENTRY_SIZE) == key) { i++; }
+	return (EdPgno *)(b->data + i*BRANCH_ENTRY_SIZE);
 }
 
+/*
+ * Leaf nodes store the keys in a dense array at the start of the data segment,
+ * followed by the remainder of each entry in a parallel array. Searches only
+ * read the key array. Entries are reassembled when returned from the cursor.
+ */
+
 static inline uint64_t
-leaf_key(EdBpt *l, uint16_t idx, size_t esize)
+leaf_key(EdBpt *l, uint16_t idx)
 {
 	assert(idx < l->nkeys);
-	return ed_fetch64(l->data + idx*esize);
+	return ed_fetch64(l->data + idx*LEAF_KEY_SIZE);
+}
+
+static inline uint8_t *
+leaf_value(EdBpt *l, uint32_t idx, size_t esize)
+{
+	return l->data + LEAF_ORDER(esize)*LEAF_KEY_SIZE + idx*(esize - LEAF_KEY_SIZE);
+}
+
+static void
+leaf_get(EdBpt *l, uint32_t idx, size_t esize, void *ent)
+{
+	memcpy(ent, l->data + idx*LEAF_KEY_SIZE, LEAF_KEY_SIZE);
+	memcpy((uint8_t *)ent + LEAF_KEY_SIZE, leaf_value(l, idx, esize), esize - LEAF_KEY_SIZE);
+}
+
+static void
+leaf_put(EdBpt *l, uint32_t idx, size_t esize, const void *ent)
+{
+	memcpy(l->data + idx*LEAF_KEY_SIZE, ent, LEAF_KEY_SIZE);
+	memcpy(leaf_value(l, idx, esize), (const uint8_t *)ent + LEAF_KEY_SIZE, esize - LEAF_KEY_SIZE);
+}
+
+/**
+ * @brief  Moves a run of entries within or between leaf nodes
+ * @param  dst  Destination leaf
+ * @param  didx  Destination entry index
+ * @param  src  Source leaf, which may be the same as #dst
+ * @param  sidx  Source entry index
+ * @param  n  Number of entries to move
+ * @param  esize  Entry size
+ */
+static void
+leaf_move(EdBpt *dst, uint32_t didx, EdBpt *src, uint32_t sidx, uint32_t n, size_t esize)
+{
+	if (n == 0) { return; }
+	memmove(dst->data + didx*LEAF_KEY_SIZE, src->data + sidx*LEAF_KEY_SIZE, n*LEAF_KEY_SIZE);
+	memmove(leaf_value(dst, didx, esize), leaf_value(src, sidx, esize),
+			n*(esize - LEAF_KEY_SIZE));
+}
+
+/**
+ * @brief  Copies the current cursor entry into the yield buffer
+ * @param  dbp  Transaction database object
+ * @return  Pointer to the assembled entry
+ */
+static void *
+leaf_entry(EdTxnDb *dbp)
+{
+	assert(dbp->entry_size <= sizeof(dbp->entbuf));
+	leaf_get(dbp->find->tree, dbp->entry_index, dbp->entry_size, dbp->entbuf);
+	return dbp->entbuf;
 }
 
 
@@ -100,8 +330,21 @@ ed_bpt_capacity(size_t esize, size_t depth)
 	return llround(pow(BRANCH_ORDER, depth-1) * LEAF_ORDER(esize));
 }
 
-int
-ed_bpt_find(EdTxn *txn, unsigned db, uint64_t key, void **ent)
+/**
+ * @brief  Searches the tree for the leaf and entry position of a key
+ *
+ * When #seek is true and the key is routed to the same leaf as the previous
+ * search, the descent is skipped and the leaf is searched directly.
+ *
+ * @param  txn  Transaction object
+ * @param  db  Database index
+ * @param  key  Key to search for
+ * @param  ent  Pointer to assign the matched entry to
+ * @param  seek  Allow reusing the leaf from the previous search
+ * @return  1 if found, 0 if not found, <0 on error
+ */
+static int
+find(EdTxn *txn, unsigned db, uint64_t key, void **ent, bool seek)
 {
 	if (txn->state != ED_TXN_OPEN) {
 		// FIXME: return proper error code
@@ -121,6 +364,16 @@ ed_bpt_find(EdTxn *txn, unsigned db, uint64_t key, void **ent)
 		goto done;
 	}
 
+	// The tree is unchanged since the last descent, so any key within the range
+	// routed to that leaf would end up there again.
+	if (seek && dbp->seek != NULL && dbp->seek_min <= key && key <= dbp->seek_max) {
+		node = dbp->find = dbp->seek;
+		kmin = dbp->seek_min;
+		kmax = dbp->seek_max;
+		dbp->nsplits = dbp->seek_nsplits;
+		goto leaf;
+	}
+
 	// The root node needs two pages when splitting.
 	dbp->nsplits = IS_FULL(node->tree, esize);
 
@@ -143,23 +396,28 @@ ed_bpt_find(EdTxn *txn, unsigned db, uint64_t key, void **ent)
 		node = next;
 		dbp->find = node;
 	}
+
+	dbp->seek = node;
+	dbp->seek_min = kmin;
+	dbp->seek_max = kmax;
+	dbp->seek_nsplits = dbp->nsplits;
+
+leaf:
 	if (IS_LEAF_FULL(node->tree, esize)) { dbp->nsplits++; }
 	else { dbp->nsplits = 0; }
+	dbp->find = node;
 
-	// Search the leaf node.
+	// Search the leaf keys. This lands on the first of any repeated keys.
 	data = node->tree->data;
-	for (i = 0, n = node->tree->nkeys; i < n; i++, data += esize) {
-		uint64_t cmp = ed_fetch64(data);
-		if (key == cmp) {
-			kmax = cmp;
-			rc = 1;
-			break;
-		}
-		else if (key < cmp) {
-			kmax = cmp;
-			break;
-		}
-		kmin = cmp;
+	n = node->tree->nkeys;
+	i = key_search(data, LEAF_KEY_SIZE, n, key);
+	if (i > 0) {
+		kmin = ed_fetch64(data + (i-1)*LEAF_KEY_SIZE);
+	}
+	data += i*LEAF_KEY_SIZE;
+	if (i < n) {
+		kmax = ed_fetch64(data);
+		rc = kmax == key;
 	}
 
 done:
@@ -175,7 +433,7 @@ done:
 		dbp->haskey = true;
 		if (rc == 1) {
 			dbp->hasentry = true;
-			if (ent) { *ent = data; }
+			if (ent) { *ent = leaf_entry(dbp); }
 		}
 		else {
 			dbp->hasentry = false;
@@ -186,6 +444,18 @@ done:
 	return rc;
 }
 
+int
+ed_bpt_find(EdTxn *txn, unsigned db, uint64_t key, void **ent)
+{
+	return find(txn, db, key, ent, false);
+}
+
+int
+ed_bpt_seek(EdTxn *txn, unsigned db, uint64_t key, void **ent)
+{
+	return find(txn, db, key, ent, true);
+}
+
 static uint64_t
 find_kmin(EdNode *node)
 {
@@ -193,7 +463,7 @@ find_kmin(EdNode *node)
 		return 0;
 	}
 	if (node->pindex > 0) {
-		return branch_key(node->parent->tree, node->pindex-1) - 1;
+		return branch_key(node->parent->tree, node->pindex);
 	}
 	return find_kmin(node->parent);
 }
@@ -235,7 +505,7 @@ move_first(EdTxn *txn, EdTxnDb *dbp, EdNode *from, uint64_t kmin, uint64_t kmax)
 	}
 	dbp->find = from;
 	if (from->tree->nkeys > 0) {
-		kmax = leaf_key(from->tree, 0, dbp->entry_size);
+		kmax = leaf_key(from->tree, 0);
 	}
 
 done:
@@ -276,7 +546,7 @@ move_last(EdTxn *txn, EdTxnDb *dbp, EdNode *from, uint64_t kmin, uint64_t kmax)
 	}
 	dbp->find = from;
 	if (from->tree->nkeys > 0) {
-		kmin = leaf_key(from->tree, from->tree->nkeys - 1, dbp->entry_size);
+		kmin = leaf_key(from->tree, from->tree->nkeys - 1);
 	}
 
 done:
@@ -284,7 +554,7 @@ done:
 		dbp->kmin = kmin;
 		dbp->kmax = kmax;
 		dbp->hasentry = true;
-		dbp->entry = dbp->find->tree->data + (dbp->find->tree->nkeys - 1) * dbp->entry_size;
+		dbp->entry = dbp->find->tree->data + (dbp->find->tree->nkeys - 1) * LEAF_KEY_SIZE;
 		dbp->entry_index = dbp->find->tree->nkeys - 1;
 	}
 	dbp->match = rc;
@@ -292,6 +562,61 @@ done:
 	return rc;
 }
 
+/**
+ * @brief  Requests read-ahead of the siblings following a node
+ *
+ * Iterating only maps the next leaf once the current one is exhausted, so a
+ * cold scan would otherwise stall on each page in turn. The next pages in the
+ * direction of travel are taken from the parent and requested ahead of time.
+ * A new window is only issued once the cursor has moved through half of the
+ * last one, and runs of consecutive page numbers are requested together.
+ *
+ * @param  txn  Transaction object
+ * @param  dbp  Transaction database object
+ * @param  node  Node the cursor moved to
+ * @param  right  Direction of travel
+ */
+static void
+prefetch_siblings(EdTxn *txn, EdTxnDb *dbp, EdNode *node, bool right)
+{
+	if (ED_BPT_PREFETCH == 0 || node == NULL || node->parent == NULL) { return; }
+
+	EdNode *parent = node->parent;
+
+	EdBpt *b = parent->tree;
+	int i = node->pindex, lo, hi;
+	if (dbp->prefetch_no != parent->page->no) {
+		dbp->prefetch_no = parent->page->no;
+		dbp->prefetch_lo = dbp->prefetch_hi = i;
+	}
+
+	if (right) {
+		if (dbp->prefetch_hi > i + ED_BPT_PREFETCH/2) { return; }
+		lo = (dbp->prefetch_hi > i ? dbp->prefetch_hi : i) + 1;
+		hi = i + ED_BPT_PREFETCH < b->nkeys ? i + ED_BPT_PREFETCH : b->nkeys;
+		if (hi > dbp->prefetch_hi) { dbp->prefetch_hi = hi; }
+	}
+	else {
+		if (dbp->prefetch_lo < i - ED_BPT_PREFETCH/2) { return; }
+		hi = (dbp->prefetch_lo < i ? dbp->prefetch_lo : i) - 1;
+		lo = i - ED_BPT_PREFETCH > 0 ? i - ED_BPT_PREFETCH : 0;
+		if (lo < dbp->prefetch_lo) { dbp->prefetch_lo = lo; }
+	}
+
+	EdPgno start = ED_PG_NONE, count = 0;
+	for (int k = lo; k <= hi; k++) {
+		EdPgno no = branch_ptr(b, k);
+		if (count > 0 && no == start + count) {
+			count++;
+			continue;
+		}
+		ed_pg_prefetch(txn->idx->fd, start, count);
+		start = no;
+		count = 1;
+	}
+	ed_pg_prefetch(txn->idx->fd, start, count);
+}
+
 /**
  * @brief  Moves the db find to a right sibling node
  * @param  txn  Transaction object
@@ -327,7 +652,9 @@ move_right(EdTxn *txn, EdTxnDb *dbp, EdNode *from)
 	} while (1);
 
 	// Traverse down to the left-most leaf.
-	return move_first(txn, dbp, from, kmin, kmax);
+	int rc = move_first(txn, dbp, from, kmin, kmax);
+	if (rc == 0) { prefetch_siblings(txn, dbp, dbp->find, true); }
+	return rc;
 }
 
 /**
@@ -364,21 +691,28 @@ move_left(EdTxn *txn, EdTxnDb *dbp, EdNode *from)
 		from = from->parent;
 	} while (1);
 
-	// Traverse down to the left-most leaf.
-	return move_last(txn, dbp, from, kmin, kmax);
+	// Traverse down to the right-most leaf.
+	int rc = move_last(txn, dbp, from, kmin, kmax);
+	if (rc == 0) { prefetch_siblings(txn, dbp, dbp->find, false); }
+	return rc;
 }
 
 int
 ed_bpt_first(EdTxn *txn, unsigned db, void **ent)
 {
 	EdTxnDb *dbp = &txn->db[db];
+	if (dbp->root == NULL || dbp->root->tree->nkeys == 0) {
+		if (ent) { *ent = NULL; }
+		return 0;
+	}
 
 	int rc = move_first(txn, dbp, dbp->root, 0, UINT64_MAX);
 	if (rc == 0) {
+		prefetch_siblings(txn, dbp, dbp->find, true);
 		dbp->start = dbp->entry;
 		dbp->nloops = 0;
 		dbp->hasfind = true;
-		if (ent) { *ent = dbp->entry; }
+		if (ent) { *ent = leaf_entry(dbp); }
 	}
 	return rc;
 }
@@ -387,13 +721,18 @@ int
 ed_bpt_last(EdTxn *txn, unsigned db, void **ent)
 {
 	EdTxnDb *dbp = &txn->db[db];
+	if (dbp->root == NULL || dbp->root->tree->nkeys == 0) {
+		if (ent) { *ent = NULL; }
+		return 0;
+	}
 
 	int rc = move_last(txn, dbp, dbp->root, 0, UINT64_MAX);
 	if (rc == 0) {
+		prefetch_siblings(txn, dbp, dbp->find, false);
 		dbp->start = dbp->entry;
 		dbp->nloops = 0;
 		dbp->hasfind = true;
-		if (ent) { *ent = dbp->entry; }
+		if (ent) { *ent = leaf_entry(dbp); }
 	}
 	return rc;
 }
@@ -403,7 +742,10 @@ ed_bpt_next(EdTxn *txn, unsigned db, void **ent)
 {
 	EdTxnDb *dbp = &txn->db[db];
 	if (!dbp->hasfind) { return ED_EINDEX_KEY_MATCH; }
-	if (dbp->find == NULL) { return 0; }
+	if (dbp->find == NULL || dbp->find->tree->nkeys == 0) {
+		if (ent) { *ent = NULL; }
+		return 0;
+	}
 
 	int rc = 0;
 	uint32_t i = dbp->entry_index;
@@ -414,7 +756,7 @@ ed_bpt_next(EdTxn *txn, unsigned db, void **ent)
 		if (rc < 0) { goto error; }
 	}
 	else if (dbp->hasentry) {
-		dbp->entry = (uint8_t *)dbp->entry + dbp->entry_size;
+		dbp->entry = (uint8_t *)dbp->entry + LEAF_KEY_SIZE;
 		dbp->entry_index++;
 		dbp->kmin = dbp->kmax;
 		dbp->kmax = ed_fetch64(dbp->entry);
@@ -433,7 +775,7 @@ ed_bpt_next(EdTxn *txn, unsigned db, void **ent)
 		}
 	}
 
-	if (ent) { *ent = dbp->entry; }
+	if (ent) { *ent = leaf_entry(dbp); }
 	if (dbp->entry == dbp->start) { dbp->nloops++; }
 	dbp->match = rc;
 	return rc;
@@ -449,7 +791,10 @@ ed_bpt_prev(EdTxn *txn, unsigned db, void **ent)
 {
 	EdTxnDb *dbp = &txn->db[db];
 	if (!dbp->hasfind) { return ED_EINDEX_KEY_MATCH; }
-	if (dbp->find == NULL) { return 0; }
+	if (dbp->find == NULL || dbp->find->tree->nkeys == 0) {
+		if (ent) { *ent = NULL; }
+		return 0;
+	}
 
 	int rc = 0;
 	uint32_t i = dbp->entry_index;
@@ -459,7 +804,7 @@ ed_bpt_prev(EdTxn *txn, unsigned db, void **ent)
 		if (rc < 0) { goto error; }
 	}
 	else {
-		dbp->entry = (uint8_t *)dbp->entry - dbp->entry_size;
+		dbp->entry = (uint8_t *)dbp->entry - LEAF_KEY_SIZE;
 		dbp->entry_index--;
 		dbp->kmax = dbp->kmin;
 		dbp->kmin = ed_fetch64(dbp->entry);
@@ -476,7 +821,7 @@ ed_bpt_prev(EdTxn *txn, unsigned db, void **ent)
 		}
 	}
 
-	if (ent) { *ent = dbp->entry; }
+	if (ent) { *ent = leaf_entry(dbp); }
 	if (dbp->entry == dbp->start) { dbp->nloops++; }
 	dbp->match = rc;
 	return rc;
@@ -628,7 +973,6 @@ split_point(EdTxnDb *dbp, EdBpt *l)
 {
 	uint16_t n = l->nkeys, mid = n/2, min, max;
 	uint64_t key;
-	size_t esize = dbp->entry_size;
 
 	// The split cannot be between repeated keys.
 	// If the searched index is around the mid point, use the key and search position.
@@ -641,19 +985,19 @@ split_point(EdTxnDb *dbp, EdBpt *l)
 	}
 	// Otherwise search back for the start of any repeat sequence.
 	else {
-		key = leaf_key(l, mid, esize);
+		key = leaf_key(l, mid);
 		if (key == dbp->key) {
 			min = dbp->entry_index - dbp->nmatches + 1;
 		}
 		else {
-			for (min = mid; min > 0 && leaf_key(l, min-1, esize) == key; min--) {}
+			for (min = mid; min > 0 && leaf_key(l, min-1) == key; min--) {}
 		}
 		max = mid + 1;
 	}
 
 	// If repeat keys span the mid point, pick the larger side to split on.
 	if (min != mid) {
-		for (; max < n && leaf_key(l, max, esize) == key; max++) {}
+		for (; max < n && leaf_key(l, max) == key; max++) {}
 		if (min == 0 && max == n) { return ED_EINDEX_DUPKEY; }
 		mid = min >= n - max ? min : max;
 	}
@@ -665,14 +1009,14 @@ split_leaf(EdTxn *txn, EdTxnDb *dbp, EdNode *leaf, int mid)
 {
 	size_t esize = dbp->entry_size;
 	uint32_t eidx = dbp->entry_index;
-	size_t off = mid * esize;
+	uint32_t n = leaf->tree->nkeys;
 
 	// If the new key will be the first entry on right, use the search key.
 	uint64_t rkey = (uint16_t)mid == eidx ?
-		dbp->key : ed_fetch64(leaf->tree->data+off);
+		dbp->key : leaf_key(leaf->tree, mid);
 
-	assert(ed_fetch64(leaf->tree->data + off - esize) < rkey);
-	assert(rkey <= ed_fetch64(leaf->tree->data + off));
+	assert(leaf_key(leaf->tree, mid - 1) < rkey);
+	assert(rkey <= leaf_key(leaf->tree, mid));
 
 	EdNode *left = leaf, *right;
 	int rc = ed_txn_alloc(txn, leaf->parent, leaf->pindex + 1, &right);
@@ -684,39 +1028,36 @@ split_leaf(EdTxn *txn, EdTxnDb *dbp, EdNode *leaf, int mid)
 
 	right->page->type = ED_PG_LEAF;
 	right->tree->next = ED_PG_NONE;
-	right->tree->nkeys = leaf->tree->nkeys - mid;
+	right->tree->nkeys = n - mid;
 	left->tree->nkeys = mid;
 
 	// The new entry goes on the left-side leaf.
 	if (eidx < (uint16_t)mid) {
 		dbp->find = left;
 		// Copy entries after the mid point to new right leaf.
-		memcpy(right->tree->data, leaf->tree->data+off, sizeof(leaf->tree->data) - off);
+		leaf_move(right->tree, 0, leaf->tree, mid, n - mid, esize);
 		// If left is a newly cloned node, copy the entries left of the new index.
 		if (left != leaf) {
-			memcpy(left->tree->data, leaf->tree->data, eidx*esize);
+			leaf_move(left->tree, 0, leaf->tree, 0, eidx, esize);
 		}
 		// Shift entries before the mid point over in left leaf.
-		memmove(left->tree->data + (eidx+1)*esize,
-				leaf->tree->data + eidx*esize,
-				(left->tree->nkeys - eidx) * esize);
+		leaf_move(left->tree, eidx+1, leaf->tree, eidx, mid - eidx, esize);
 	}
 	// The new entry goes on the right-side leaf.
 	else {
 		eidx -= mid;
 		if (left != leaf) {
-			memcpy(left->tree->data, leaf->tree->data, off);
+			leaf_move(left->tree, 0, leaf->tree, 0, mid, esize);
 		}
 		// Copy entries after the mid point but before the new index to new right leaf.
-		memcpy(right->tree->data, leaf->tree->data+off, eidx*esize);
+		leaf_move(right->tree, 0, leaf->tree, mid, eidx, esize);
 		// Copy entries after the mid point and after the new index to new right leaf.
-		memcpy(right->tree->data + (eidx+1)*esize,
-				leaf->tree->data + off + eidx*esize,
-				(right->tree->nkeys - eidx) * esize);
+		leaf_move(right->tree, eidx+1, leaf->tree, mid + eidx,
+				right->tree->nkeys - eidx, esize);
 		dbp->entry_index = eidx;
 		dbp->find = right;
 	}
-	dbp->entry = dbp->find->tree->data + eidx*esize;
+	dbp->entry = dbp->find->tree->data + eidx*LEAF_KEY_SIZE;
 
 	return insert_into_parent(txn, dbp, left, right, rkey);
 }
@@ -758,27 +1099,29 @@ insert_into_leaf(EdTxn *txn, EdTxnDb *dbp, const void *ent, bool replace)
 			int rc = ed_txn_clone(txn, src, &leaf);
 			if (rc < 0) { return rc; }
 			dbp->find = leaf;
-			dbp->entry = leaf->tree->data + eidx*esize;
+			dbp->entry = leaf->tree->data + eidx*LEAF_KEY_SIZE;
 			// When replacing, copy the full data. Otherwise only copy left of then new
-			// insertion index. The following memmove will copy the right side.
-			memcpy(leaf->tree->data, src->tree->data,
-					replace ? sizeof(src->tree->data) : eidx*esize);
+			// insertion index. The following move will copy the right side.
+			if (replace) {
+				memcpy(leaf->tree->data, src->tree->data, sizeof(src->tree->data));
+			}
+			else {
+				leaf_move(leaf->tree, 0, src->tree, 0, eidx, esize);
+			}
 		}
 		if (!replace) {
 			// Shift all entries after the new index over. The src node must be part of
 			// the current transaction at this point. If the node was cloned, this will
 			// copy the remaining data from the previous version. Otherwise, this will
 			// shift the entries in place.
-			memmove(leaf->tree->data + eidx*esize + esize,
-					src->tree->data + eidx*esize,
-					(src->tree->nkeys - eidx)*esize);
+			leaf_move(leaf->tree, eidx+1, src->tree, eidx, src->tree->nkeys - eidx, esize);
 			leaf->tree->nkeys++;
 		}
 	}
 
 	// The insert location is now available for assignment and it is part of the
 	// current transaction.
-	memcpy(dbp->entry, ent, esize);
+	leaf_put(leaf->tree, dbp->entry_index, esize, ent);
 	return set_leaf(txn, dbp, leaf, eidx);
 }
 
@@ -792,6 +1135,7 @@ ed_bpt_set(EdTxn *txn, unsigned db, const void *ent, bool replace)
 	if (!dbp->hasfind || key < dbp->kmin || key > dbp->kmax) {
 		return ED_EINDEX_KEY_MATCH;
 	}
+	dbp->seek = NULL;
 
 	int rc = insert_into_leaf(txn, dbp, ent, replace && dbp->match == 1);
 	if (rc < 0) {
@@ -810,53 +1154,391 @@ ed_bpt_set(EdTxn *txn, unsigned db, const void *ent, bool replace)
 	return 0;
 }
 
+/**
+ * @brief  Ensures a node is part of the current transaction
+ *
+ * A node from a prior transaction is cloned and linked into its parent.
+ *
+ * @param  txn  Transaction object
+ * @param  dbp  Transaction database object
+ * @param  nodep  Indirect pointer to the node, updated to the clone
+ * @return  0 on success, <0 on error
+ */
+static int
+node_writable(EdTxn *txn, EdTxnDb *dbp, EdNode **nodep)
+{
+	EdNode *src = *nodep, *node;
+	if (src->tree->xid == txn->xid) { return 0; }
+
+	int rc = ed_txn_clone(txn, src, &node);
+	if (rc < 0) { return rc; }
+	memcpy(node->tree->data, src->tree->data, sizeof(node->tree->data));
+	rc = set_node(txn, dbp, node);
+	if (rc < 0) { return rc; }
+	*nodep = node;
+	return 0;
+}
+
+/**
+ * @brief  Removes a key and the pointer to its right from a branch
+ * @param  b  Branch node
+ * @param  idx  Index of the pointer to remove
+ */
+static void
+branch_remove(EdBpt *b, uint16_t idx)
+{
+	assert(0 < idx && idx <= b->nkeys);
+	size_t pos = BRANCH_PTR_SIZE + (idx-1)*BRANCH_ENTRY_SIZE;
+	memmove(b->data + pos, b->data + pos + BRANCH_ENTRY_SIZE,
+			(b->nkeys - idx)*BRANCH_ENTRY_SIZE);
+	b->nkeys--;
+}
+
+/**
+ * @brief  Finds the leaf split position nearest to #pos
+ *
+ * Repeated keys cannot be divided between leaves, so the position is moved
+ * to the nearest boundary between two different keys.
+ *
+ * @param  l  Leaf node
+ * @param  pos  Preferred position
+ * @return  Position in the range [1,nkeys-1] or 0 if there is none
+ */
+static uint32_t
+leaf_boundary(EdBpt *l, uint32_t pos)
+{
+	uint32_t n = l->nkeys;
+	for (uint32_t d = 0; d < n; d++) {
+		if (pos > d && pos - d < n &&
+				leaf_key(l, pos-d-1) != leaf_key(l, pos-d)) {
+			return pos - d;
+		}
+		if (pos + d > 0 && pos + d < n &&
+				leaf_key(l, pos+d-1) != leaf_key(l, pos+d)) {
+			return pos + d;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief  Merges or refills an underfull node from a sibling
+ *
+ * The node is paired with its left sibling, or its right sibling when it is
+ * the first child. If both fit into one page, the right node is merged into
+ * the left and removed from the parent. Otherwise, entries are shifted over
+ * from the sibling to even out the two nodes.
+ *
+ * The node must be part of the current transaction. An index into the node is
+ * carried through the move: for leaves this is the cursor entry, and for
+ * branches it is the child on the cursor path.
+ *
+ * @param  txn  Transaction object
+ * @param  dbp  Transaction database object
+ * @param  nodep  Indirect pointer to the node, updated if it is merged left
+ * @param  idxp  Pointer to the index within the node
+ * @return  1 if merged, 0 if not, <0 on error
+ */
+static int
+rebalance(EdTxn *txn, EdTxnDb *dbp, EdNode **nodep, uint32_t *idxp)
+{
+	EdNode *node = *nodep, *parent = node->parent, *sib, *left, *right;
+	size_t esize = dbp->entry_size;
+	bool leaf = !IS_BRANCH(node->tree);
+	uint32_t order = leaf ? LEAF_ORDER(esize) : BRANCH_ORDER - 1;
+	uint64_t sep;
+
+	assert(parent != NULL && parent->tree->xid == txn->xid);
+	if (parent->tree->nkeys == 0) { return 0; }
+
+	uint16_t pidx = node->pindex > 0 ? node->pindex - 1 : node->pindex + 1;
+	int rc = ed_txn_map(txn, branch_ptr(parent->tree, pidx), parent, pidx, &sib);
+	if (rc < 0) { return rc; }
+
+	bool isleft = pidx > node->pindex;
+	uint32_t nl = isleft ? node->tree->nkeys : sib->tree->nkeys;
+	uint32_t nr = isleft ? sib->tree->nkeys : node->tree->nkeys;
+
+	// Merge the right node into the left. Branches also pull down the separator.
+	if (nl + nr + !leaf <= order) {
+		if (!isleft) {
+			rc = node_writable(txn, dbp, &sib);
+			if (rc < 0) { return rc; }
+		}
+		left = isleft ? node : sib;
+		right = isleft ? sib : node;
+		if (leaf) {
+			leaf_move(left->tree, nl, right->tree, 0, nr, esize);
+		}
+		else {
+			uint8_t *end = left->tree->data + BRANCH_PTR_SIZE + nl*BRANCH_ENTRY_SIZE;
+			sep = branch_key(parent->tree, right->pindex);
+			memcpy(end, &sep, sizeof(sep));
+			memcpy(end + BRANCH_KEY_SIZE, right->tree->data,
+					BRANCH_PTR_SIZE + nr*BRANCH_ENTRY_SIZE);
+		}
+		left->tree->nkeys = nl + nr + !leaf;
+		rc = ed_txn_discard(txn, right);
+		if (rc < 0) { return rc; }
+		branch_remove(parent->tree, right->pindex);
+		if (node == right) {
+			*idxp += nl + !leaf;
+			*nodep = left;
+		}
+		return 1;
+	}
+
+	rc = node_writable(txn, dbp, &sib);
+	if (rc < 0) { return rc; }
+	left = isleft ? node : sib;
+	right = isleft ? sib : node;
+
+	// Move the first entries of the right node onto the end of the left.
+	if (isleft) {
+		uint32_t m = (nr - nl) / 2;
+		if (leaf) {
+			m = leaf_boundary(right->tree, m);
+			if (m == 0 || nl + m > order) { return 0; }
+			leaf_move(left->tree, nl, right->tree, 0, m, esize);
+			leaf_move(right->tree, 0, right->tree, m, nr - m, esize);
+			sep = ed_fetch64(right->tree->data);
+		}
+		else {
+			assert(m > 0);
+			uint8_t *end = left->tree->data + BRANCH_PTR_SIZE + nl*BRANCH_ENTRY_SIZE;
+			uint64_t down = branch_key(parent->tree, right->pindex);
+			sep = branch_key(right->tree, m);
+			memcpy(end, &down, sizeof(down));
+			memcpy(end + BRANCH_KEY_SIZE, right->tree->data,
+					BRANCH_PTR_SIZE + (m-1)*BRANCH_ENTRY_SIZE);
+			memmove(right->tree->data, right->tree->data + m*BRANCH_ENTRY_SIZE,
+					BRANCH_PTR_SIZE + (nr-m)*BRANCH_ENTRY_SIZE);
+		}
+		left->tree->nkeys = nl + m;
+		right->tree->nkeys = nr - m;
+	}
+	// Move the last entries of the left node onto the start of the right.
+	else {
+		uint32_t m = (nl - nr) / 2;
+		if (leaf) {
+			m = leaf_boundary(left->tree, nl - m);
+			if (m == 0 || nr + (nl - m) > order) { return 0; }
+			m = nl - m;
+			leaf_move(right->tree, m, right->tree, 0, nr, esize);
+			leaf_move(right->tree, 0, left->tree, nl - m, m, esize);
+			sep = ed_fetch64(right->tree->data);
+		}
+		else {
+			assert(m > 0);
+			uint64_t down = branch_key(parent->tree, right->pindex);
+			sep = branch_key(left->tree, nl - m + 1);
+			memmove(right->tree->data + m*BRANCH_ENTRY_SIZE, right->tree->data,
+					BRANCH_PTR_SIZE + nr*BRANCH_ENTRY_SIZE);
+			memcpy(right->tree->data, left->tree->data + (nl-m+1)*BRANCH_ENTRY_SIZE,
+					BRANCH_PTR_SIZE + (m-1)*BRANCH_ENTRY_SIZE);
+			memcpy(right->tree->data + BRANCH_PTR_SIZE + (m-1)*BRANCH_ENTRY_SIZE,
+					&down, sizeof(down));
+		}
+		left->tree->nkeys = nl - m;
+		right->tree->nkeys = nr + m;
+		*idxp += m;
+	}
+	branch_set_key(parent->tree, right->pindex, sep);
+	return 0;
+}
+
 int
 ed_bpt_del(EdTxn *txn, unsigned db)
 {
-	// FIXME: this function is terrible
 	if (ed_txn_isrdonly(txn)) { return ED_EINDEX_RDONLY; }
 
 	EdTxnDb *dbp = ed_txn_db(txn, db, false);
 	if (!dbp->hasfind) { return ED_EINDEX_RDONLY; }
 	if (!dbp->hasentry) { return 0; }
+	dbp->seek = NULL;
 
 	EdNode *leaf = dbp->find;
 	size_t esize = dbp->entry_size;
 	uint32_t eidx = dbp->entry_index;
 
-	if (leaf->tree->xid < txn->xid) {
-		EdNode *src = leaf;
-		int rc = ed_txn_clone(txn, src, &leaf);
-		if (rc < 0) { return rc; }
-		memcpy(leaf->tree->data, src->tree->data, sizeof(leaf->tree->data));
-		rc = set_node(txn, dbp, leaf);
-		if (rc < 0) { return rc; }
-		dbp->entry = leaf->tree->data + esize*eidx;
-		dbp->find = leaf;
-	}
-
-	memmove(dbp->entry, (uint8_t *)dbp->entry + esize,
-			(leaf->tree->nkeys - eidx - 1) * esize);
-	if (leaf->tree->nkeys == 1) {
-		leaf->tree->nkeys = 0;
-	}
-	else {
-		leaf->tree->nkeys--;
-#if 0
-		if (leaf->parent && eidx == 0) {
-			branch_set_key(leaf->parent->tree, leaf->pindex, ed_fetch64(dbp->entry));
+	int rc = node_writable(txn, dbp, &leaf);
+	if (rc < 0) { goto error; }
+
+	leaf_move(leaf->tree, eidx, leaf->tree, eidx+1, leaf->tree->nkeys - eidx - 1, esize);
+	leaf->tree->nkeys--;
+
+	// Rebalance up the cursor path while merges leave parents underfull. The
+	// path node and index at each level are tracked so the cursor remains on
+	// the entry following the removed one.
+	EdNode *node = leaf, *child = NULL;
+	uint32_t idx = eidx;
+	while (node->parent != NULL) {
+		uint32_t min = IS_BRANCH(node->tree) ? BRANCH_MIN : LEAF_MIN(esize);
+		if (node->tree->nkeys >= min) { break; }
+		rc = rebalance(txn, dbp, &node, &idx);
+		if (rc < 0) { goto error; }
+		if (child == NULL) {
+			leaf = node;
+			eidx = idx;
 		}
-#endif
-	}
-	if (dbp->entry_index == leaf->tree->nkeys) {
-		dbp->kmax = find_kmax(leaf);
+		else {
+			child->parent = node;
+			child->pindex = idx;
+		}
+		if (rc == 0) { break; }
+		child = node;
+		idx = node->pindex;
+		node = node->parent;
 	}
-	else {
-		dbp->kmax = ed_fetch64(dbp->entry);
+
+	// A root branch with a single child is replaced by that child.
+	for (node = dbp->root; IS_BRANCH(node->tree) && node->tree->nkeys == 0; ) {
+		EdNode *next;
+		rc = ed_txn_map(txn, branch_ptr(node->tree, 0), NULL, 0, &next);
+		if (rc < 0) { goto error; }
+		rc = ed_txn_discard(txn, node);
+		if (rc < 0) { goto error; }
+		dbp->root = node = next;
 	}
+
+	dbp->find = leaf;
+	dbp->entry = leaf->tree->data + eidx*LEAF_KEY_SIZE;
+	dbp->entry_index = eidx;
+	dbp->kmin = eidx > 0 ? leaf_key(leaf->tree, eidx-1) : find_kmin(leaf);
+	dbp->kmax = eidx < leaf->tree->nkeys ? leaf_key(leaf->tree, eidx) : find_kmax(leaf);
 	dbp->nmatches = 0;
 	dbp->hasentry = false;
 	return 1;
+
+error:
+	txn->error = rc;
+	return rc;
+}
+
+/*
+ * Bulk loading fills pages straight from a sorted entry array. Leaves are
+ * packed full, and each level of branches is built from the first key and page
+ * number of the level below it.
+ */
+
+#define LOAD_BATCH 64
+
+typedef struct {
+	EdIdx *idx;
+	EdPg *pg[LOAD_BATCH];
+	EdPgno head, count;
+} LoadPool;
+
+typedef struct {
+	uint64_t key;
+	EdPgno no;
+} LoadRef;
+
+static int
+load_page(LoadPool *pool, EdTxnId xid, uint32_t type, EdBpt **bptp)
+{
+	if (pool->head == pool->count) {
+		int rc = ed_alloc(pool->idx, pool->pg, LOAD_BATCH, true);
+		if (rc < 0) { return rc; }
+		pool->head = 0;
+		pool->count = (EdPgno)rc;
+	}
+	EdBpt *bpt = (EdBpt *)pool->pg[pool->head++];
+	bpt->base.type = type;
+	bpt->xid = xid;
+	bpt->next = ED_PG_NONE;
+	bpt->nkeys = 0;
+	memset(bpt->data, 0, sizeof(bpt->data));
+	*bptp = bpt;
+	return 0;
+}
+
+static int
+load_ref(LoadRef **refs, size_t *nrefs, size_t *cap, uint64_t key, EdPgno no)
+{
+	if (*nrefs == *cap) {
+		size_t ncap = *cap ? *cap * 2 : 64;
+		LoadRef *tmp = realloc(*refs, ncap * sizeof(*tmp));
+		if (tmp == NULL) { return ED_ERRNO; }
+		*refs = tmp;
+		*cap = ncap;
+	}
+	(*refs)[*nrefs] = (LoadRef){ key, no };
+	(*nrefs)++;
+	return 0;
+}
+
+int
+ed_bpt_load(EdIdx *idx, EdTxnId xid, const void *ents, size_t n, size_t esize, EdPgno *root)
+{
+	assert(esize <= ED_ENTRY_MAX);
+
+	const uint8_t *p = ents;
+	const size_t order = LEAF_ORDER(esize);
+	LoadPool pool = { .idx = idx };
+	LoadRef *refs = NULL;
+	size_t nrefs = 0, cap = 0;
+	int rc = 0;
+
+	*root = ED_PG_NONE;
+
+	for (size_t i = 0; i < n; ) {
+		size_t cnt = n - i < order ? n - i : order;
+
+		// A run of repeated keys cannot span leaves, so end the leaf before it.
+		if (i + cnt < n) {
+			uint64_t next = ed_fetch64(p + (i+cnt)*esize);
+			while (cnt > 0 && ed_fetch64(p + (i+cnt-1)*esize) == next) { cnt--; }
+			if (cnt == 0) { rc = ED_EINDEX_DUPKEY; goto done; }
+		}
+
+		EdBpt *leaf;
+		rc = load_page(&pool, xid, ED_PG_LEAF, &leaf);
+		if (rc < 0) { goto done; }
+		leaf->nkeys = (uint16_t)cnt;
+		for (size_t k = 0; k < cnt; k++) {
+			assert(i+k == 0 || ed_fetch64(p + (i+k-1)*esize) <= ed_fetch64(p + (i+k)*esize));
+			leaf_put(leaf, k, esize, p + (i+k)*esize);
+		}
+		rc = load_ref(&refs, &nrefs, &cap, leaf_key(leaf, 0), leaf->base.no);
+		ed_pg_unmap(leaf, 1);
+		if (rc < 0) { goto done; }
+		i += cnt;
+	}
+
+	// Each branch level is written over the front of the reference array. The
+	// children are spread evenly so the last branch is not left nearly empty.
+	while (nrefs > 1) {
+		size_t nout = 0;
+		for (size_t i = 0; i < nrefs; ) {
+			size_t remain = nrefs - i;
+			size_t cnt = ED_COUNT_SIZE(remain, ED_COUNT_SIZE(remain, BRANCH_ORDER));
+
+			EdBpt *branch;
+			rc = load_page(&pool, xid, ED_PG_BRANCH, &branch);
+			if (rc < 0) { goto done; }
+			branch->nkeys = (uint16_t)(cnt - 1);
+			for (size_t k = 0; k < cnt; k++) {
+				branch_set_ptr(branch, k, refs[i+k].no);
+				branch_set_key(branch, k, refs[i+k].key);
+			}
+			refs[nout++] = (LoadRef){ refs[i].key, branch->base.no };
+			ed_pg_unmap(branch, 1);
+			i += cnt;
+		}
+		nrefs = nout;
+	}
+
+	if (nrefs == 1) { *root = refs[0].no; }
+
+done:
+	// Return any pages that were allocated but not used.
+	if (pool.head < pool.count) {
+		int frc = ed_free(idx, 0, pool.pg + pool.head, pool.count - pool.head);
+		if (rc == 0) { rc = frc; }
+	}
+	free(refs);
+	return rc;
 }
 
 static int
@@ -1000,10 +1682,12 @@ print_leaf(int fd, size_t esize, EdBpt *leaf, FILE *out, EdBptPrint print, bool
 		return;
 	}
 
-	uint8_t *p = leaf->data;
-	for (uint32_t i = 0; i < n; i++, p += esize) {
+	uint8_t ent[ED_ENTRY_MAX];
+	assert(esize <= sizeof(ent));
+	for (uint32_t i = 0; i < n; i++) {
 		char buf[COLW+1];
-		int len = print(p, buf, sizeof(buf));
+		leaf_get(leaf, i, esize, ent);
+		int len = print(ent, buf, sizeof(buf));
 		if (len < 0 || len > (int)COLW) {
 			len = 0;
 		}
@@ -1074,10 +1758,9 @@ verify_leaf(int fd, size_t esize, EdBpt *l, FILE *out, uint64_t min, uint64_t ma
 {
 	if (l->nkeys == 0) { return 0; }
 
-	uint8_t *p = l->data;
 	uint64_t last;
-	for (uint32_t i = 0; i < l->nkeys; i++, p += esize) {
-		uint64_t key = ed_fetch64(p);
+	for (uint32_t i = 0; i < l->nkeys; i++) {
+		uint64_t key = leaf_key(l, i);
 		if (key < min || key > max) {
 			if (out != NULL) {
 				fprintf(out,
@@ -11,6 +11,38 @@ obj_id(const char *id, EdTxnId *xid, EdBlkno *vno)
 	return 0;
 }
 
+/**
+ * @brief  Selects the partition of a sharded cache that holds a key
+ * @param  cache  Sharded cache handle
+ * @param  k  Key bytes
+ * @param  klen  Length of #k
+ * @return  partition number
+ */
+static unsigned
+shard_key(const EdCache *cache, const void *k, size_t klen)
+{
+	return (unsigned)(ed_hash(k, klen, cache->shards[0]->idx.seed) % cache->nshards);
+}
+
+/**
+ * @brief  Parses the partition prefix from an object id of a sharded cache
+ * @param  cache  Sharded cache handle
+ * @param  id  Object id
+ * @param  shard  Assigned the partition number
+ * @param  rest  Assigned the object id within the partition
+ * @return  0 on success, <0 error code
+ */
+static int
+shard_id(const EdCache *cache, const char *id, unsigned *shard, const char **rest)
+{
+	char *end;
+	unsigned long n = strtoul(id, &end, 16);
+	if (end == id || *end != '.' || n >= cache->nshards) { return ED_EOBJECT_ID; }
+	*shard = (unsigned)n;
+	*rest = end + 1;
+	return 0;
+}
+
 static int
 obj_new(EdObject **objp, const void *k, size_t klen, bool rdonly)
 {
@@ -95,7 +127,13 @@ obj_init_basic(EdObject *obj, EdCache *cache, EdObjectHdr *hdr, EdBlkno vno, boo
 	obj->nbytes = size;
 	obj->exp = exp;
 	obj->rdonly = rdonly;
-	snprintf(obj->id, sizeof(obj->id), "%" PRIx64 ":%" PRIx64, obj->xid, vno);
+	if (cache->shard >= 0) {
+		snprintf(obj->id, sizeof(obj->id), "%x.%" PRIx64 ":%" PRIx64,
+				(unsigned)cache->shard, obj->xid, vno);
+	}
+	else {
+		snprintf(obj->id, sizeof(obj->id), "%" PRIx64 ":%" PRIx64, obj->xid, vno);
+	}
 }
 
 static void
@@ -103,7 +141,7 @@ obj_init(EdObject *obj, EdCache *cache, EdObjectHdr *hdr, EdBlkno vno, bool rdon
 {
 	obj_init_basic(obj, cache, hdr, vno, rdonly, exp);
 	obj->meta = obj_meta(hdr);
-	obj->data = obj_data(hdr, cache->idx.flags);
+	obj->data = obj->nomap ? NULL : obj_data(hdr, cache->idx.flags);
 }
 
 static int
@@ -113,7 +151,7 @@ obj_verify(const EdObject *obj, const uint64_t flags)
 		if (obj->metalen && ed_crc32c(0, obj->meta, obj->metalen) != obj->metacrc) {
 			return ED_EOBJECT_METACRC;
 		}
-		if (obj->datalen && ed_crc32c(0, obj->data, obj->datalen) != obj->datacrc) {
+		if (obj->datalen && obj->data && ed_crc32c(0, obj->data, obj->datalen) != obj->datacrc) {
 			return ED_EOBJECT_DATACRC;
 		}
 	}
@@ -137,33 +175,452 @@ obj_hdr_final(EdObjectHdr *hdr, size_t nbytes, uint64_t flags)
 	memset(data, 0, nbytes - (data - (uint8_t *)hdr));
 }
 
+static size_t
+slab_size(const EdCache *cache)
+{
+	return (size_t)cache->slab_block_count * cache->slab_block_size;
+}
+
+/**
+ * @brief  Tests if objects may be placed across the end of the slab
+ *
+ * Wrapped objects are mapped with #ed_blk_map_ring(), which needs the end of
+ * the slab to fall on a page boundary.
+ *
+ * @param  cache  Cache handle
+ * @return  true if wrapped placement is supported
+ */
+static bool
+slab_wraps(const EdCache *cache)
+{
+	return slab_size(cache) % PAGESIZE == 0;
+}
+
+static void *
+slab_map(const EdCache *cache, EdBlkno no, EdBlkno count, bool need)
+{
+	return ed_blk_map_ring(cache->idx.slabfd, no, count, cache->slab_block_size,
+			cache->slab_block_count, need);
+}
+
+/**
+ * @brief  Resolves an object byte position to a slab offset
+ *
+ * Positions past the end of the slab are wrapped to the start, and the length
+ * is clamped so that a single request does not cross the end.
+ *
+ * @param  cache  Cache handle
+ * @param  pos  Unwrapped byte position
+ * @param  len  Length to clamp
+ * @return  Byte offset in the slab
+ */
+static off_t
+slab_pos(const EdCache *cache, size_t pos, size_t *len)
+{
+	const size_t size = slab_size(cache);
+	if (pos >= size) { pos -= size; }
+	if (*len > size - pos) { *len = size - pos; }
+	return (off_t)pos;
+}
+
+/**
+ * @brief  Locks a byte range of the slab that may wrap past the end
+ *
+ * Locks are held in the shared lock table of the index rather than as file
+ * locks. Wrapped ranges are locked as two regions. If the second region cannot
+ * be locked, the first is released again.
+ *
+ * @param  cache  Cache handle
+ * @param  type  Lock type
+ * @param  start  Byte offset in the slab
+ * @param  len  Number of bytes to lock
+ * @param  flags  Lock flags
+ * @return  0 on success, <0 error code
+ */
+static int
+slab_lck(EdCache *cache, EdLckType type, off_t start, off_t len, uint64_t flags)
+{
+	EdIdx *idx = &cache->idx;
+	const off_t size = (off_t)slab_size(cache);
+	if (start + len <= size) {
+		return ed_idx_slab_lck(idx, type, start, len, flags);
+	}
+
+	int rc = ed_idx_slab_lck(idx, type, start, size - start, flags);
+	if (rc < 0) { return rc; }
+	rc = ed_idx_slab_lck(idx, type, 0, start + len - size, flags);
+	if (rc < 0 && type != ED_LCK_UN) {
+		ed_idx_slab_lck(idx, ED_LCK_UN, start, size - start, flags);
+	}
+	return rc;
+}
+
+/**
+ * @brief  Reads an exact number of bytes from the slab
+ *
+ * Reads that extend past the end of the slab continue from the start.
+ *
+ * @param  cache  Cache handle
+ * @param  buf  Buffer to read into
+ * @param  len  Number of bytes to read
+ * @param  off  Byte offset in the slab
+ * @return  0 on success, <0 error code
+ */
+static int
+slab_pread(EdCache *cache, void *buf, size_t len, off_t off)
+{
+	const off_t size = (off_t)slab_size(cache);
+	uint8_t *p = buf;
+	while (len > 0) {
+		if (off >= size) { off -= size; }
+		size_t max = (size_t)(size - off) < len ? (size_t)(size - off) : len;
+		ssize_t n = pread(cache->idx.slabfd, p, max, off);
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			return ED_ERRNO;
+		}
+		if (n == 0) { return ed_esys(EIO); }
+		p += n;
+		len -= (size_t)n;
+		off += n;
+	}
+	return 0;
+}
+
+/**
+ * @brief  Writes an exact number of bytes to the slab using the O_DIRECT descriptor
+ *
+ * Writes that extend past the end of the slab continue from the start. The
+ * end of the slab is block aligned, so both writes remain aligned.
+ *
+ * @param  cache  Cache handle
+ * @param  buf  Aligned buffer to write from
+ * @param  len  Number of bytes to write
+ * @param  off  Byte offset in the slab
+ * @return  0 on success, <0 error code
+ */
+static int
+slab_pwrite(EdCache *cache, const void *buf, size_t len, off_t off)
+{
+	const off_t size = (off_t)slab_size(cache);
+	const uint8_t *p = buf;
+	while (len > 0) {
+		if (off >= size) { off -= size; }
+		size_t max = (size_t)(size - off) < len ? (size_t)(size - off) : len;
+		ssize_t n = pwrite(cache->idx.slabdfd, p, max, off);
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			return ED_ERRNO;
+		}
+		if (n == 0) { return ed_esys(EIO); }
+		p += n;
+		len -= (size_t)n;
+		off += n;
+	}
+	return 0;
+}
+
+/**
+ * @brief  Copies the header, key and meta segments of an object into memory
+ *
+ * This is used in place of mapping the object when opening with #ED_ONOMAP.
+ * The data segment is left in the slab to be read with #ed_read().
+ *
+ * @param  cache  Cache handle
+ * @param  no  Slab block number
+ * @param  count  Number of blocks used by the object
+ * @return  Allocated header or MAP_FAILED on error
+ */
+static EdObjectHdr *
+obj_hdr_copy(EdCache *cache, EdBlkno no, EdBlkno count)
+{
+	const uint16_t block_size = cache->slab_block_size;
+	const off_t off = (off_t)(no * block_size);
+	const size_t max = count * block_size;
+	size_t len = max < ED_OBJ_COPY_SIZE ? max : ED_OBJ_COPY_SIZE;
+	EdObjectHdr *hdr = NULL;
+	int rc;
+
+	if (len < sizeof(*hdr) || (hdr = malloc(len)) == NULL) { goto error; }
+	if ((rc = slab_pread(cache, hdr, len, off)) < 0) { goto error_rc; }
+
+	// Large keys or meta data may extend beyond the initial read.
+	size_t need = obj_data_offset(hdr->keylen, hdr->metalen, cache->idx.flags);
+	if (need > max) {
+		errno = EINVAL;
+		goto error;
+	}
+	if (need > len) {
+		EdObjectHdr *tmp = realloc(hdr, need);
+		if (tmp == NULL) { goto error; }
+		hdr = tmp;
+		rc = slab_pread(cache, (uint8_t *)hdr + len, need - len, off + (off_t)len);
+		if (rc < 0) { goto error_rc; }
+	}
+	return hdr;
+
+error_rc:
+	errno = ed_ecode(rc);
+error:
+	free(hdr);
+	return MAP_FAILED;
+}
+
+static EdObjectHdr *
+obj_hdr_open(EdCache *cache, EdBlkno no, EdBlkno count, bool nomap)
+{
+	if (nomap) {
+		return obj_hdr_copy(cache, no, count);
+	}
+	return slab_map(cache, no, count, false);
+}
+
+static void
+obj_hdr_close(EdCache *cache, EdObjectHdr *hdr, EdBlkno count, bool nomap)
+{
+	if (nomap) {
+		free(hdr);
+	}
+	else {
+		ed_blk_unmap(hdr, count, cache->slab_block_size);
+	}
+}
+
+/**
+ * @brief  Allocates staging buffers for writing a new object with #ED_FDIRECT
+ *
+ * The head buffer holds the header, key, meta data and the start of the data.
+ * It is written last, when the object is closed. Any data beyond it is staged
+ * in the tail buffer, which is written each time it fills. Both lengths are
+ * multiples of the block size, so every write is aligned for O_DIRECT.
+ *
+ * Direct objects are marked as unmapped so the head buffer is freed with
+ * #obj_hdr_close().
+ *
+ * @param  obj  Object to set up
+ * @param  nbytes  Number of bytes used by the object in the slab
+ * @param  dataoff  Offset of the data segment
+ * @param  block_size  Slab block size
+ * @return  Head buffer or MAP_FAILED on error
+ */
+static EdObjectHdr *
+obj_direct_alloc(EdObject *obj, size_t nbytes, size_t dataoff, size_t block_size)
+{
+	const size_t max = ED_ALIGN_SIZE(ED_DIRECT_SIZE, block_size);
+	size_t head = nbytes, tail = 0;
+	void *buf;
+
+	if (nbytes > max) {
+		head = ED_ALIGN_SIZE(dataoff, block_size);
+		if (head < max) { head = max; }
+		if (head > nbytes) { head = nbytes; }
+		tail = nbytes - head < max ? nbytes - head : max;
+	}
+
+	int err = posix_memalign(&buf, PAGESIZE, head + tail);
+	if (err != 0) {
+		errno = err;
+		return MAP_FAILED;
+	}
+	memset(buf, 0, head + tail);
+
+	obj->nomap = true;
+	obj->tail = tail ? (uint8_t *)buf + head : NULL;
+	obj->headlen = head;
+	obj->taillen = tail;
+	obj->tailpos = head;
+	return buf;
+}
+
+/**
+ * @brief  Copies data into the staging buffers of a direct object
+ *
+ * The tail buffer is written out once it is full and more data follows.
+ *
+ * @param  obj  Writable direct object
+ * @param  buf  Data to write
+ * @param  len  Number of bytes to write
+ * @param  flags  Cache flags
+ * @return  0 on success, <0 error code
+ */
+static int
+obj_direct_write(EdObject *obj, const void *buf, size_t len, uint64_t flags)
+{
+	const uint8_t *src = buf;
+	size_t pos = obj_data_offset(obj->keylen, obj->metalen, flags) + obj->dataseek;
+
+	while (len > 0) {
+		uint8_t *dst;
+		size_t n;
+		if (pos < obj->headlen) {
+			dst = (uint8_t *)obj->hdr + pos;
+			n = obj->headlen - pos;
+		}
+		else {
+			if (pos == obj->tailpos + obj->taillen) {
+				int rc = slab_pwrite(obj->cache, obj->tail, obj->taillen,
+						(off_t)(obj->byte + obj->tailpos));
+				if (rc < 0) { return rc; }
+				obj->tailpos += obj->taillen;
+			}
+			dst = obj->tail + (pos - obj->tailpos);
+			n = obj->tailpos + obj->taillen - pos;
+		}
+		if (n > len) { n = len; }
+		memcpy(dst, src, n);
+		src += n;
+		len -= n;
+		pos += n;
+	}
+
+	if (flags & ED_FCHECKSUM) {
+		obj->datacrc = ed_crc32c(obj->datacrc, buf, (size_t)(src - (const uint8_t *)buf));
+	}
+	return 0;
+}
+
+/**
+ * @brief  Writes the remaining tail and then the head of a direct object
+ *
+ * Writing the head last keeps the header from describing an object whose
+ * data is not yet in the slab.
+ *
+ * @param  obj  Writable direct object with all data written
+ * @param  flags  Cache flags
+ * @return  0 on success, <0 error code
+ */
+static int
+obj_direct_flush(EdObject *obj, uint64_t flags)
+{
+	int rc;
+	if (obj->tail != NULL && obj->tailpos < obj->nbytes) {
+		size_t len = obj->nbytes - obj->tailpos;
+		if (len > obj->taillen) { len = obj->taillen; }
+
+		// Clear any data left in the buffer from the previous fill.
+		size_t end = obj_data_offset(obj->keylen, obj->metalen, flags) + obj->datalen;
+		size_t used = end > obj->tailpos ? end - obj->tailpos : 0;
+		if (used < len) {
+			memset(obj->tail + used, 0, len - used);
+		}
+
+		rc = slab_pwrite(obj->cache, obj->tail, len, (off_t)(obj->byte + obj->tailpos));
+		if (rc < 0) { return rc; }
+	}
+	return slab_pwrite(obj->cache, obj->hdr, obj->headlen, (off_t)obj->byte);
+}
+
+static void
+obj_hdr_init(EdObjectHdr *hdr, const EdObjectAttr *attr, uint64_t h, EdTime now, uint64_t flags)
+{
+	hdr->xid = 0;
+	hdr->created = now;
+	hdr->exp = 0;
+	hdr->flags = 0;
+	hdr->keylen = attr->keylen;
+	hdr->metalen = attr->metalen;
+	hdr->datalen = attr->datalen;
+	hdr->keyhash = h;
+	hdr->metacrc = 0;
+	hdr->datacrc = 0;
+
+	// Copy the key into the tail of the header segment.
+	uint8_t *key = obj_key(hdr), *meta = obj_meta(hdr);
+	memcpy(key, attr->key, attr->keylen);
+	key += attr->keylen;
+
+	// Zero out the end of the key segment.
+	memset(key, 0, obj_meta(hdr) - key);
+
+	// Write the meta data segment if provided.
+	if (attr->meta != NULL && attr->metalen > 0) {
+		obj_write(meta, attr->meta, attr->metalen, &hdr->metacrc, flags);
+	}
+	meta += attr->metalen;
+
+	// Zero out the end of the meta segment.
+	memset(meta, 0, obj_data(hdr, flags) - meta);
+}
+
+/**
+ * @brief  Tests if an entry overlaps a block range
+ *
+ * Either range may extend past the end of the slab. Comparing with each one
+ * shifted forward by a lap of the ring covers the wrapped portions.
+ *
+ * @param  block  Entry to test
+ * @param  start  First block of the range
+ * @param  end  Block after the range, which may exceed #block_count
+ * @param  block_count  Number of blocks in the slab
+ * @return  true if the ranges overlap
+ */
 static bool
-obj_overlap(const EdEntryBlock *block, EdBlkno start, EdBlkno end)
+obj_overlap(const EdEntryBlock *block, EdBlkno start, EdBlkno end, EdBlkno block_count)
 {
-	return block->no < end && start < block->no + block->count;
+	const EdBlkno bstart = block->no, bend = block->no + block->count;
+	return (bstart < end && start < bend) ||
+		(bstart + block_count < end) ||
+		(start + block_count < bend);
+}
+
+static int
+expiry_set(EdTxn *txn, uint64_t h, EdBlkno vno, EdTime exp)
+{
+	// Objects that never expire are left for the ring to overwrite.
+	if (exp == ED_TIME_INF) { return 0; }
+
+	EdEntryExpiry ent = ed_entry_expiry_make(h, vno, exp);
+	int rc = ed_bpt_find(txn, ED_DB_EXPIRY, ent.key, NULL);
+	if (rc >= 0) {
+		rc = ed_bpt_set(txn, ED_DB_EXPIRY, (void *)&ent, false);
+	}
+	return rc;
+}
+
+static int
+expiry_del(EdTxn *txn, EdBlkno vno, EdTime exp)
+{
+	if (exp == ED_TIME_INF) { return 0; }
+
+	// The truncated block number in the key may collide across wraps of a very
+	// large slab, so the full block number is compared.
+	EdEntryExpiry *ent;
+	int rc;
+	for (rc = ed_bpt_find(txn, ED_DB_EXPIRY, ed_entry_expiry_key(vno, exp), (void **)&ent);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_EXPIRY) == 0;
+			rc = ed_bpt_next(txn, ED_DB_EXPIRY, (void **)&ent)) {
+		if (ent->vno == vno) {
+			return ed_bpt_del(txn, ED_DB_EXPIRY);
+		}
+	}
+	return rc;
 }
 
 static int
 obj_reserve(EdCache *cache, EdTxn *txn, uint64_t flags, EdBlkno *vnop, size_t len)
 {
-	const int slabfd = cache->idx.slabfd;
 	const uint16_t block_size = cache->slab_block_size;
 	const EdBlkno block_count = cache->slab_block_count;
-	const EdBlkno nmin = ED_ALIGN_SIZE(sizeof(EdObjectHdr) + ED_MAX_KEY + 1, block_size);
 	EdBlkno vno = *vnop, no = vno % block_count, end;
+	const EdBlkno vmax = vno + block_count;
 	size_t start = no * block_size;
 	bool searched = false;
 	bool locked = false;
 	EdEntryBlock *block;
 	int rc;
 
+	// A range larger than the slab would never be found.
+	if (len > (size_t)block_count*block_size) {
+		return ED_ESLAB_FULL;
+	}
+
 	// Find then next unlocked region >= #vno. If the current #vno cannot be used,
 	// start from the beginning of the next entry.
 	do {
-		// If the range sticks out past the end of the file, search at the beginning.
-		// I was creating a wrapped mmap here previously. For simplicity, that has
-		// been removed, but it could come back without any file format changes.
-		if (start + len > block_count*block_size) {
+		// If the range sticks out past the end of the slab, it wraps around to the
+		// beginning. When the slab cannot be mapped as a ring, search at the
+		// beginning instead.
+		if (start + len > block_count*block_size && !slab_wraps(cache)) {
 			start = 0;
 			vno += block_count - no;
 			no = vno % block_count;
@@ -179,9 +636,19 @@ obj_reserve(EdCache *cache, EdTxn *txn, uint64_t flags, EdBlkno *vnop, size_t le
 			searched = true;
 		}
 
-		if (ed_flck(slabfd, ED_LCK_EX, start, len, flags|ED_FNOBLOCK) < 0) {
+		rc = slab_lck(cache, ED_LCK_EX, start, len, flags|ED_FNOBLOCK);
+		if (rc < 0) {
+			// Only a conflicting holder can be skipped past. Any other error,
+			// such as running out of lock entries, would fail at every position.
+			if (rc != ed_esys(EAGAIN)) { goto done; }
 			rc = ed_bpt_next(txn, ED_DB_BLOCKS, (void **)&block);
 			if (rc < 0) { goto done; }
+			// With no entry to move to, or after a full lap of the ring, every
+			// position is held by another lock.
+			if (block == NULL || vno + block->count >= vmax) {
+				rc = ed_esys(EAGAIN);
+				goto done;
+			}
 			vno += block->count;
 			no = block->no;
 			start = no * block_size;
@@ -204,27 +671,28 @@ obj_reserve(EdCache *cache, EdTxn *txn, uint64_t flags, EdBlkno *vnop, size_t le
 
 	// Loop through objects by block position and remove the key and then block
 	// entries in the index.
-	while (block && obj_overlap(block, no, end)) {
-		// Only the first page of the object is needed.
-		EdObjectHdr *old = ed_blk_map(slabfd, block->no, nmin, block_size, true);
-		if (old == MAP_FAILED) { rc = ED_ERRNO; goto done; }
-
+	while (block && obj_overlap(block, no, end, block_count)) {
 		// Loop through each key entry to resolve collisions. Key comparison is not
 		// rquireds for this resolution. We are looking for the key that maps to
-		// current block number.
+		// current block number. The block entry carries the key hash, so the old
+		// object is never read from the slab.
 		EdEntryKey *key;
-		for (rc = ed_bpt_find(txn, ED_DB_KEYS, old->keyhash, (void **)&key);
+		for (rc = ed_bpt_find(txn, ED_DB_KEYS, block->hash, (void **)&key);
 				rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
 				rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
 			if ((key->vno % block_count) == block->no) {
+				const EdBlkno kvno = key->vno;
+				const EdTime kexp = key->exp;
 				rc = ed_bpt_del(txn, ED_DB_KEYS);
 				if (rc >= 0) {
 					rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key);
 				}
+				if (rc >= 0) {
+					rc = expiry_del(txn, kvno, kexp);
+				}
 				break;
 			}
 		}
-		ed_blk_unmap(old, nmin, block_size);
 		if (rc < 0) { goto done; }
 
 		rc = ed_bpt_del(txn, ED_DB_BLOCKS);
@@ -238,7 +706,7 @@ obj_reserve(EdCache *cache, EdTxn *txn, uint64_t flags, EdBlkno *vnop, size_t le
 
 done:
 	if (rc < 0 && locked) {
-		ed_flck(slabfd, ED_LCK_UN, start, len, flags);
+		slab_lck(cache, ED_LCK_UN, start, len, flags);
 	}
 	return rc;
 }
@@ -251,8 +719,9 @@ obj_upsert(EdCache *cache, const void *k, size_t klen, uint64_t h,
 	const uint16_t block_size = cache->slab_block_size;
 	const EdBlkno block_count = cache->slab_block_count;
 	const EdBlkno nmin = ED_ALIGN_SIZE(sizeof(EdObjectHdr) + ED_MAX_KEY + 1, block_size);
-	EdEntryBlock blocknew = ed_entry_block_make(vno, nblcks, block_count, txn->xid);
-	EdEntryKey *key, keynew = ed_entry_key_make(h, vno, nblcks, exp);
+	EdEntryBlock blocknew = ed_entry_block_make(vno, nblcks, block_count, txn->xid, h);
+	const uint32_t tag = ed_hash_tag(k, klen, cache->idx.seed);
+	EdEntryKey *key, keynew = ed_entry_key_make(h, vno, nblcks, exp, tag, klen), keyold;
 	bool replace = false;
 	int rc;
 
@@ -266,26 +735,443 @@ obj_upsert(EdCache *cache, const void *k, size_t klen, uint64_t h,
 	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
 			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
 			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
-		// Map the slab object.
-		EdObjectHdr *old = ed_blk_map(cache->idx.slabfd, key->vno % block_count, nmin, block_size, true);
-		if (old == MAP_FAILED) { return ED_ERRNO; }
+		if (!ed_entry_key_match(key, tag, klen)) {
+			continue;
+		}
+
+		// With the hash, fingerprint, and length all matching, the entry is taken
+		// to be this key. The old object is only mapped to mark it as deleted.
+		replace = true;
+		if (!(cache->idx.flags & ED_FKEEPOLD)) {
+			EdObjectHdr *old = slab_map(cache, key->vno % block_count, nmin, true);
+			if (old == MAP_FAILED) { return ED_ERRNO; }
 
-		replace = old->keylen == klen && memcmp(obj_key(old), k, klen) == 0;
-		if (replace && !(cache->idx.flags & ED_FKEEPOLD)) {
-			old->exp = ED_TIME_DELETE;
+			replace = old->keylen == klen && memcmp(obj_key(old), k, klen) == 0;
+			if (replace) {
+				old->exp = ED_TIME_DELETE;
+			}
+			ed_blk_unmap(old, nmin, block_size);
+		}
+		if (replace) {
+			keyold = *key;
+			break;
 		}
-		ed_blk_unmap(old, nmin, block_size);
-		if (replace) { break; }
 	}
 	if (rc >= 0) {
 		rc = ed_bpt_set(txn, ED_DB_KEYS, (void *)&keynew, replace);
 	}
+	if (rc >= 0 && replace) {
+		rc = expiry_del(txn, keyold.vno, keyold.exp);
+	}
+	if (rc >= 0) {
+		rc = expiry_set(txn, h, vno, exp);
+	}
+	return rc;
+}
+
+#ifndef ED_SCAN_SIZE
+# define ED_SCAN_SIZE (8*1024*1024)
+#endif
+
+/**
+ * @brief  Object header found while scanning the slab
+ */
+typedef struct {
+	uint64_t h;
+	EdTxnId xid;
+	EdBlkno no;
+	EdBlkno vno;
+	EdBlkno count;
+	EdTime exp;
+	uint32_t tag;
+	uint16_t keylen;
+	bool newest;
+} ScanObj;
+
+static int
+scan_xid_cmp(const void *a, const void *b)
+{
+	const ScanObj *oa = a, *ob = b;
+	if (oa->xid != ob->xid) { return oa->xid > ob->xid ? -1 : 1; }
+	return oa->vno > ob->vno ? -1 : oa->vno < ob->vno;
+}
+
+static int
+scan_key_cmp(const void *a, const void *b)
+{
+	const ScanObj *oa = a, *ob = b;
+	if (oa->h != ob->h) { return oa->h < ob->h ? -1 : 1; }
+	return scan_xid_cmp(a, b);
+}
+
+static int
+scan_no_cmp(const void *a, const void *b)
+{
+	EdBlkno na = ((const ScanObj *)a)->no, nb = ((const ScanObj *)b)->no;
+	return na < nb ? -1 : na > nb;
+}
+
+static int
+scan_expiry_cmp(const void *a, const void *b)
+{
+	uint64_t ka = ((const EdEntryExpiry *)a)->key, kb = ((const EdEntryExpiry *)b)->key;
+	return ka < kb ? -1 : ka > kb;
+}
+
+/**
+ * @brief  Reads every block of the slab and collects valid object headers
+ *
+ * Each block is tested as a potential header. A header is accepted if it has
+ * been committed at or before the index transaction, its segments fit in the
+ * slab, and the key hashes to the saved value with the index seed. Objects
+ * written for a different index fail the hash check. Each block position is
+ * then assigned the virtual block number from the most recent pass of the slab
+ * ending at #head.
+ *
+ * @param  cache  Cache handle
+ * @param  head  Virtual block number of the slab write position
+ * @param  xmax  Most recent transaction ID of the index
+ * @param  objsp  Indirect pointer to assign the allocated object array to
+ * @param  nobjsp  Pointer to assign the object count to
+ * @return  0 on success, <0 error code
+ */
+static int
+scan_slab(EdCache *cache, EdBlkno head, EdTxnId xmax, ScanObj **objsp, size_t *nobjsp)
+{
+	const uint64_t flags = cache->idx.flags;
+	const uint16_t block_size = cache->slab_block_size;
+	const EdBlkno block_count = cache->slab_block_count;
+	const bool wraps = slab_wraps(cache);
+
+	// Each read extends past the chunk so that keys of headers near the end can
+	// be checked without another read. These bytes wrap to the start of the
+	// slab, just as the keys of wrapped objects do.
+	const size_t chunk = ED_SCAN_SIZE / block_size;
+	const size_t extra = ED_ALIGN_SIZE(obj_meta_offset(ED_MAX_KEY), block_size);
+
+	ScanObj *objs = NULL;
+	size_t nobjs = 0, cap = 0;
+	int rc = 0;
+
+	uint8_t *buf = malloc(chunk*block_size + extra);
+	if (buf == NULL) { return ED_ERRNO; }
+
+	for (EdBlkno start = 0; start < block_count; start += chunk) {
+		EdBlkno n = block_count - start < chunk ? block_count - start : chunk;
+		rc = slab_pread(cache, buf, n*block_size + extra, (off_t)(start*block_size));
+		if (rc < 0) { goto done; }
+
+		for (EdBlkno b = 0; b < n; b++) {
+			EdObjectHdr *hdr = (EdObjectHdr *)(buf + b*block_size);
+			if (hdr->xid == 0 || hdr->xid > xmax ||
+					hdr->keylen == 0 || hdr->keylen > ED_MAX_KEY) {
+				continue;
+			}
+
+			EdBlkno no = start + b;
+			EdBlkno count = obj_slab_size(hdr->keylen, hdr->metalen, hdr->datalen,
+					block_size, flags) / block_size;
+			if (count > block_count || (!wraps && no + count > block_count)) {
+				continue;
+			}
+			if (ed_hash(obj_key(hdr), hdr->keylen, cache->idx.seed) != hdr->keyhash) {
+				continue;
+			}
+
+			// Objects must end at or before the write position. Anything else is
+			// left over from an earlier index using the same seed.
+			EdBlkno vno = no;
+			if (head >= block_count) {
+				vno = head - block_count + (no + block_count - head%block_count) % block_count;
+			}
+			if (vno + count > head) { continue; }
+
+			if (nobjs == cap) {
+				size_t ncap = cap ? cap * 2 : 1024;
+				ScanObj *tmp = realloc(objs, ncap * sizeof(*tmp));
+				if (tmp == NULL) { rc = ED_ERRNO; goto done; }
+				objs = tmp;
+				cap = ncap;
+			}
+			objs[nobjs++] = (ScanObj){
+				.h = hdr->keyhash,
+				.xid = hdr->xid,
+				.no = no,
+				.vno = vno,
+				.count = count,
+				.exp = hdr->exp,
+				.tag = ed_hash_tag(obj_key(hdr), hdr->keylen, cache->idx.seed),
+				.keylen = hdr->keylen,
+			};
+		}
+	}
+
+done:
+	free(buf);
+	if (rc < 0) {
+		free(objs);
+		return rc;
+	}
+	*objsp = objs;
+	*nobjsp = nobjs;
+	return 0;
+}
+
+/**
+ * @brief  Claims the slab blocks used by an object
+ *
+ * Newer objects are claimed first, so an object that overlaps a claimed range
+ * has been partially overwritten.
+ *
+ * @param  claimed  Bit set of claimed blocks
+ * @param  obj  Scanned object
+ * @param  block_count  Number of blocks in the slab
+ * @return  true if the blocks were claimed
+ */
+static bool
+scan_claim(uint64_t *claimed, const ScanObj *obj, EdBlkno block_count)
+{
+	for (EdBlkno i = 0, no = obj->no; i < obj->count; i++, no++) {
+		if (no == block_count) { no = 0; }
+		if (claimed[no/64] & (UINT64_C(1) << (no%64))) { return false; }
+	}
+	for (EdBlkno i = 0, no = obj->no; i < obj->count; i++, no++) {
+		if (no == block_count) { no = 0; }
+		claimed[no/64] |= UINT64_C(1) << (no%64);
+	}
+	return true;
+}
+
+static int
+scan_verify(EdCache *cache, const ScanObj *obj)
+{
+	EdObjectHdr *hdr = slab_map(cache, obj->no, obj->count, true);
+	if (hdr == MAP_FAILED) { return ED_ERRNO; }
+	EdObject tmp = { .nomap = false };
+	obj_init(&tmp, cache, hdr, obj->vno, true, hdr->exp);
+	int rc = obj_verify(&tmp, cache->idx.flags);
+	ed_blk_unmap(hdr, obj->count, cache->slab_block_size);
+	return rc;
+}
+
+static int
+scan_key_eq(EdCache *cache, const ScanObj *a, const ScanObj *b, uint8_t *buf)
+{
+	if (a->tag != b->tag || a->keylen != b->keylen) { return 0; }
+	const off_t koff = (off_t)obj_key_offset();
+	const uint16_t block_size = cache->slab_block_size;
+	int rc = slab_pread(cache, buf, a->keylen, (off_t)(a->no*block_size) + koff);
+	if (rc == 0) {
+		rc = slab_pread(cache, buf + ED_MAX_KEY, b->keylen, (off_t)(b->no*block_size) + koff);
+	}
+	if (rc < 0) { return rc; }
+	return memcmp(buf, buf + ED_MAX_KEY, a->keylen) == 0;
+}
+
+/**
+ * @brief  Rebuilds both index trees from the objects in the slab
+ *
+ * The slab is read sequentially, and the newest intact version of each key is
+ * kept. Both trees are then loaded bottom-up from the sorted entries, rather
+ * than inserting each one. The index must have been reinitialized by
+ * #ed_idx_open() with #ED_FREPAIR so the seed, epoch and slab positions of the
+ * previous index are still in place.
+ *
+ * @param  cache  Cache handle
+ * @return  0 on success, <0 error code
+ */
+static int
+cache_rebuild(EdCache *cache)
+{
+	EdIdx *const idx = &cache->idx;
+	EdPgIdx *const hdr = idx->hdr;
+	const uint64_t flags = idx->flags;
+	const EdBlkno block_count = cache->slab_block_count;
+	const bool verify = (flags & ED_FCHECKSUM) && !(flags & ED_FNOVERIFY);
+
+	ScanObj *objs = NULL;
+	size_t nobjs = 0, nkeys = 0, nclaimed = 0;
+	uint64_t *claimed = NULL;
+	EdEntryKey *keys = NULL;
+	EdEntryBlock *blocks = NULL;
+	EdEntryExpiry *exps = NULL;
+	size_t nexps = 0;
+	EdPgno kroot = ED_PG_NONE, broot = ED_PG_NONE, eroot = ED_PG_NONE;
+	uint8_t keybuf[ED_MAX_KEY*2];
+
+	int rc = ed_lck(&idx->lck, idx->fd, ED_LCK_EX, flags);
+	if (rc < 0) { return rc; }
+
+	const EdBlkno head = hdr->vno;
+	const EdTxnId xid = hdr->xid + 1;
+
+	ed_verbose(flags, "scanning %zu slab blocks...", (size_t)block_count);
+	rc = scan_slab(cache, head, hdr->xid, &objs, &nobjs);
+	if (rc < 0) { goto done; }
+	ed_verbose(flags, "ok (%zu objects)\n", nobjs);
+
+	// Newer objects take their blocks first. Older objects overlapping them,
+	// and objects that fail checksums, are dropped.
+	claimed = calloc(ED_COUNT_SIZE(block_count, 64), sizeof(*claimed));
+	if (claimed == NULL) { rc = ED_ERRNO; goto done; }
+	qsort(objs, nobjs, sizeof(*objs), scan_xid_cmp);
+	for (size_t i = 0; i < nobjs; i++) {
+		if (verify) {
+			rc = scan_verify(cache, &objs[i]);
+			if (rc == ED_EOBJECT_METACRC || rc == ED_EOBJECT_DATACRC) { continue; }
+			if (rc < 0) { goto done; }
+		}
+		if (scan_claim(claimed, &objs[i], block_count)) {
+			objs[nclaimed++] = objs[i];
+		}
+	}
+	nobjs = nclaimed;
+
+	// Group the objects by key hash with the newest first. Collisions are
+	// resolved by comparing the keys against the newest version of each key
+	// seen so far for the hash.
+	keys = malloc(nobjs * sizeof(*keys));
+	blocks = malloc(nobjs * sizeof(*blocks));
+	exps = malloc(nobjs * sizeof(*exps));
+	if (keys == NULL || blocks == NULL || exps == NULL) { rc = ED_ERRNO; goto done; }
+	qsort(objs, nobjs, sizeof(*objs), scan_key_cmp);
+	for (size_t i = 0, end; i < nobjs; i = end) {
+		for (end = i; end < nobjs && objs[end].h == objs[i].h; end++) {
+			ScanObj *obj = &objs[end];
+			obj->newest = true;
+			for (size_t k = i; k < end && obj->newest; k++) {
+				if (!objs[k].newest) { continue; }
+				rc = scan_key_eq(cache, &objs[k], obj, keybuf);
+				if (rc < 0) { goto done; }
+				obj->newest = rc == 0;
+			}
+			if (obj->newest && obj->exp != ED_TIME_DELETE) {
+				keys[nkeys++] = ed_entry_key_make(obj->h, obj->vno, obj->count, obj->exp,
+						obj->tag, obj->keylen);
+				if (obj->exp != ED_TIME_INF) {
+					exps[nexps++] = ed_entry_expiry_make(obj->h, obj->vno, obj->exp);
+				}
+			}
+		}
+	}
+
+	// Replaced objects keep their blocks until overwritten.
+	qsort(objs, nobjs, sizeof(*objs), scan_no_cmp);
+	for (size_t i = 0; i < nobjs; i++) {
+		blocks[i] = ed_entry_block_make(objs[i].vno, objs[i].count, block_count, objs[i].xid, objs[i].h);
+	}
+
+	qsort(exps, nexps, sizeof(*exps), scan_expiry_cmp);
+
+	ed_verbose(flags, "loading %zu keys and %zu blocks...", nkeys, nobjs);
+	rc = ed_bpt_load(idx, xid, keys, nkeys, sizeof(*keys), &kroot);
+	if (rc < 0) { goto done_load; }
+	rc = ed_bpt_load(idx, xid, blocks, nobjs, sizeof(*blocks), &broot);
+	if (rc < 0) { goto done_load; }
+	rc = ed_bpt_load(idx, xid, exps, nexps, sizeof(*exps), &eroot);
+	if (rc < 0) { goto done_load; }
+
+	hdr->tree[ED_DB_KEYS] = kroot;
+	hdr->tree[ED_DB_BLOCKS] = broot;
+	hdr->tree[ED_DB_EXPIRY] = eroot;
+	hdr->xid = xid;
+	hdr->sync_xid = xid;
+	if (!(flags & ED_FNOSYNC)) {
+		fsync(idx->fd);
+	}
+
+done_load:
+	if (rc < 0) { ed_verbose(flags, "failed (%s)\n", ed_strerror(rc)); }
+	else { ed_verbose(flags, "ok\n"); }
+done:
+	ed_lck(&idx->lck, idx->fd, ED_LCK_UN, flags);
+	free(objs);
+	free(claimed);
+	free(keys);
+	free(blocks);
+	free(exps);
 	return rc;
 }
 
+static void
+cache_close_shards(EdCache *cache)
+{
+	for (unsigned i = 0; i < cache->nshards; i++) {
+		ed_cache_close(&cache->shards[i]);
+	}
+	free(cache->shards);
+	free(cache);
+}
+
+/**
+ * @brief  Opens every partition of a sharded cache
+ *
+ * Each partition uses the configured paths with a ".<n>" suffix, and an even
+ * share of the slab size. The partition count must not change once created.
+ *
+ * @param  cachep  Sharded cache reference
+ * @param  cfg  Cache configuration
+ * @return  0 on success, <0 error code
+ */
+static int
+cache_open_shards(EdCache **cachep, const EdConfig *cfg)
+{
+	if (cfg->nshards > ED_MAX_SHARDS) { return ED_ECONFIG_SHARDS; }
+
+	EdCache *cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) { return ED_ERRNO; }
+	cache->ref = 1;
+	cache->shard = -1;
+	cache->shards = calloc(cfg->nshards, sizeof(*cache->shards));
+	if (cache->shards == NULL) {
+		free(cache);
+		return ED_ERRNO;
+	}
+	cache->nshards = cfg->nshards;
+
+	int rc = 0;
+	for (unsigned i = 0; i < cfg->nshards; i++) {
+		char index_path[4096], slab_path[4096];
+		EdConfig scfg = *cfg;
+		scfg.nshards = 0;
+		if (snprintf(index_path, sizeof(index_path), "%s.%u", cfg->index_path, i)
+				>= (int)sizeof(index_path)) {
+			rc = ED_ECONFIG_INDEX_NAME;
+			break;
+		}
+		scfg.index_path = index_path;
+		if (cfg->slab_path != NULL) {
+			if (snprintf(slab_path, sizeof(slab_path), "%s.%u", cfg->slab_path, i)
+					>= (int)sizeof(slab_path)) {
+				rc = ED_ECONFIG_SLAB_NAME;
+				break;
+			}
+			scfg.slab_path = slab_path;
+		}
+		scfg.slab_size = cfg->slab_size / cfg->nshards;
+
+		rc = ed_cache_open(&cache->shards[i], &scfg);
+		if (rc < 0) { break; }
+		cache->shards[i]->shard = (int)i;
+	}
+
+	if (rc < 0) {
+		cache_close_shards(cache);
+		return rc;
+	}
+	cache->slab_block_count = cache->shards[0]->slab_block_count;
+	cache->slab_block_size = cache->shards[0]->slab_block_size;
+	*cachep = cache;
+	return 0;
+}
+
 int
 ed_cache_open(EdCache **cachep, const EdConfig *cfg)
 {
+	if (cfg->nshards > 1) {
+		return cache_open_shards(cachep, cfg);
+	}
+
 	int rc;
 	EdCache *cache = malloc(sizeof(*cache));
 	if (cache == NULL) { return ED_ERRNO; }
@@ -296,12 +1182,30 @@ ed_cache_open(EdCache **cachep, const EdConfig *cfg)
 	rc = ed_txn_new(&cache->txn, &cache->idx);
 	if (rc < 0) { goto error_txn; }
 
+	memset(cache->readers, 0, sizeof(cache->readers));
+	cache->rbusy = 0;
+	cache->rwaiters = 0;
+	pthread_mutex_init(&cache->rmutex, NULL);
+	pthread_cond_init(&cache->rcond, NULL);
 	cache->ref = 1;
+	cache->shard = -1;
+	cache->nshards = 0;
+	cache->shards = NULL;
 	cache->slab_block_count = cache->idx.hdr->slab_block_count;
 	cache->slab_block_size = cache->idx.hdr->slab_block_size;
+
+	if (cfg->flags & ED_FREPAIR) {
+		rc = cache_rebuild(cache);
+		if (rc < 0) { goto error_rebuild; }
+	}
+
 	*cachep = cache;
 	return 0;
 
+error_rebuild:
+	pthread_cond_destroy(&cache->rcond);
+	pthread_mutex_destroy(&cache->rmutex);
+	ed_txn_close(&cache->txn, cache->idx.flags);
 error_txn:
 	ed_idx_close(&cache->idx);
 error_open:
@@ -325,7 +1229,16 @@ ed_cache_close(EdCache **cachep)
 	if (cache != NULL) {
 		*cachep = NULL;
 		if (__sync_fetch_and_sub(&cache->ref, 1) == 1) {
+			if (cache->nshards > 0) {
+				cache_close_shards(cache);
+				return;
+			}
 			ed_txn_close(&cache->txn, cache->idx.flags);
+			for (int i = 0; i < ED_CACHE_READERS; i++) {
+				ed_txn_close(&cache->readers[i], cache->idx.flags);
+			}
+			pthread_cond_destroy(&cache->rcond);
+			pthread_mutex_destroy(&cache->rmutex);
 			ed_idx_close(&cache->idx);
 			free(cache);
 		}
@@ -337,6 +1250,15 @@ ed_cache_stat(EdCache *cache, FILE *out, uint64_t flags)
 {
 	if (out == NULL) { out = stdout; }
 
+	if (cache->nshards > 0) {
+		for (unsigned i = 0; i < cache->nshards; i++) {
+			fprintf(out, "shard: %u\n", i);
+			int rc = ed_cache_stat(cache->shards[i], out, flags);
+			if (rc < 0) { return rc; }
+		}
+		return 0;
+	}
+
 	EdStat *stat;
 	int rc = ed_stat_new(&stat, &cache->idx, flags);
 	if (rc < 0) { return rc; }
@@ -367,20 +1289,93 @@ ed_cache_stat(EdCache *cache, FILE *out, uint64_t flags)
 }
 
 static int
-open_key(EdCache *cache, EdTxn *txn, EdObject *obj, const void *k, size_t klen, uint64_t flags)
+purge_key(EdTxn *txn, const EdEntryExpiry *ent)
+{
+	EdEntryKey *key;
+	int rc;
+	for (rc = ed_bpt_find(txn, ED_DB_KEYS, ent->hash, (void **)&key);
+			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
+			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
+		if (key->vno == ent->vno) {
+			// A changed expiry leaves the key for its newer entry to remove.
+			if (key->exp != ed_entry_expiry_time(ent)) { return 0; }
+			return ed_bpt_del(txn, ED_DB_KEYS);
+		}
+	}
+	return rc;
+}
+
+int
+ed_cache_purge_expired(EdCache *cache, size_t budget)
+{
+	if (cache->nshards > 0) {
+		int n = 0;
+		if (budget > INT32_MAX) { budget = INT32_MAX; }
+		for (unsigned i = 0; i < cache->nshards && (size_t)n < budget; i++) {
+			int rc = ed_cache_purge_expired(cache->shards[i], budget - n);
+			if (rc < 0) { return rc; }
+			n += rc;
+		}
+		return n;
+	}
+
+	const EdTimeUnix epoch = cache->idx.epoch;
+	const EdTimeUnix now = ed_now_unix();
+	EdTxn *const txn = cache->txn;
+	EdEntryExpiry *ent;
+	uint64_t last = 0;
+	int rc, n = 0;
+
+	if (budget == 0) { return 0; }
+	if (budget > INT32_MAX) { budget = INT32_MAX; }
+
+	rc = ed_txn_open(txn, cache->idx.flags);
+	if (rc < 0) { return rc; }
+
+	// Entries are ordered by expiration, so the walk ends at the first one still
+	// live. Every entry visited is removed, so a key lower than the last one can
+	// only come from wrapping around to the start of the tree.
+	for (rc = ed_bpt_first(txn, ED_DB_EXPIRY, (void **)&ent);
+			rc >= 0 && ent != NULL && (size_t)n < budget && ent->key >= last;
+			rc = ed_bpt_next(txn, ED_DB_EXPIRY, (void **)&ent)) {
+		const EdEntryExpiry e = *ent;
+		if (!ed_expired_at(epoch, ed_entry_expiry_time(&e), now)) { break; }
+		last = e.key;
+
+		rc = purge_key(txn, &e);
+		if (rc >= 0) {
+			rc = ed_bpt_del(txn, ED_DB_EXPIRY);
+		}
+		if (rc < 0) { break; }
+		n++;
+	}
+
+	if (rc >= 0 && n > 0) {
+		rc = ed_txn_commit(&cache->txn, cache->idx.flags|ED_FRESET);
+	}
+	else {
+		ed_txn_close(&cache->txn, cache->idx.flags|ED_FRESET);
+	}
+
+	return rc < 0 ? rc : n;
+}
+
+static int
+open_key(EdCache *cache, EdTxn *txn, EdObject *obj, const void *k, size_t klen, uint64_t h, uint64_t flags)
 {
-	const uint64_t h = ed_hash(k, klen, cache->idx.seed);
 	const uint16_t block_size = cache->slab_block_size;
 	const EdBlkno block_count = cache->slab_block_count;
 	const EdTimeUnix now = ed_now_unix();
+	const uint32_t tag = ed_hash_tag(k, klen, cache->idx.seed);
 
 	EdEntryKey *key;
 	int rc;
-	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
+	for (rc = ed_bpt_seek(txn, ED_DB_KEYS, h, (void **)&key);
 			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
 			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
-		// First check if the object is expired.
-		if (ed_expired_at(cache->idx.epoch, key->exp, now)) {
+		// First check if the object is expired or is known to hold another key.
+		if (ed_expired_at(cache->idx.epoch, key->exp, now) ||
+				!ed_entry_key_match(key, tag, klen)) {
 			continue;
 		}
 
@@ -389,15 +1384,15 @@ open_key(EdCache *cache, EdTxn *txn, EdObject *obj, const void *k, size_t klen,
 
 		// Try to get a shared lock on the slab region. If it cannot be locked, a
 		// writer is replacing this slab location.
-		if (ed_flck(cache->idx.slabfd, ED_LCK_SH, off, len, flags|ED_FNOBLOCK) < 0) {
+		if (slab_lck(cache, ED_LCK_SH, off, len, flags|ED_FNOBLOCK) < 0) {
 			continue;
 		}
 
-		// Map the slab object.
-		EdObjectHdr *hdr = ed_blk_map(cache->idx.slabfd, key->vno % block_count, key->count, block_size, false);
+		// Map or copy the slab object.
+		EdObjectHdr *hdr = obj_hdr_open(cache, key->vno % block_count, key->count, obj->nomap);
 		if (hdr == MAP_FAILED) {
 			rc = ED_ERRNO;
-			ed_flck(cache->idx.slabfd, ED_LCK_UN, off, len, flags);
+			slab_lck(cache, ED_LCK_UN, off, len, flags);
 			return rc;
 		}
 
@@ -410,8 +1405,8 @@ open_key(EdCache *cache, EdTxn *txn, EdObject *obj, const void *k, size_t klen,
 
 		// We have a hash collision so unlock and unmap the slab region and continue
 		// searching with the next entry.
-		ed_flck(cache->idx.slabfd, ED_LCK_UN, off, len, flags);
-		ed_blk_unmap(hdr, key->count, block_size);
+		slab_lck(cache, ED_LCK_UN, off, len, flags);
+		obj_hdr_close(cache, hdr, key->count, obj->nomap);
 	}
 	return 0;
 }
@@ -425,7 +1420,7 @@ open_id(EdCache *cache, EdTxn *txn, EdObject *obj, const char *id, uint64_t flag
 	const EdBlkno block_count = cache->slab_block_count;
 	int rc = obj_id(id, &xid, &vno);
 	if (rc < 0) { return rc; }
-	if (xid > cache->idx.conn->xid || vno > ed_txn_vno(txn)) {
+	if (xid > ed_txn_snapshot(txn) || vno > ed_txn_vno(txn)) {
 		return 0;
 	}
 
@@ -439,15 +1434,15 @@ open_id(EdCache *cache, EdTxn *txn, EdObject *obj, const char *id, uint64_t flag
 
 	// Try to get a shared lock on the slab region. If it cannot be locked, a
 	// writer is replacing this slab location.
-	if (ed_flck(cache->idx.slabfd, ED_LCK_SH, off, len, flags|ED_FNOBLOCK) < 0) {
+	if (slab_lck(cache, ED_LCK_SH, off, len, flags|ED_FNOBLOCK) < 0) {
 		return 0;
 	}
 
-	// Map the slab object.
-	EdObjectHdr *hdr = ed_blk_map(cache->idx.slabfd, entry->no, entry->count, block_size, false);
+	// Map or copy the slab object.
+	EdObjectHdr *hdr = obj_hdr_open(cache, entry->no, entry->count, obj->nomap);
 	if (hdr == MAP_FAILED) {
 		rc = ED_ERRNO;
-		ed_flck(cache->idx.slabfd, ED_LCK_UN, off, len, flags);
+		slab_lck(cache, ED_LCK_UN, off, len, flags);
 		return rc;
 	}
 
@@ -455,17 +1450,164 @@ open_id(EdCache *cache, EdTxn *txn, EdObject *obj, const char *id, uint64_t flag
 	return 1;
 }
 
+/**
+ * @brief  Creates a read-only transaction with its own connection reader slot
+ * @param  cache  Cache handle
+ * @param  txnp  New transaction reference
+ * @param  flags  Cache flags
+ * @return  0 on success, EAGAIN if the connection has no reader slots left,
+ *          or another <0 error code
+ */
+static int
+reader_new(EdCache *cache, EdTxn **txnp, uint64_t flags)
+{
+	EdTxn *txn;
+	int rc = ed_txn_new(&txn, &cache->idx);
+	if (rc < 0) { return rc; }
+	rc = txn->rslot = ed_idx_acquire_reader(&cache->idx);
+	if (rc < 0) {
+		ed_txn_close(&txn, flags);
+		return rc;
+	}
+	*txnp = txn;
+	return 0;
+}
+
+/**
+ * @brief  Waits until a read-only transaction may be available
+ *
+ * The waiter count is raised before checking, so a release either sees the
+ * waiter and signals, or happens before the check.
+ *
+ * @param  cache  Cache handle
+ */
+static void
+reader_wait(EdCache *cache)
+{
+	pthread_mutex_lock(&cache->rmutex);
+	__atomic_add_fetch(&cache->rwaiters, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&cache->rbusy, __ATOMIC_SEQ_CST) == (UINT32_C(1) << ED_CACHE_READERS) - 1 &&
+			__atomic_load_n(&cache->idx.conn->rmask, __ATOMIC_SEQ_CST) == UINT32_MAX) {
+		pthread_cond_wait(&cache->rcond, &cache->rmutex);
+	}
+	__atomic_sub_fetch(&cache->rwaiters, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&cache->rmutex);
+}
+
+/**
+ * @brief  Takes a read-only transaction from the pool of the cache
+ *
+ * Each pooled transaction has its own node arena and connection reader slot,
+ * so threads sharing the cache can search the index concurrently. When every
+ * pooled transaction is in use, a new one is created for the caller and freed
+ * on release. Only when the connection has no reader slots left does this
+ * wait for a release, unless #ED_FNOBLOCK is set.
+ *
+ * @param  cache  Cache handle
+ * @param  txnp  Transaction reference
+ * @param  flags  Cache flags
+ * @return  pool index, or #ED_CACHE_READERS for a transaction outside of the
+ *          pool, on success, <0 error code
+ */
+static int
+reader_acquire(EdCache *cache, EdTxn **txnp, uint64_t flags)
+{
+	for (;;) {
+		uint32_t busy = __atomic_load_n(&cache->rbusy, __ATOMIC_RELAXED);
+		if (busy == (UINT32_C(1) << ED_CACHE_READERS) - 1) {
+			int rc = reader_new(cache, txnp, flags);
+			if (rc == 0) { return ED_CACHE_READERS; }
+			if (rc != ed_esys(EAGAIN) || (flags & ED_FNOBLOCK)) { return rc; }
+			reader_wait(cache);
+			continue;
+		}
+
+		int i = __builtin_ctz(~busy);
+		if (!__atomic_compare_exchange_n(&cache->rbusy, &busy, busy | (UINT32_C(1) << i),
+					false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			continue;
+		}
+		if (cache->readers[i] == NULL) {
+			int rc = reader_new(cache, &cache->readers[i], flags);
+			if (rc < 0) {
+				__atomic_and_fetch(&cache->rbusy, ~(UINT32_C(1) << i), __ATOMIC_SEQ_CST);
+				if (rc != ed_esys(EAGAIN) || (flags & ED_FNOBLOCK)) { return rc; }
+				reader_wait(cache);
+				continue;
+			}
+		}
+		*txnp = cache->readers[i];
+		return i;
+	}
+}
+
+/**
+ * @brief  Closes a read-only transaction and returns it to the pool
+ * @param  cache  Cache handle
+ * @param  i  Index returned from #reader_acquire()
+ * @param  txnp  Transaction reference returned from #reader_acquire()
+ * @param  flags  Cache flags
+ */
+static void
+reader_release(EdCache *cache, int i, EdTxn **txnp, uint64_t flags)
+{
+	if (i < ED_CACHE_READERS) {
+		ed_txn_close(&cache->readers[i], flags|ED_FRESET);
+		__atomic_and_fetch(&cache->rbusy, ~(UINT32_C(1) << i), __ATOMIC_SEQ_CST);
+	}
+	else {
+		ed_txn_close(txnp, flags);
+	}
+	if (__atomic_load_n(&cache->rwaiters, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&cache->rmutex);
+		pthread_cond_broadcast(&cache->rcond);
+		pthread_mutex_unlock(&cache->rmutex);
+	}
+}
+
+static int
+open_finish(EdObject *obj, int rc, uint64_t flags)
+{
+	if (rc == 1) {
+		if (!(flags & ED_FMAPSLAB) && !obj->nomap) {
+			madvise(obj->hdr, obj->nbytes, MADV_SEQUENTIAL);
+		}
+		int vrc = obj_verify(obj, flags);
+		if (vrc < 0) { rc = vrc; }
+	}
+	return rc;
+}
+
 int
 ed_open(EdCache *cache, EdObject **objp, const void *k, size_t klen, int oflags)
 {
-	(void)oflags;
+	if (cache->nshards > 0) {
+		unsigned n = 0;
+		if (oflags & ED_OID) {
+			const char *id;
+			int rc = shard_id(cache, k, &n, &id);
+			if (rc < 0) {
+				*objp = NULL;
+				return rc;
+			}
+			k = id;
+		}
+		else {
+			n = shard_key(cache, k, klen);
+		}
+		return ed_open(cache->shards[n], objp, k, klen, oflags);
+	}
+
 	EdObject *obj = NULL;
 	int rc = obj_new(&obj, NULL, 0, true);
 	if (rc < 0) { return rc; }
 	assert(obj != NULL);
+	obj->nomap = !!(oflags & ED_ONOMAP);
 
 	const uint64_t flags = cache->idx.flags;
-	EdTxn *const txn = cache->txn;
+	EdTxn *txn;
+	int r = reader_acquire(cache, &txn, flags);
+	if (r < 0) { rc = r; goto done; }
 
 	rc = ed_txn_open(txn, flags|ED_FRDONLY);
 	if (rc < 0) { goto done; }
@@ -474,27 +1616,186 @@ ed_open(EdCache *cache, EdObject **objp, const void *k, size_t klen, int oflags)
 		rc = open_id(cache, txn, obj, k, flags);
 	}
 	else {
-		rc = open_key(cache, txn, obj, k, klen, flags);
+		rc = open_key(cache, txn, obj, k, klen, ed_hash(k, klen, cache->idx.seed), flags);
 	}
 
 done:
-	ed_txn_close(&cache->txn, flags|ED_FRESET);
-	if (rc == 1) {
-		madvise(obj->hdr, obj->nbytes, MADV_SEQUENTIAL);
-		int vrc = obj_verify(obj, flags);
-		if (vrc < 0) { rc = vrc; }
-	}
+	if (r >= 0) { reader_release(cache, r, &txn, flags); }
+	rc = open_finish(obj, rc, flags);
 	if (rc <= 0) {
 		free(obj);
 		obj = NULL;
 	}
-	*objp = obj;
-	return rc;
+	*objp = obj;
+	return rc;
+}
+
+typedef struct {
+	uint64_t h;
+	size_t i;
+} OpenKey;
+
+static int
+open_key_cmp(const void *a, const void *b)
+{
+	uint64_t ha = ((const OpenKey *)a)->h, hb = ((const OpenKey *)b)->h;
+	return ha < hb ? -1 : ha > hb;
+}
+
+/**
+ * @brief  Opens many objects from a sharded cache
+ *
+ * Keys are grouped by partition, and each group is opened with a single
+ * #ed_open_many() call on its partition.
+ */
+static int
+open_many_shards(EdCache *cache, EdObject **objs, const void *const *keys, const size_t *lens,
+		size_t n, int oflags)
+{
+	const void **skeys = malloc(n * sizeof(*skeys));
+	const void **rest = malloc(n * sizeof(*rest));
+	size_t *slens = malloc(n * sizeof(*slens));
+	EdObject **sobjs = malloc(n * sizeof(*sobjs));
+	unsigned *route = malloc(n * sizeof(*route));
+	int rc = 0, count = 0;
+
+	if (skeys == NULL || rest == NULL || slens == NULL || sobjs == NULL || route == NULL) {
+		rc = ED_ERRNO;
+		goto done;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (oflags & ED_OID) {
+			const char *id;
+			rc = shard_id(cache, keys[i], &route[i], &id);
+			if (rc < 0) { goto done; }
+			rest[i] = id;
+		}
+		else {
+			route[i] = shard_key(cache, keys[i], lens[i]);
+			rest[i] = keys[i];
+		}
+	}
+
+	for (unsigned s = 0; s < cache->nshards; s++) {
+		size_t m = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (route[i] != s) { continue; }
+			skeys[m] = rest[i];
+			slens[m] = lens[i];
+			m++;
+		}
+		if (m == 0) { continue; }
+
+		rc = ed_open_many(cache->shards[s], sobjs, skeys, slens, m, oflags);
+		if (rc < 0) { goto done; }
+		count += rc;
+
+		m = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (route[i] == s) { objs[i] = sobjs[m++]; }
+		}
+	}
+
+done:
+	if (rc < 0) {
+		for (size_t i = 0; i < n; i++) {
+			ed_close(&objs[i]);
+		}
+	}
+	free(skeys);
+	free(rest);
+	free(slens);
+	free(sobjs);
+	free(route);
+	return rc < 0 ? rc : count;
+}
+
+int
+ed_open_many(EdCache *cache, EdObject **objs, const void *const *keys, const size_t *lens,
+		size_t n, int oflags)
+{
+	const uint64_t flags = cache->idx.flags;
+	EdTxn *txn;
+	OpenKey *order = NULL;
+	int rc = 0, count = 0, r = -1;
+
+	for (size_t i = 0; i < n; i++) {
+		objs[i] = NULL;
+	}
+
+	if (cache->nshards > 0) {
+		return open_many_shards(cache, objs, keys, lens, n, oflags);
+	}
+
+	// Visit the keys in hash order so that neighboring keys are found in the
+	// leaf that is already mapped.
+	if (!(oflags & ED_OID)) {
+		order = malloc(n * sizeof(*order));
+		if (order == NULL) { return ED_ERRNO; }
+		for (size_t i = 0; i < n; i++) {
+			order[i].h = ed_hash(keys[i], lens[i], cache->idx.seed);
+			order[i].i = i;
+		}
+		qsort(order, n, sizeof(*order), open_key_cmp);
+	}
+
+	rc = r = reader_acquire(cache, &txn, flags);
+	if (rc < 0) { goto done; }
+
+	rc = ed_txn_open(txn, flags|ED_FRDONLY);
+	if (rc < 0) { goto done; }
+
+	for (size_t j = 0; j < n; j++) {
+		size_t i = order ? order[j].i : j;
+		EdObject *obj = NULL;
+		rc = obj_new(&obj, NULL, 0, true);
+		if (rc < 0) { break; }
+		obj->nomap = !!(oflags & ED_ONOMAP);
+
+		if (oflags & ED_OID) {
+			rc = open_id(cache, txn, obj, keys[i], flags);
+		}
+		else {
+			rc = open_key(cache, txn, obj, keys[i], lens[i], order[j].h, flags);
+		}
+		if (rc == 1) {
+			objs[i] = obj;
+			count++;
+		}
+		else {
+			free(obj);
+			if (rc < 0) { break; }
+		}
+	}
+
+	reader_release(cache, r, &txn, flags);
+	r = -1;
+
+	// Verification is done after the transaction is closed, as in #ed_open().
+	for (size_t i = 0; rc >= 0 && i < n; i++) {
+		if (objs[i] == NULL) { continue; }
+		rc = open_finish(objs[i], 1, flags);
+	}
+
+done:
+	if (r >= 0) { reader_release(cache, r, &txn, flags); }
+	if (rc < 0) {
+		for (size_t i = 0; i < n; i++) {
+			ed_close(&objs[i]);
+		}
+	}
+	free(order);
+	return rc < 0 ? rc : count;
 }
 
 int
 ed_create(EdCache *cache, EdObject **objp, const EdObjectAttr *attr)
 {
+	if (cache->nshards > 0) {
+		cache = cache->shards[shard_key(cache, attr->key, attr->keylen)];
+	}
+
 	EdObject *obj = NULL;
 	int rc = obj_new(&obj, attr->key, attr->keylen, false);
 	if (rc < 0) { return rc; }
@@ -508,7 +1809,6 @@ ed_create(EdCache *cache, EdObject **objp, const EdObjectAttr *attr)
 	const EdBlkno block_count = cache->slab_block_count;
 	const size_t nbytes = obj_slab_size(attr->keylen, attr->metalen, attr->datalen, block_size, flags);
 	const EdBlkno nblcks = nbytes/block_size;
-	const int slabfd = cache->idx.slabfd;
 	EdTxn *const txn = cache->txn;
 
 	EdObjectHdr *hdr = MAP_FAILED;
@@ -525,8 +1825,15 @@ ed_create(EdCache *cache, EdObject **objp, const EdObjectAttr *attr)
 	rc = obj_reserve(cache, txn, flags, &vno, nbytes);
 	if (rc < 0) { goto done; }
 
-	// Map the new object header in the slab.
-	hdr = ed_blk_map(slabfd, vno % block_count, nblcks, block_size, true);
+	// Map the new object header in the slab, or stage it in memory when
+	// writing directly.
+	if (flags & ED_FDIRECT) {
+		hdr = obj_direct_alloc(obj, nbytes,
+				obj_data_offset(attr->keylen, attr->metalen, flags), block_size);
+	}
+	else {
+		hdr = slab_map(cache, vno % block_count, nblcks, true);
+	}
 	if (hdr == MAP_FAILED) {
 		rc = ED_ERRNO;
 		goto done;
@@ -540,45 +1847,20 @@ ed_create(EdCache *cache, EdObject **objp, const EdObjectAttr *attr)
 	if (rc < 0) { goto done; }
 
 	// Initializse the object header.
-	madvise(hdr, nbytes, MADV_SEQUENTIAL);
-	hdr->xid = 0;
-	hdr->created = now;
-	hdr->exp = 0;
-	hdr->flags = 0;
-	hdr->keylen = attr->keylen;
-	hdr->metalen = attr->metalen;
-	hdr->datalen = attr->datalen;
-	hdr->keyhash = h;
-	hdr->metacrc = 0;
-	hdr->datacrc = 0;
-
-	// Copy the key into the tail of the header segment.
-	uint8_t *key = obj_key(hdr), *meta = obj_meta(hdr);
-	memcpy(key, attr->key, attr->keylen);
-	key += attr->keylen;
-
-	// Zero out the end of the key segment.
-	memset(key, 0, obj_meta(hdr) - key);
-
-	// Write the meta data segment if provided.
-	if (attr->meta != NULL && attr->metalen > 0) {
-		obj_write(meta, attr->meta, attr->metalen, &hdr->metacrc, flags);
+	if (!(flags & (ED_FMAPSLAB|ED_FDIRECT))) {
+		madvise(hdr, nbytes, MADV_SEQUENTIAL);
 	}
-	meta += attr->metalen;
-
-	// Zero out the end of the meta segment.
-	memset(meta, 0, obj_data(hdr, flags) - meta);
-
+	obj_hdr_init(hdr, attr, h, now, flags);
 	obj_init(obj, cache, hdr, vno, false, ED_TIME_INF);
 
 done:
 	// Clean up resources if there was an error.
 	if (rc < 0) {
 		if (hdr != MAP_FAILED) {
-			ed_blk_unmap(hdr, nblcks, block_size);
+			obj_hdr_close(cache, hdr, nblcks, obj->nomap);
 		}
 		if (locked) {
-			ed_flck(slabfd, ED_LCK_UN, (vno % block_count) * block_size, nbytes, flags);
+			slab_lck(cache, ED_LCK_UN, (vno % block_count) * block_size, nbytes, flags);
 		}
 		if (ed_txn_isopen(txn)) {
 			ed_txn_close(&cache->txn, flags|ED_FRESET);
@@ -596,6 +1878,7 @@ update_expiry(EdCache *cache, const void *k, size_t klen, EdTime exp, EdTimeUnix
 	const uint16_t block_size = cache->slab_block_size;
 	const EdBlkno block_count = cache->slab_block_count;
 	const uint64_t h = ed_hash(k, klen, cache->idx.seed);
+	const uint32_t tag = ed_hash_tag(k, klen, cache->idx.seed);
 	EdTxn *const txn = cache->txn;
 
 	int rc = 0, set = 0;
@@ -607,13 +1890,14 @@ update_expiry(EdCache *cache, const void *k, size_t klen, EdTime exp, EdTimeUnix
 	for (rc = ed_bpt_find(txn, ED_DB_KEYS, h, (void **)&key);
 			rc == 1 && ed_bpt_loop(txn, ED_DB_KEYS) == 0;
 			rc = ed_bpt_next(txn, ED_DB_KEYS, (void **)&key)) {
-		// First check if the object is expired.
-		if (!restore && ed_expired_at(cache->idx.epoch, key->exp, now)) {
+		// First check if the object is expired or is known to hold another key.
+		if (!ed_entry_key_match(key, tag, klen) ||
+				(!restore && ed_expired_at(cache->idx.epoch, key->exp, now))) {
 			continue;
 		}
 
 		// Map the slab object.
-		EdObjectHdr *hdr = ed_blk_map(cache->idx.slabfd, key->vno % block_count, 1, block_size, true);
+		EdObjectHdr *hdr = slab_map(cache, key->vno % block_count, 1, true);
 		if (hdr == MAP_FAILED) {
 			rc = ED_ERRNO;
 			break;
@@ -622,9 +1906,15 @@ update_expiry(EdCache *cache, const void *k, size_t klen, EdTime exp, EdTimeUnix
 		// Resolve any hash collisions with a full key comparison. This will *very*
 		// likely match. If it does, set up the object and end the loop.
 		if (hdr->keylen == klen && memcmp(obj_key(hdr), k, klen) == 0) {
-			EdEntryKey keynew = *key;
+			EdEntryKey keyold = *key, keynew = *key;
 			keynew.exp = exp;
 			rc = ed_bpt_set(txn, ED_DB_KEYS, (void *)&keynew, true);
+			if (rc >= 0) {
+				rc = expiry_del(txn, keyold.vno, keyold.exp);
+			}
+			if (rc >= 0) {
+				rc = expiry_set(txn, h, keynew.vno, exp);
+			}
 			if (rc >= 0) {
 				hdr->exp = exp;
 				set = 1;
@@ -651,6 +1941,9 @@ update_expiry(EdCache *cache, const void *k, size_t klen, EdTime exp, EdTimeUnix
 int
 ed_update_ttl(EdCache *cache, const void *k, size_t klen, EdTimeTTL ttl, bool restore)
 {
+	if (cache->nshards > 0) {
+		cache = cache->shards[shard_key(cache, k, klen)];
+	}
 	EdTimeUnix now = ed_now_unix();
 	EdTime exp = ed_expiry_at(cache->idx.epoch, ttl, now);
 	return update_expiry(cache, k, klen, exp, now, restore);
@@ -659,6 +1952,9 @@ ed_update_ttl(EdCache *cache, const void *k, size_t klen, EdTimeTTL ttl, bool re
 int
 ed_update_expiry(EdCache *cache, const void *k, size_t klen, EdTimeUnix expiry, bool restore)
 {
+	if (cache->nshards > 0) {
+		cache = cache->shards[shard_key(cache, k, klen)];
+	}
 	EdTimeUnix now = ed_now_unix();
 	EdTime exp = ed_time_from_unix(cache->idx.epoch, expiry);
 	return update_expiry(cache, k, klen, exp, now, restore);
@@ -674,15 +1970,142 @@ ed_write(EdObject *obj, const void *buf, size_t len)
 		return ED_EOBJECT_TOOBIG;
 	}
 	const uint64_t flags = obj->cache->idx.flags;
-	obj_write(obj->data + obj->dataseek, buf, len, &obj->datacrc, flags);
+	if (obj->nomap) {
+		int rc = obj_direct_write(obj, buf, len, flags);
+		if (rc < 0) { return rc; }
+	}
+	else {
+		obj_write(obj->data + obj->dataseek, buf, len, &obj->datacrc, flags);
+	}
 	obj->dataseek += (uint32_t)len;
 	if (obj->datalen == obj->dataseek) {
 		obj->hdr->datacrc = obj->datacrc;
-		obj_hdr_final(obj->hdr, obj->nbytes, flags);
+		// The staging buffers are already zeroed past the data.
+		if (!obj->nomap) {
+			obj_hdr_final(obj->hdr, obj->nbytes, flags);
+		}
 	}
 	return (int64_t)len;
 }
 
+ssize_t
+ed_obj_read_pos(const EdObject *obj, size_t len, off_t off, off_t *pos)
+{
+	if (!obj->rdonly) {
+		return ED_EOBJECT_WRONLY;
+	}
+	if (off < 0) {
+		return ed_esys(EINVAL);
+	}
+	if ((uint64_t)off >= obj->datalen) {
+		return 0;
+	}
+	if (len > obj->datalen - (size_t)off) {
+		len = obj->datalen - (size_t)off;
+	}
+	*pos = slab_pos(obj->cache, obj->byte + (size_t)off +
+			obj_data_offset(obj->keylen, obj->metalen, obj->cache->idx.flags), &len);
+	return (ssize_t)len;
+}
+
+ssize_t
+ed_obj_write_pos(EdObject *obj, const void *buf, size_t len, off_t *pos)
+{
+	if (obj->rdonly) {
+		return ED_EOBJECT_RDONLY;
+	}
+	if (obj->nomap) {
+		return ed_esys(ENOTSUP);
+	}
+	if (len > UINT32_MAX || (uint64_t)obj->dataseek + len > (uint64_t)obj->datalen) {
+		return ED_EOBJECT_TOOBIG;
+	}
+	const uint64_t flags = obj->cache->idx.flags;
+	*pos = slab_pos(obj->cache, obj->byte + obj->dataseek +
+			obj_data_offset(obj->keylen, obj->metalen, flags), &len);
+	if (flags & ED_FCHECKSUM) {
+		obj->datacrc = ed_crc32c(obj->datacrc, buf, len);
+	}
+	obj->dataseek += (uint32_t)len;
+	if (obj->datalen == obj->dataseek) {
+		obj->hdr->datacrc = obj->datacrc;
+		obj_hdr_final(obj->hdr, obj->nbytes, flags);
+	}
+	return (ssize_t)len;
+}
+
+ssize_t
+ed_read(EdObject *obj, void *buf, size_t len, off_t off)
+{
+	off_t pos;
+	ssize_t n = ed_obj_read_pos(obj, len, off, &pos);
+	if (n <= 0) { return n; }
+
+	// The length is clamped at the end of the slab, but both the mapping and
+	// the slab read continue across a wrapped object.
+	if (len > obj->datalen - (size_t)off) {
+		len = obj->datalen - (size_t)off;
+	}
+	if (obj->data != NULL) {
+		memcpy(buf, obj->data + off, len);
+	}
+	else {
+		int rc = slab_pread(obj->cache, buf, len, pos);
+		if (rc < 0) { return rc; }
+	}
+	return (ssize_t)len;
+}
+
+static ssize_t
+obj_send(EdObject *obj, int s, size_t len, bool splicing)
+{
+	if (!obj->rdonly) {
+		return ED_EOBJECT_WRONLY;
+	}
+
+	// Read-only objects use the data seek as the send cursor. The shared region
+	// lock from the open is held until the object is closed, so the slab range
+	// remains stable between partial sends.
+	const size_t rem = obj->datalen - obj->dataseek;
+	if (len > rem) { len = rem; }
+	if (len == 0) { return 0; }
+
+	const int slabfd = obj->cache->idx.slabfd;
+	off_t off = slab_pos(obj->cache, obj->byte + obj->dataseek +
+			obj_data_offset(obj->keylen, obj->metalen, obj->cache->idx.flags), &len);
+	ssize_t n;
+
+#if defined(__linux__)
+	if (splicing) {
+		n = splice(slabfd, &off, s, NULL, len, len < rem ? SPLICE_F_MORE : 0);
+	}
+	else {
+		n = sendfile(s, slabfd, &off, len);
+	}
+#else
+	(void)splicing;
+	(void)off;
+	if (obj->data == NULL) { return ed_esys(ENOTSUP); }
+	n = write(s, obj->data + obj->dataseek, len);
+#endif
+	if (n < 0) { return ED_ERRNO; }
+
+	obj->dataseek += (uint32_t)n;
+	return n;
+}
+
+ssize_t
+ed_splice(EdObject *obj, int s, size_t len)
+{
+	return obj_send(obj, s, len, true);
+}
+
+ssize_t
+ed_sendfile(EdObject *obj, int s, size_t len)
+{
+	return obj_send(obj, s, len, false);
+}
+
 const void *
 ed_value(EdObject *obj, size_t *len)
 {
@@ -704,6 +2127,14 @@ ed_close(EdObject **objp)
 	if (obj == NULL) { return 0; }
 	*objp = NULL;
 
+	// Batched objects are indexed when the batch is committed.
+	if (obj->batch != NULL) {
+		obj->batch->nopen--;
+		if (obj->datalen != obj->dataseek) { return ED_EOBJECT_TOOSMALL; }
+		obj->closed = true;
+		return 0;
+	}
+
 	EdCache *cache = obj->cache;
 	uint64_t flags = cache->idx.flags;
 	int slabfd = cache->idx.slabfd;
@@ -722,12 +2153,19 @@ ed_close(EdObject **objp)
 
 			obj->hdr->exp = obj->exp;
 			obj->hdr->xid = cache->txn->xid;
-			ed_flck(slabfd, ED_LCK_UN, obj->byte, obj->nbytes, flags);
+
+			// Direct objects must reach the slab before the key is committed.
+			if (obj->nomap) {
+				rc = obj_direct_flush(obj, flags);
+				if (rc < 0) { goto done; }
+			}
+			slab_lck(cache, ED_LCK_UN, obj->byte, obj->nbytes, flags);
 			locked = false;
 
 			rc = ed_txn_commit(&cache->txn, flags|ED_FRESET);
 
-			if (rc >= 0 && !(flags & ED_FNOSYNC)) {
+			// With group syncing, the commit has already synced the slab.
+			if (rc >= 0 && !(flags & (ED_FNOSYNC|ED_FGROUPSYNC))) {
 				fsync(slabfd);
 			}
 		}
@@ -737,10 +2175,10 @@ ed_close(EdObject **objp)
 	}
 
 done:
-	ed_blk_unmap(obj->hdr, obj->nblcks, cache->slab_block_size);
+	obj_hdr_close(cache, obj->hdr, obj->nblcks, obj->nomap);
 
 	if (locked) {
-		ed_flck(slabfd, ED_LCK_UN, obj->byte, obj->nbytes, flags);
+		slab_lck(cache, ED_LCK_UN, obj->byte, obj->nbytes, flags);
 	}
 	if (rc < 0 && ed_txn_isopen(cache->txn)) {
 		ed_txn_close(&cache->txn, flags|ED_FRESET);
@@ -756,12 +2194,291 @@ ed_discard(EdObject **objp)
 	if (obj == NULL) { return; }
 	*objp = NULL;
 
+	if (obj->batch != NULL) {
+		obj->batch->nopen--;
+		return;
+	}
+
 	EdCache *cache = obj->cache;
-	ed_blk_unmap(obj->hdr, obj->nblcks, cache->slab_block_size);
-	ed_flck(cache->idx.slabfd, ED_LCK_UN, obj->byte, obj->nbytes, cache->idx.flags);
+	obj_hdr_close(cache, obj->hdr, obj->nblcks, obj->nomap);
+	slab_lck(cache, ED_LCK_UN, obj->byte, obj->nbytes, cache->idx.flags);
 	free(obj);
 }
 
+static void
+batch_free(EdBatch *batch)
+{
+	for (size_t i = 0; i < batch->nobjs; i++) {
+		free(batch->objs[i]);
+	}
+	free(batch);
+}
+
+/**
+ * @brief  Begins a batch on each partition of a sharded cache
+ *
+ * Objects are handed out in the order of #attrs, and each partition commits
+ * its own objects. The batch is only atomic within each partition.
+ */
+static int
+batch_begin_shards(EdCache *cache, EdBatch **batchp, const EdObjectAttr *attrs, size_t n)
+{
+	EdBatch *batch = calloc(1, sizeof(*batch) + (n-1)*sizeof(batch->objs[0]));
+	if (batch == NULL) { return ED_ERRNO; }
+
+	EdObjectAttr *sattrs = malloc(n * sizeof(*sattrs));
+	unsigned *route = malloc(n * sizeof(*route));
+	batch->parts = calloc(cache->nshards, sizeof(*batch->parts));
+	batch->cache = cache;
+	batch->map = MAP_FAILED;
+	batch->nobjs = n;
+
+	int rc = 0;
+	if (sattrs == NULL || route == NULL || batch->parts == NULL) {
+		rc = ED_ERRNO;
+		goto done;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		route[i] = shard_key(cache, attrs[i].key, attrs[i].keylen);
+	}
+
+	for (unsigned s = 0; s < cache->nshards; s++) {
+		size_t m = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (route[i] == s) { sattrs[m++] = attrs[i]; }
+		}
+		if (m == 0) { continue; }
+
+		rc = ed_batch_begin(cache->shards[s], &batch->parts[s], sattrs, m);
+		if (rc < 0) { goto done; }
+
+		m = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (route[i] == s) { batch->objs[i] = batch->parts[s]->objs[m++]; }
+		}
+	}
+
+done:
+	free(sattrs);
+	free(route);
+	if (rc < 0) {
+		if (batch->parts != NULL) {
+			// Committing a batch without any closed objects releases it.
+			for (unsigned s = 0; s < cache->nshards; s++) {
+				ed_batch_commit(&batch->parts[s]);
+			}
+			free(batch->parts);
+		}
+		free(batch);
+		batch = NULL;
+	}
+	*batchp = batch;
+	return rc;
+}
+
+int
+ed_batch_begin(EdCache *cache, EdBatch **batchp, const EdObjectAttr *attrs, size_t n)
+{
+	if (n == 0) { return ed_esys(EINVAL); }
+	if (cache->nshards > 0) {
+		return batch_begin_shards(cache, batchp, attrs, n);
+	}
+
+	EdBatch *batch = calloc(1, sizeof(*batch) + (n-1)*sizeof(batch->objs[0]));
+	if (batch == NULL) { return ED_ERRNO; }
+
+	const EdTimeUnix unow = ed_now_unix();
+	const EdTime now = ed_time_from_unix(cache->idx.epoch, unow);
+	const uint64_t flags = cache->idx.flags;
+	const uint16_t block_size = cache->slab_block_size;
+	const EdBlkno block_count = cache->slab_block_count;
+	EdTxn *const txn = cache->txn;
+
+	size_t nbytes = 0;
+	bool locked = false;
+	EdBlkno vno;
+	int rc = 0;
+
+	batch->cache = cache;
+	batch->map = MAP_FAILED;
+	for (size_t i = 0; i < n; i++) {
+		rc = obj_new(&batch->objs[i], attrs[i].key, attrs[i].keylen, false);
+		if (rc < 0) { goto done; }
+		batch->nobjs++;
+		nbytes += obj_slab_size(attrs[i].keylen, attrs[i].metalen, attrs[i].datalen,
+				block_size, flags);
+	}
+
+	// Reserve a single range for all objects. This is the same as #ed_create(),
+	// but the index is only updated once for the whole batch.
+	rc = ed_txn_open(txn, flags);
+	if (rc < 0) { goto done; }
+
+	vno = ed_txn_vno(txn);
+	rc = obj_reserve(cache, txn, flags, &vno, nbytes);
+	if (rc < 0) { goto done; }
+	locked = true;
+
+	batch->byte = (vno % block_count) * block_size;
+	batch->nbytes = nbytes;
+	batch->nblcks = nbytes/block_size;
+	batch->map = slab_map(cache, vno % block_count, batch->nblcks, true);
+	if (batch->map == MAP_FAILED) {
+		rc = ED_ERRNO;
+		goto done;
+	}
+
+	ed_txn_set_vno(txn, vno + batch->nblcks);
+
+	rc = ed_txn_commit(&cache->txn, flags|ED_FRESET);
+	if (rc < 0) { goto done; }
+
+	if (!(flags & ED_FMAPSLAB)) {
+		madvise(batch->map, nbytes, MADV_SEQUENTIAL);
+	}
+
+	// Lay out each object header within the reserved range.
+	uint8_t *p = batch->map;
+	for (size_t i = 0; i < n; i++) {
+		EdObject *obj = batch->objs[i];
+		EdObjectHdr *hdr = (EdObjectHdr *)p;
+		uint64_t h = ed_hash(attrs[i].key, attrs[i].keylen, cache->idx.seed);
+		obj_hdr_init(hdr, &attrs[i], h, now, flags);
+		obj_init(obj, cache, hdr, vno, false, ED_TIME_INF);
+		obj->batch = batch;
+		p += obj->nbytes;
+		vno += obj->nblcks;
+	}
+
+done:
+	if (rc < 0) {
+		if (batch->map != MAP_FAILED) {
+			ed_blk_unmap(batch->map, batch->nblcks, block_size);
+		}
+		if (locked) {
+			slab_lck(cache, ED_LCK_UN, batch->byte, nbytes, flags);
+		}
+		if (ed_txn_isopen(txn)) {
+			ed_txn_close(&cache->txn, flags|ED_FRESET);
+		}
+		batch_free(batch);
+		batch = NULL;
+	}
+	*batchp = batch;
+	return rc;
+}
+
+int
+ed_batch_create(EdBatch *batch, EdObject **objp)
+{
+	if (batch->next == batch->nobjs) {
+		*objp = NULL;
+		return 0;
+	}
+	if (batch->parts != NULL) {
+		// Partition batches hand out their objects in the same relative order.
+		EdObject *obj = batch->objs[batch->next++];
+		int rc = ed_batch_create(obj->batch, objp);
+		assert(*objp == obj);
+		return rc;
+	}
+	*objp = batch->objs[batch->next++];
+	batch->nopen++;
+	return 1;
+}
+
+/**
+ * @brief  Counts the objects handed out by a batch that are still open
+ * @param  batch  Batch object
+ * @return  Number of objects not yet closed or discarded
+ */
+static size_t
+batch_nopen(const EdBatch *batch)
+{
+	if (batch->parts == NULL) { return batch->nopen; }
+	size_t n = 0;
+	for (unsigned s = 0; s < batch->cache->nshards; s++) {
+		if (batch->parts[s] != NULL) { n += batch->parts[s]->nopen; }
+	}
+	return n;
+}
+
+int
+ed_batch_commit(EdBatch **batchp)
+{
+	EdBatch *batch = *batchp;
+	if (batch == NULL) { return 0; }
+
+	// The objects belong to the batch, so it cannot be released while the caller
+	// still holds any of them.
+	if (batch_nopen(batch) > 0) { return ed_esys(EBUSY); }
+	*batchp = NULL;
+
+	if (batch->parts != NULL) {
+		int rc = 0, count = 0;
+		for (unsigned s = 0; s < batch->cache->nshards; s++) {
+			int prc = ed_batch_commit(&batch->parts[s]);
+			if (prc < 0) {
+				if (rc == 0) { rc = prc; }
+			}
+			else {
+				count += prc;
+			}
+		}
+		free(batch->parts);
+		free(batch);
+		return rc < 0 ? rc : count;
+	}
+
+	EdCache *cache = batch->cache;
+	const uint64_t flags = cache->idx.flags;
+	const int slabfd = cache->idx.slabfd;
+	bool locked = true;
+	int rc = 0, count = 0;
+
+	for (size_t i = 0; i < batch->nobjs; i++) {
+		if (batch->objs[i]->closed) { count++; }
+	}
+
+	if (count > 0) {
+		rc = ed_txn_open(cache->txn, flags);
+		if (rc < 0) { goto done; }
+
+		// Insert every completed object in the same transaction so that the
+		// modified tree pages are shared across the batch.
+		for (size_t i = 0; i < batch->nobjs; i++) {
+			EdObject *obj = batch->objs[i];
+			if (!obj->closed) { continue; }
+			rc = obj_upsert(cache, obj->newkey, obj->keylen, obj->hdr->keyhash,
+					obj->vno, obj->nblcks, obj->exp);
+			if (rc < 0) { goto done; }
+			obj->hdr->exp = obj->exp;
+			obj->hdr->xid = cache->txn->xid;
+		}
+
+		slab_lck(cache, ED_LCK_UN, batch->byte, batch->nbytes, flags);
+		locked = false;
+
+		rc = ed_txn_commit(&cache->txn, flags|ED_FRESET);
+
+		if (rc >= 0 && !(flags & (ED_FNOSYNC|ED_FGROUPSYNC))) {
+			fsync(slabfd);
+		}
+	}
+
+done:
+	ed_blk_unmap(batch->map, batch->nblcks, cache->slab_block_size);
+	if (locked) {
+		slab_lck(cache, ED_LCK_UN, batch->byte, batch->nbytes, flags);
+	}
+	if (rc < 0 && ed_txn_isopen(cache->txn)) {
+		ed_txn_close(&cache->txn, flags|ED_FRESET);
+	}
+	batch_free(batch);
+	return rc < 0 ? rc : count;
+}
+
 int
 ed_set_ttl(EdObject *obj, EdTimeTTL ttl)
 {
@@ -815,6 +2532,27 @@ ed_list_open(EdCache *cache, EdList **listp, const char *id)
 	const EdBlkno block_count = cache->slab_block_count;
 	int rc = 0;
 
+	// A sharded cache lists each partition in turn, starting from the partition
+	// of the id when one is provided.
+	if (cache->nshards > 0) {
+		unsigned shard = 0;
+		if (id != NULL) {
+			rc = shard_id(cache, id, &shard, &id);
+			if (rc < 0) { return rc; }
+		}
+		EdList *list = calloc(1, sizeof(*list));
+		if (list == NULL) { return ED_ERRNO; }
+		rc = ed_list_open(cache->shards[shard], &list->part, id);
+		if (rc < 0) {
+			free(list);
+			return rc;
+		}
+		list->cache = cache;
+		list->shard = shard;
+		*listp = list;
+		return 0;
+	}
+
 	// If an id is not provided, start from the oldest entry.
 	if (id != NULL) {
 		rc = obj_id(id, &xmin, &vmin);
@@ -827,10 +2565,15 @@ ed_list_open(EdCache *cache, EdList **listp, const char *id)
 	rc = ed_txn_new(&list->txn, &cache->idx);
 	if (rc < 0) { goto error; }
 
+	// Lists may stay open for a while, so give them their own reader slot when
+	// one is available rather than sharing the connection transaction id.
+	int slot = ed_idx_acquire_reader(&cache->idx);
+	if (slot >= 0) { list->txn->rslot = slot; }
+
 	rc = ed_txn_open(list->txn, cache->idx.flags|ED_FRDONLY);
 	if (rc < 0) { goto error; }
 
-	xmax = cache->idx.conn->xid;
+	xmax = ed_txn_snapshot(list->txn);
 	vmax = ed_txn_vno(list->txn);
 	if (id == NULL) {
 		xmin = 0;
@@ -880,11 +2623,39 @@ list_clear(EdList *list, const uint16_t block_size, const EdBlkno block_need)
 	}
 }
 
+/**
+ * @brief  Iterates the partition lists of a sharded cache
+ */
+static int
+list_next_shards(EdList *list, const EdObject **objp)
+{
+	EdCache *cache = list->cache;
+	for (;;) {
+		int rc = list->part ? ed_list_next(list->part, objp) : 0;
+		if (rc != 0) { return rc; }
+		ed_list_close(&list->part);
+		if (++list->shard >= cache->nshards) {
+			list->shard = cache->nshards;
+			*objp = NULL;
+			return 0;
+		}
+		rc = ed_list_open(cache->shards[list->shard], &list->part, NULL);
+		if (rc < 0) {
+			*objp = NULL;
+			return rc;
+		}
+	}
+}
+
 int
 ed_list_next(EdList *list, const EdObject **objp)
 {
 	// TODO: optimize unmap/map when its the same page
 
+	if (list->cache->nshards > 0) {
+		return list_next_shards(list, objp);
+	}
+
 	int rc = 0;
 	const EdCache *const cache = list->cache;
 	const uint16_t block_size = cache->slab_block_size;
@@ -903,7 +2674,7 @@ ed_list_next(EdList *list, const EdObject **objp)
 
 		const EdBlkno no = vcur % block_count;
 
-		hdr = ed_blk_map(cache->idx.slabfd, no, block_need, block_size, true);
+		hdr = slab_map(cache, no, block_need, true);
 		if (hdr == MAP_FAILED) {
 			rc = ED_ERRNO;
 			goto done;
@@ -949,6 +2720,12 @@ ed_list_close(EdList **listp)
 	if (list == NULL) { return; }
 	*listp = NULL;
 
+	if (list->cache->nshards > 0) {
+		ed_list_close(&list->part);
+		free(list);
+		return;
+	}
+
 	const uint16_t block_size = list->cache->slab_block_size;
 	const EdBlkno block_need = ED_COUNT_SIZE(sizeof(EdObjectHdr) + ED_MAX_KEY, block_size);
 	list_clear(list, block_size, block_need);
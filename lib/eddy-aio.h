@@ -0,0 +1,123 @@
+#ifndef INCLUDED_EDDY_AIO_H
+#define INCLUDED_EDDY_AIO_H
+
+#include "eddy.h"
+
+typedef struct EdAio EdAio;
+typedef struct EdAioEvent EdAioEvent;
+
+/**
+ * @brief  Completed asynchronous request
+ */
+struct EdAioEvent {
+	EdObject *   obj;              /**< Object the request was made against */
+	void *       udata;            /**< User data passed with the request */
+	const void * buf;              /**< Registered buffer holding read data, or NULL for writes */
+	ssize_t      res;              /**< Number of bytes transferred or <0 error code */
+	int          slot;             /**< Registered buffer slot */
+};
+
+/**
+ * @brief  Opens an io_uring engine for the slab of a cache
+ *
+ * The slab file descriptor is registered with the ring, along with #depth
+ * buffers of #bufsize bytes each. Each request uses one buffer, so at most
+ * #depth requests may be in flight. The engine is not thread-safe, and is
+ * intended to be owned by a single event loop.
+ *
+ * @param  aiop  Indirect pointer to assign the engine to
+ * @param  cache  Cache to perform slab I/O against
+ * @param  depth  Number of requests that may be in flight
+ * @param  bufsize  Size in bytes of each registered buffer
+ * @return  0 on success, <0 on error
+ */
+ED_EXPORT int
+ed_aio_open(EdAio **aiop, EdCache *cache, unsigned depth, size_t bufsize);
+
+/**
+ * @brief  Closes the engine
+ *
+ * Any requests still in flight are waited on before the ring is torn down.
+ *
+ * @param  aiop  Indirect pointer to the engine
+ */
+ED_EXPORT void
+ed_aio_close(EdAio **aiop);
+
+/**
+ * @brief  Gets a file descriptor that becomes readable when completions are ready
+ * @param  aio  Engine
+ * @return  Event file descriptor
+ */
+ED_EXPORT int
+ed_aio_fd(const EdAio *aio);
+
+/**
+ * @brief  Queues a read of object data into a registered buffer
+ *
+ * The object must be opened for reading, typically with #ED_ONOMAP so that
+ * opening does not fault in the object data. The length is clamped to the
+ * buffer size, the end of the object, and the end of the slab for objects
+ * that wrap around. The read is not started until #ed_aio_submit() is called.
+ *
+ * @param  aio  Engine
+ * @param  obj  Read-only object
+ * @param  len  Maximum number of bytes to read
+ * @param  off  Offset into the object data
+ * @param  udata  User data returned with the completion
+ * @return  Number of bytes requested, 0 at the end of the data, or <0 on error
+ */
+ED_EXPORT ssize_t
+ed_aio_read(EdAio *aio, EdObject *obj, size_t len, off_t off, void *udata);
+
+/**
+ * @brief  Queues a write of the next object data segment
+ *
+ * The data is copied into a registered buffer, so #buf may be reused right
+ * away. The object write position advances immediately. All writes must be
+ * completed before the object is closed. Fewer bytes than requested are
+ * queued when the object wraps around the end of the slab.
+ *
+ * @param  aio  Engine
+ * @param  obj  Writable object
+ * @param  buf  Data to write
+ * @param  len  Number of bytes to write, at most the buffer size
+ * @param  udata  User data returned with the completion
+ * @return  Number of bytes queued or <0 on error
+ */
+ED_EXPORT ssize_t
+ed_aio_write(EdAio *aio, EdObject *obj, const void *buf, size_t len, void *udata);
+
+/**
+ * @brief  Submits all queued requests
+ * @param  aio  Engine
+ * @return  Number of requests submitted or <0 on error
+ */
+ED_EXPORT int
+ed_aio_submit(EdAio *aio);
+
+/**
+ * @brief  Collects completed requests
+ *
+ * Write buffers are released automatically. Read buffers remain valid until
+ * passed to #ed_aio_release().
+ *
+ * @param  aio  Engine
+ * @param  ev  Array to receive completions
+ * @param  n  Maximum number of completions to collect
+ * @param  wait  Minimum number of completions to block for
+ * @return  Number of completions collected or <0 on error
+ */
+ED_EXPORT int
+ed_aio_reap(EdAio *aio, EdAioEvent *ev, unsigned n, unsigned wait);
+
+/**
+ * @brief  Returns the buffer for a completed read to the engine
+ * @param  aio  Engine
+ * @param  ev  Completion from #ed_aio_reap()
+ */
+ED_EXPORT void
+ed_aio_release(EdAio *aio, const EdAioEvent *ev);
+
+#endif
+
@@ -18,6 +18,7 @@
 
 #if defined(__linux__)
 # include <linux/fs.h>
+# include <sys/sendfile.h>
 #elif defined(__APPLE__) || defined(__FreeBSD__)
 # include <sys/disk.h>
 #else
@@ -28,6 +29,29 @@
 # define ED_ALLOC_COUNT 16
 #endif
 
+/**
+ * Size of each index page, which is also the size of the b+tree nodes. This
+ * must be a multiple of the system page size. Larger pages give wider nodes
+ * and shallower trees, but copy more bytes for each node modified in a
+ * transaction. The size is saved in the index, and indexes created with a
+ * different size cannot be opened.
+ */
+#ifndef ED_PG_SIZE
+# define ED_PG_SIZE PAGESIZE
+#endif
+
+#ifndef ED_OBJ_COPY_SIZE
+# define ED_OBJ_COPY_SIZE 4096
+#endif
+
+#ifndef ED_DIRECT_SIZE
+# define ED_DIRECT_SIZE (1024*1024)
+#endif
+
+#ifndef ED_ENTRY_MAX
+# define ED_ENTRY_MAX 64
+#endif
+
 #ifndef ED_MAX_ALIGN
 # ifdef __BIGGEST_ALIGNMENT__
 #  define ED_MAX_ALIGN __BIGGEST_ALIGNMENT__
@@ -41,7 +65,8 @@
 
 #define ED_DB_KEYS 0
 #define ED_DB_BLOCKS 1
-#define ED_NDB 2
+#define ED_DB_EXPIRY 2
+#define ED_NDB 3
 
 #define ED_STR2(v) #v
 #define ED_STR(v) ED_STR2(v)
@@ -69,14 +94,19 @@ typedef uint64_t EdTxnId;
 typedef struct EdTxn EdTxn;
 typedef struct EdTxnDb EdTxnDb;
 typedef struct EdTxnNode EdTxnNode;
+typedef struct EdTxnSlot EdTxnSlot;
 
 typedef struct EdIdx EdIdx;
 typedef struct EdConn EdConn;
+typedef struct EdRlck EdRlck;
+typedef struct EdRlckConn EdRlckConn;
+typedef struct EdRlckTable EdRlckTable;
 
 typedef struct EdStat EdStat;
 
 typedef struct EdEntryBlock EdEntryBlock;
 typedef struct EdEntryKey EdEntryKey;
+typedef struct EdEntryExpiry EdEntryExpiry;
 typedef struct EdObjectHdr EdObjectHdr;
 
 typedef volatile EdPgno EdPgnoV;
@@ -161,7 +191,8 @@ struct EdLck {
  *
  * The lock controls both thread-level, and file-level reader/writer locking.
  * A byte range is specified for file locking, allowing multiple independant
- * locks per file.
+ * locks per file. The thread-level lock only guards threads sharing the same
+ * handle, as file locks held through one descriptor do not exclude each other.
  *
  * @param  lck  Pointer to a lock value
  * @param  start  Starting byte off
@@ -217,6 +248,11 @@ ed_lck(EdLck *lck, int fd, EdLckType type, uint64_t flags);
  * This is used to both aquires a lock (shared or exlusive) and release it.
  * It is undefined behavior to acquire a lock multiple times. The lock must
  * be released before #ed_lck_final().
+ *
+ * Where supported, open file description locks are used. These are held by
+ * the file descriptor, so locks from separate descriptors conflict even within
+ * the same process. Threads sharing a descriptor must still be coordinated
+ * with #ed_lck().
  * 
  * Supported values for #type are:
  *   - #ED_LCK_SH
@@ -240,6 +276,22 @@ ed_lck(EdLck *lck, int fd, EdLckType type, uint64_t flags);
 ED_LOCAL int
 ed_flck(int fd, EdLckType type, off_t start, off_t len, uint64_t flags);
 
+/**
+ * @brief  Checks if a file lock could be taken without taking it
+ *
+ * Unlike locking and unlocking, this leaves any lock already held on the
+ * range by #fd untouched. Locks held by #fd itself never conflict.
+ *
+ * @param  fd  Open file descriptor to check
+ * @param  type  Either #ED_LCK_SH or #ED_LCK_EX
+ * @param  start  Starting offset for the region of the file
+ * @param  len  Number of bytes for region of the file
+ * @return  0 if the lock could be taken, EAGAIN if it conflicts, or another
+ *          error code
+ */
+ED_LOCAL int
+ed_flck_test(int fd, EdLckType type, off_t start, off_t len);
+
 /** @} */
 
 
@@ -263,12 +315,58 @@ ed_flck(int fd, EdLckType type, off_t start, off_t len, uint64_t flags);
 
 ED_LOCAL   void * ed_blk_map(int fd, EdBlkno no, EdBlkno count, uint16_t size, bool need);
 ED_LOCAL      int ed_blk_unmap(void *p, EdBlkno count, uint16_t size);
+
+/**
+ * @brief  Maps a block range that may wrap past the end of the file
+ *
+ * When the range extends past #total blocks, the remainder is mapped from the
+ * start of the file directly after it, giving a contiguous view of the ring.
+ * This requires the file size to be a multiple of #PAGESIZE. Otherwise, and
+ * for ranges that do not wrap, this is the same as #ed_blk_map().
+ *
+ * @param  fd  File descriptor to map
+ * @param  no  Starting block number
+ * @param  count  Number of blocks to map
+ * @param  size  Size of each block
+ * @param  total  Number of blocks in the file
+ * @param  need  Hint that the pages will be accessed
+ * @return  Mapped pointer or MAP_FAILED on error
+ */
+ED_LOCAL void *
+ed_blk_map_ring(int fd, EdBlkno no, EdBlkno count, uint16_t size, EdBlkno total, bool need);
 ED_LOCAL   void * ed_pg_map(int fd, EdPgno no, EdPgno count, bool need);
 ED_LOCAL      int ed_pg_unmap(void *p, EdPgno count);
+ED_LOCAL     void ed_pg_prefetch(int fd, EdPgno no, EdPgno count);
 ED_LOCAL   void * ed_pg_load(int fd, EdPg **pgp, EdPgno no, bool need);
 ED_LOCAL     void ed_pg_unload(EdPg **pgp);
 ED_LOCAL      int ed_pg_mark_gc(EdIdx *idx, EdStat *stat);
 
+/**
+ * @brief  Maps a file once into a reserved address range
+ *
+ * Once reserved, calls to #ed_pg_map() for the file descriptor return
+ * pointers into the reserved range, growing the mapped length as needed.
+ * Calls to #ed_pg_unmap() for pointers within the range have no effect.
+ * Ranges beyond the reservation fall back to individual mappings.
+ *
+ * @param  fd  File descriptor to map
+ * @param  size  Number of bytes of address space to reserve
+ * @param  len  Number of bytes of the file to map immediately
+ * @return  0 on success, <0 error code
+ */
+ED_LOCAL int
+ed_pg_reserve(int fd, size_t size, size_t len);
+
+/**
+ * @brief  Unmaps a reserved address range for the file descriptor
+ *
+ * This must be called before the file descriptor is closed.
+ *
+ * @param  fd  File descriptor that was reserved
+ */
+ED_LOCAL void
+ed_pg_release(int fd);
+
 /**
  * @brief  Allocates a page from the underlying file
  *
@@ -410,10 +508,16 @@ struct EdNode {
 
 typedef int (*EdBptPrint)(const void *, char *buf, size_t len);
 
+/** Key compare kernels for #ed_bpt_count() */
+#define ED_BPT_COUNT_SCALAR 0
+#define ED_BPT_COUNT_SSE42  1
+#define ED_BPT_COUNT_AVX2   2
+
 ED_LOCAL   size_t ed_branch_order(void);
 ED_LOCAL   size_t ed_leaf_order(size_t esize);
 ED_LOCAL   size_t ed_bpt_capacity(size_t esize, size_t depth);
 ED_LOCAL      int ed_bpt_find(EdTxn *txn, unsigned db, uint64_t key, void **ent);
+ED_LOCAL      int ed_bpt_seek(EdTxn *txn, unsigned db, uint64_t key, void **ent);
 ED_LOCAL      int ed_bpt_first(EdTxn *txn, unsigned db, void **ent);
 ED_LOCAL      int ed_bpt_last(EdTxn *txn, unsigned db, void **ent);
 ED_LOCAL      int ed_bpt_next(EdTxn *txn, unsigned db, void **ent);
@@ -422,8 +526,10 @@ ED_LOCAL      int ed_bpt_loop(const EdTxn *txn, unsigned db);
 ED_LOCAL      int ed_bpt_set(EdTxn *txn, unsigned db, const void *ent, bool replace);
 ED_LOCAL      int ed_bpt_del(EdTxn *txn, unsigned db);
 ED_LOCAL      int ed_bpt_mark(EdIdx *, EdStat *, EdBpt *);
+ED_LOCAL      int ed_bpt_load(EdIdx *idx, EdTxnId xid, const void *ents, size_t n, size_t esize, EdPgno *root);
 ED_LOCAL     void ed_bpt_print(EdBpt *, int fd, size_t esize, FILE *, EdBptPrint);
 ED_LOCAL      int ed_bpt_verify(EdBpt *, int fd, size_t esize, FILE *);
+ED_LOCAL      int ed_bpt_count(int kernel, const void *keys, size_t stride, uint32_t n, uint64_t key);
 
 /** @} */
 
@@ -500,21 +606,29 @@ typedef enum EdTxnState EdTxnState;
 struct EdTxnDb {
 	EdNode *     root;             /**< First node searched */
 	EdNode *     find;             /**< Current find result */
+	EdNode *     seek;             /**< Leaf reached by the last full descent */
 	EdPgno *     no;               /**< Pointer to page number of root node */
 	uint64_t     key;              /**< Key searched for */
 	uint64_t     kmin;             /**< Minimum key value that may be inserted at the current position */
 	uint64_t     kmax;             /**< Maximum key value that may be inserted at the current position */
+	uint64_t     seek_min;         /**< Minimum key value routed to #seek */
+	uint64_t     seek_max;         /**< Maximum key value routed to #seek */
 	void *       start;            /**< Pointer to the first entry */
 	void *       entry;            /**< Pointer to the entry in the leaf */
 	size_t       entry_size;       /**< Size in bytes of the entry */
 	uint32_t     entry_index;      /**< Index of the entry in the leaf */
 	int          nsplits;          /**< Number of nodes requiring splits for an insert */
+	int          seek_nsplits;     /**< Number of branch splits along the path to #seek */
 	int          match;            /**< Return code of the search */
 	int          nmatches;         /**< Number of matched keys so far */
 	int          nloops;           /**< Number of full iterations */
+	EdPgno       prefetch_no;      /**< Parent page of the siblings last prefetched */
+	int          prefetch_lo;      /**< Lowest child index prefetched from #prefetch_no */
+	int          prefetch_hi;      /**< Highest child index prefetched from #prefetch_no */
 	bool         haskey;           /**< Mark if the cursor started with a find key */
 	bool         hasfind;          /**< Mark if the cursor has moved into position */
 	bool         hasentry;         /**< Mark if the current entry has been yielded */
+	uint8_t      entbuf[ED_ENTRY_MAX]; /**< Copy of the last yielded entry */
 };
 
 /**
@@ -534,12 +648,17 @@ struct EdTxn {
 	unsigned     ngcused;          /**< Number of pages discarded */
 	unsigned     ngcslot;          /**< Number of page slots in the #gc array */
 	EdTxnNode *  nodes;            /**< Linked list of node arrays */
+	EdTxnSlot *  map;              /**< Open-addressed table of nodes by page number */
+	unsigned     nmap;             /**< Number of slots in #map, a power of 2 */
+	unsigned     nmapused;         /**< Number of slots used in the current generation */
+	unsigned     mapgen;           /**< Generation marking the valid slots in #map */
 	EdTxnId      xid;              /**< Transaction ID or 0 for read-only */
 	EdBlkno      vno;              /**< Current slab write block */
 	uint64_t     cflags;           /**< Critical flags required during #ed_txn_commit() or #ed_txn_close() */
 	EdTxnState   state;            /**< Current transaction state */
 	int          error;            /**< Error code during transaction */
 	bool         isrdonly;         /**< Was #ed_txn_open() called with #ED_FRDONLY */
+	int          rslot;            /**< Connection reader slot or -1 to use the connection xid */
 	EdBpt *      roots[ED_NDB];    /**< Cached root pages */
 	EdTxnDb      db[ED_NDB];       /**< State information for each b+tree */
 };
@@ -558,6 +677,18 @@ struct EdTxnNode {
 	EdNode       nodes[1];         /**< Flexible array of node wrapped pages */
 };
 
+/**
+ * @brief  Page number lookup slot for mapped nodes
+ *
+ * Slots are only valid when #gen matches the transaction generation. This
+ * allows the whole table to be cleared by advancing the generation.
+ */
+struct EdTxnSlot {
+	EdPgno       no;               /**< Page number of the node */
+	unsigned     gen;              /**< Generation the slot was set in */
+	EdNode *     node;             /**< Node wrapping the mapped page */
+};
+
 /**
  * @brief  Allocates a new transaction for working with a specific set of databases.
  *
@@ -634,6 +765,14 @@ ed_txn_close(EdTxn **txnp, uint64_t flags);
 ED_LOCAL EdBlkno
 ed_txn_vno(const EdTxn *txn);
 
+/**
+ * @brief  Gets the transaction id of the open snapshot
+ * @param  txn  Transaction object
+ * @return  transaction id visible to the transaction
+ */
+ED_LOCAL EdTxnId
+ed_txn_snapshot(const EdTxn *txn);
+
 /**
  * @brief  Sets the slab position to write on commit
  * @param  txn  Transaction object
@@ -744,7 +883,9 @@ struct EdIdx {
 	char *       path;             /**< Path copied when opening */
 	int          fd;               /**< Open file discriptor for the file to allocate from */
 	int          slabfd;           /**< Open file descriptor for the slab */
+	int          slabdfd;          /**< Open O_DIRECT file descriptor for the slab or -1 */
 	EdLck        lck;              /**< Write lock */
+	EdLck        sync;             /**< Group sync lock */
 	EdPgGc *     gc_head;          /**< Currently mapped head of the garbage collected pages */
 	EdPgGc *     gc_tail;          /**< Currently mapped tail of the garbage collected pages */
 	uint64_t     flags;            /**< Open flags merged with the saved flags */
@@ -755,7 +896,50 @@ struct EdIdx {
 	EdTimeUnix   epoch;            /**< Epoch adjustment in seconds */
 };
 
-#define ED_IDX_PAGES(nconns) ed_count_pg(offsetof(EdPgIdx, conns) + sizeof(EdConn)*nconns)
+/**
+ * Size of the address range reserved when opening with #ED_FMAPINDEX. Pages
+ * beyond this range are mapped individually.
+ */
+#ifndef ED_IDX_MAP_SIZE
+# if UINTPTR_MAX > UINT32_MAX
+#  define ED_IDX_MAP_SIZE ((size_t)64*1024*1024*1024)
+# else
+#  define ED_IDX_MAP_SIZE ((size_t)256*1024*1024)
+# endif
+#endif
+
+/**
+ * Largest slab that will be mapped whole when opening with #ED_FMAPSLAB.
+ * Larger slabs, and all slabs on 32-bit hosts, use windowed mappings.
+ */
+#ifndef ED_SLAB_MAP_MAX
+# if UINTPTR_MAX > UINT32_MAX
+#  define ED_SLAB_MAP_MAX (UINT64_C(64)*1024*1024*1024*1024)
+# else
+#  define ED_SLAB_MAP_MAX UINT64_C(0)
+# endif
+#endif
+
+/** Byte offset of the slab lock table within the index header pages */
+#define ED_IDX_RLCK_OFF(nconns) \
+	ED_ALIGN_SIZE(offsetof(EdPgIdx, conns) + sizeof(EdConn)*(nconns), 64)
+
+/** Byte size of the slab lock table */
+#define ED_IDX_RLCK_SIZE(nconns) \
+	(offsetof(EdRlckTable, conns) + sizeof(EdRlckConn)*(nconns))
+
+#define ED_IDX_PAGES(nconns) \
+	ED_COUNT_SIZE(ED_IDX_RLCK_OFF(nconns) + ED_IDX_RLCK_SIZE(nconns), ED_PG_SIZE)
+
+#define ed_idx_rlck(idx) \
+	((EdRlckTable *)((uint8_t *)(idx)->hdr + ED_IDX_RLCK_OFF((idx)->nconns)))
+
+/** Transaction id slot for a reader slot, or the connection slot when <0 */
+#define ed_idx_xid_slot(idx, slot) \
+	((slot) < 0 ? &(idx)->conn->xid : &(idx)->conn->readers[(slot)])
+
+/** Minimum time between attempts to recover stale connections */
+#define ED_IDX_RECOVER_INTERVAL 1
 
 #define ed_idx_active(idx) ((idx)->pid == getpid())
 #define ed_idx_assert(idx) assert(ed_idx_active(idx))
@@ -769,10 +953,14 @@ ED_LOCAL      int ed_idx_open(EdIdx *, const EdConfig *cfg);
 ED_LOCAL     void ed_idx_close(EdIdx *);
 ED_LOCAL  EdTxnId ed_idx_xmin(EdIdx *idx, EdTime now);
 ED_LOCAL      int ed_idx_lock(EdIdx *, EdLckType type);
-ED_LOCAL  EdTxnId ed_idx_acquire_xid(EdIdx *);
-ED_LOCAL     void ed_idx_release_xid(EdIdx *);
-ED_LOCAL      int ed_idx_acquire_snapshot(EdIdx *, EdBpt **trees);
-ED_LOCAL     void ed_idx_release_snapshot(EdIdx *, EdBpt **trees);
+ED_LOCAL      int ed_idx_sync(EdIdx *, EdTxnId xid, uint64_t flags);
+ED_LOCAL      int ed_idx_slab_lck(EdIdx *, EdLckType type, off_t start, off_t len, uint64_t flags);
+ED_LOCAL      int ed_idx_acquire_reader(EdIdx *);
+ED_LOCAL     void ed_idx_release_reader(EdIdx *, int slot);
+ED_LOCAL  EdTxnId ed_idx_acquire_xid(EdIdx *, int slot);
+ED_LOCAL     void ed_idx_release_xid(EdIdx *, int slot);
+ED_LOCAL      int ed_idx_acquire_snapshot(EdIdx *, EdBpt **trees, int slot);
+ED_LOCAL     void ed_idx_release_snapshot(EdIdx *, EdBpt **trees, int slot);
 ED_LOCAL      int ed_idx_repair_leaks(EdIdx *, EdStat *, uint64_t flags);
 
 /** @} */
@@ -981,6 +1169,19 @@ ed_mkfile(int fd, off_t size);
 ED_LOCAL uint64_t
 ed_hash(const uint8_t *val, size_t len, uint64_t seed);
 
+/**
+ * @brief  32-bit key fingerprint stored alongside the key hash
+ *
+ * The seed is inverted so the fingerprint is independent of the key hash.
+ *
+ * @param  val  Bytes to hash
+ * @param  len  Number of bytes to hash
+ * @param  seed  Seed used for the key hash
+ * @return  32-bit fingerprint
+ */
+#define ed_hash_tag(val, len, seed) \
+	((uint32_t)ed_hash((val), (len), ~(uint64_t)(seed)))
+
 /**
  * @brief  CRC-32c
  *
@@ -1043,15 +1244,42 @@ ed_power2(unsigned p)
 
 
 
-#define ED_ENTRY_BLOCK_COUNT ((PAGESIZE - sizeof(EdBpt)) / sizeof(EdEntryBlock))
-#define ED_ENTRY_KEY_COUNT ((PAGESIZE - sizeof(EdBpt)) / sizeof(EdEntryKey))
+#define ED_ENTRY_BLOCK_COUNT ((ED_PG_SIZE - sizeof(EdBpt)) / sizeof(EdEntryBlock))
+#define ED_ENTRY_KEY_COUNT ((ED_PG_SIZE - sizeof(EdBpt)) / sizeof(EdEntryKey))
+#define ED_ENTRY_EXPIRY_COUNT ((ED_PG_SIZE - sizeof(EdBpt)) / sizeof(EdEntryExpiry))
+
+/** Number of reader transaction id slots for each connection */
+#define ED_CONN_READERS 32
+
+/**
+ * Number of pooled read transactions for each cache handle. When all are in
+ * use, transactions are created outside of the pool while the connection has
+ * reader slots left.
+ */
+#define ED_CACHE_READERS (ED_CONN_READERS/2)
+
+/** Largest number of partitions in a sharded cache */
+#define ED_MAX_SHARDS 256
 
+/**
+ * A sharded cache holds no index of its own. Each key is routed by its hash
+ * to one of the partition handles in #shards, and each partition is a regular
+ * cache with its own index, slab, and write lock.
+ */
 struct EdCache {
 	EdIdx        idx;
 	EdTxn *      txn;
+	EdTxn *      readers[ED_CACHE_READERS]; /**< Pool of read-only transactions */
+	uint32_t     rbusy;            /**< Bit mask of #readers in use */
+	uint32_t     rwaiters;         /**< Number of threads waiting in #rcond */
+	pthread_mutex_t rmutex;        /**< Mutex for #rcond */
+	pthread_cond_t rcond;          /**< Signaled when a read transaction is released */
 	int          ref;
 	EdBlkno      slab_block_count; /**< Number of blocks in the slab */
 	uint16_t     slab_block_size;  /**< Size of the blocks in the slab */
+	int          shard;            /**< Partition number within a sharded cache or -1 */
+	unsigned     nshards;          /**< Number of partitions or 0 when not sharded */
+	EdCache **   shards;           /**< Partition handles of a sharded cache */
 };
 
 struct EdObject {
@@ -1073,10 +1301,64 @@ struct EdObject {
 	size_t       nbytes;
 	EdTime       exp;
 	bool         rdonly;
-	char         id[34];
+	bool         nomap;
+	bool         closed;
+	EdBatch *    batch;
+	uint8_t *    tail;
+	size_t       headlen;
+	size_t       taillen;
+	size_t       tailpos;
+	char         id[38];
 	uint8_t      newkey[1];
 };
 
+struct EdBatch {
+	EdCache *    cache;            /**< Reference to the cache handle */
+	uint8_t *    map;              /**< Mapping of the reserved slab range */
+	size_t       byte;             /**< Byte offset of the reserved slab range */
+	size_t       nbytes;           /**< Number of bytes in the reserved slab range */
+	EdBlkno      nblcks;           /**< Number of blocks in the reserved slab range */
+	size_t       nobjs;            /**< Number of objects in #objs */
+	size_t       next;             /**< Index of the next object to hand out */
+	size_t       nopen;            /**< Number of objects handed out but not closed */
+	EdBatch **   parts;            /**< Partition batches of a sharded cache or NULL */
+	EdObject *   objs[1];          /**< Flexible array of reserved objects */
+};
+
+/**
+ * @brief  Locates a read of object data within the slab
+ *
+ * The length is clamped to the end of the object data, and to the end of the
+ * slab for objects that wrap around to its start.
+ *
+ * @param  obj  Read-only object
+ * @param  len  Number of bytes requested
+ * @param  off  Offset into the object data
+ * @param  pos  Assigned the byte offset in the slab
+ * @return  Number of bytes to read, 0 at the end of the data, or <0 on error
+ */
+ED_LOCAL ssize_t
+ed_obj_read_pos(const EdObject *obj, size_t len, off_t off, off_t *pos);
+
+/**
+ * @brief  Advances the write position for data written outside of #ed_write()
+ *
+ * This updates the checksum from #buf and finalizes the header once all data
+ * has been accounted for. The caller is responsible for writing #buf to the
+ * slab at the returned position. For objects that wrap around to the start of
+ * the slab, the length is clamped at the end of the slab and the remainder
+ * must be written with another call. Objects staged for #ED_FDIRECT are not
+ * supported.
+ *
+ * @param  obj  Writable object
+ * @param  buf  Data that will be written
+ * @param  len  Number of bytes in #buf
+ * @param  pos  Assigned the byte offset in the slab
+ * @return  Number of bytes or <0 on error
+ */
+ED_LOCAL ssize_t
+ed_obj_write_pos(EdObject *obj, const void *buf, size_t len, off_t *pos);
+
 struct EdList {
 	EdCache *    cache;            /**< Reference to the cache handle */
 	EdTxn *      txn;              /**< Open read transaction */
@@ -1088,6 +1370,8 @@ struct EdList {
 	EdBlkno      vmax;             /**< Stopping virtual block number */
 	EdBlkno      vcur;             /**< Current virtual block number */
 	bool         inc;
+	unsigned     shard;            /**< Current partition of a sharded cache */
+	EdList *     part;             /**< List of the current partition or NULL */
 	EdObject     obj;              /**< Object value returned when iterating */
 };
 
@@ -1117,7 +1401,7 @@ struct EdPgGc {
 	EdPgGcState  state;            /**< State information for the first active list object */
 	EdPgno       next;             /**< Linked list of furthur gc pages */
 	uint32_t     _pad;
-#define ED_GC_DATA (PAGESIZE - sizeof(EdPg) - sizeof(EdPgGcState) - sizeof(EdPgno) - 4)
+#define ED_GC_DATA (ED_PG_SIZE - sizeof(EdPg) - sizeof(EdPgGcState) - sizeof(EdPgno) - 4)
 	uint8_t      data[ED_GC_DATA]; /**< Array for #EdPgGcList values */
 };
 
@@ -1146,6 +1430,9 @@ struct EdPgGcList {
 
 /**
  * @brief  Connection handle for each active process
+ *
+ * Reader transactions that may run concurrently within the process each claim
+ * a bit in #rmask and publish their snapshot in the matching #readers slot.
  */
 struct EdConn {
 	volatile int     pid;          /**< Process ID */
@@ -1153,6 +1440,59 @@ struct EdConn {
 	EdTxnIdV     xid;              /**< Active read transaction id */
 	EdPgno       npending;         /**< Number of pages in #pending */
 	EdPgno       pending[11];      /**< Allocated pages pending reuse */
+	uint32_t     rmask;            /**< Bit mask of claimed #readers slots */
+	uint32_t     _pad;
+	EdTxnIdV     readers[ED_CONN_READERS]; /**< Reader transaction ids */
+};
+
+/**
+ * Number of shared slab locks each connection holds in the lock table. These
+ * entries also record exclusive locks that fell back to file locks.
+ */
+#define ED_RLCK_READERS 128
+
+/** Number of exclusive slab locks held in the lock table */
+#define ED_RLCK_WRITERS 64
+
+#define ED_RLCK_FREE 0
+#define ED_RLCK_BUSY 1
+#define ED_RLCK_SH   2
+#define ED_RLCK_EX   3
+#define ED_RLCK_XF   4
+
+/**
+ * @brief  Slab byte range entry in the lock table
+ */
+struct EdRlck {
+	uint64_t     start;            /**< Byte offset of the range */
+	uint64_t     len;              /**< Number of bytes in the range */
+	uint32_t     state;            /**< One of the ED_RLCK_* states */
+	uint32_t     conn;             /**< Connection index of the holder */
+};
+
+/**
+ * @brief  Shared slab locks held by a process connection
+ */
+struct EdRlckConn {
+	uint32_t     nheld;            /**< Number of entries in #readers in use */
+	uint32_t     nflck;            /**< Number of locks that fell back to fcntl */
+	EdRlck       readers[ED_RLCK_READERS];
+};
+
+/**
+ * @brief  Slab lock table stored after the connections in the index header
+ *
+ * Readers claim an entry in the slot for their own connection, so the common
+ * case touches no memory written by other processes. Writers publish their
+ * range in #writers and then scan every connection for overlapping readers.
+ * When #writers is full, a writer takes a file lock instead and records the
+ * range as #ED_RLCK_XF in the slot for its own connection.
+ */
+struct EdRlckTable {
+	uint32_t     nwriters;         /**< Number of entries in #writers in use */
+	uint32_t     nwflck;           /**< Number of exclusive locks that fell back to fcntl */
+	EdRlck       writers[ED_RLCK_WRITERS];
+	EdRlckConn   conns[1];         /**< Flexible array, one per connection */
 };
 
 
@@ -1168,7 +1508,7 @@ struct EdPgIdx {
 	uint64_t     seed;             /**< Randomized seed */
 	EdTimeUnix   epoch;            /**< Epoch adjustment in seconds */
 	uint64_t     flags;            /**< Permanent flags used when creating */
-	uint32_t     size_page;        /**< Saved system page size in bytes */
+	uint32_t     size_page;        /**< Saved index page size in bytes */
 	uint16_t     slab_block_size;  /**< Size of the blocks in the slab */
 	uint16_t     nconns;           /**< Number of process connection slots */
 	EdPgnoV      tail_start;       /**< Page number for the start of the tail pages */
@@ -1177,13 +1517,19 @@ struct EdPgIdx {
 	EdPgnoV      gc_tail;          /**< Page pointer for the garbage collector tail */
 	union {
 		uint64_t vtree;            /**< Atomic CAS value for the first 2 trees */
-		EdPgno   tree[4];          /**< Page pointer for the key and slab b+trees */
+		EdPgno   tree[4];          /**< Page pointer for the key, slab, and expiry b+trees */
 	};
 	EdTxnIdV     xid;              /**< Global transaction ID */
 	EdBlknoV     vno;              /**< Current slab write block */
 	EdBlkno      slab_block_count; /**< Number of blocks in the slab */
 	uint64_t     slab_ino;         /**< Inode number of the slab */
-	char         slab_path[912];   /**< Path to the slab */
+	EdTxnIdV     sync_xid;         /**< Most recent transaction ID synced to disk */
+	EdTxnIdV     xmin;             /**< Cached oldest transaction ID held by any connection */
+	uint64_t     xmin_gen;         /**< Incremented when #xmin may have advanced */
+	uint64_t     xmin_valid;       /**< Value of #xmin_gen when #xmin was computed */
+	EdTime       xmin_recover;     /**< Time of the last stale connection recovery */
+	uint32_t     nsnapshots;       /**< Number of transaction IDs held by all connections */
+	char         slab_path[872];   /**< Path to the slab */
 	EdPgnoV      nactive;          /**< Number of pages in #active */
 	EdPgno       active[255];      /**< Allocated pages in the active transaction */
 	EdConn       conns[1];         /**< Flexible array of active process connections */
@@ -1191,6 +1537,7 @@ struct EdPgIdx {
 
 #define ED_IDX_LCK_OPEN base
 #define ED_IDX_LCK_WRITE xid
+#define ED_IDX_LCK_SYNC sync_xid
 
 #define ED_IDX_LCK_OPEN_OFF offsetof(EdPgIdx, ED_IDX_LCK_OPEN)
 #define ED_IDX_LCK_OPEN_LEN sizeof(((EdPgIdx *)0)->ED_IDX_LCK_OPEN)
@@ -1198,6 +1545,9 @@ struct EdPgIdx {
 #define ED_IDX_LCK_WRITE_OFF offsetof(EdPgIdx, ED_IDX_LCK_WRITE)
 #define ED_IDX_LCK_WRITE_LEN sizeof(((EdPgIdx *)0)->ED_IDX_LCK_WRITE)
 
+#define ED_IDX_LCK_SYNC_OFF offsetof(EdPgIdx, ED_IDX_LCK_SYNC)
+#define ED_IDX_LCK_SYNC_LEN sizeof(((EdPgIdx *)0)->ED_IDX_LCK_SYNC)
+
 /**
  * @brief  On-disk value for an entry in the slab
  */
@@ -1240,8 +1590,18 @@ struct EdObjectHdr {
  * These values need to be acquired using the `ed_fetch64` to accomodate
  * unaligned reads.
  *
- * Leaf nodes use the data segment as an array of entries. Each entry *must*
- * start with a 64-bit key.
+ * Leaf nodes split the data segment into two parallel arrays. Each entry
+ * *must* start with a 64-bit key, and these keys are packed densely at the
+ * start of the segment so that searches only touch the key array. The rest of
+ * each entry is stored in a second array that begins after room for the
+ * maximum number of keys:
+ *
+ * +--------+--------+-----+----------+------------+-----+--------------+
+ * | Key[0] | Key[1] | ... | Key[M-1] | Rest[0]    | ... | Rest[M-1]    |
+ * +--------+--------+-----+----------+------------+-----+--------------+
+ *
+ * Entries yielded by the cursor are reassembled into a buffer in the
+ * #EdTxnDb, which remains valid until the next cursor call on that database.
  */
 struct EdBpt {
 	EdPg         base;             /**< Page number and type */
@@ -1249,7 +1609,7 @@ struct EdBpt {
 	EdPgno       next;             /**< Overflow leaf pointer */
 	uint16_t     nkeys;            /**< Number of keys in the node */
 	uint16_t     _pad;
-#define ED_BPT_DATA (PAGESIZE - sizeof(EdPg) - sizeof(EdTxnId) - sizeof(EdPgno) - 4)
+#define ED_BPT_DATA (ED_PG_SIZE - sizeof(EdPg) - sizeof(EdTxnId) - sizeof(EdPgno) - 4)
 	uint8_t      data[ED_BPT_DATA];/**< Tree-specific data for nodes (8-byte aligned) */
 };
 
@@ -1258,9 +1618,10 @@ struct EdBpt {
  */
 struct EdEntryBlock {
 	EdBlkno      no;               /**< Physical block number for the entry */
-	EdPgno       count;            /**< Number of blocks used by the entry */
+	EdPgno       count;            /**< Number of blocks used by the entry, which may wrap past the end of the slab */
 	uint32_t     _pad;
 	EdTxnId      xid;              /**< Transaction ID that created the entry */
+	uint64_t     hash;             /**< Hash of the key, used to find the key entry without reading the slab */
 };
 
 /**
@@ -1269,9 +1630,10 @@ struct EdEntryBlock {
  * @param  c  Number of blocks in the entry
  * @param  t  Total number of blocks in the slab
  * @param  x  Transaction ID
+ * @param  h  Hash value of the key
  */
-#define ed_entry_block_make(n, c, t, x) \
-	((EdEntryBlock){ ((n) % (t)), (c), 0, (x) })
+#define ed_entry_block_make(n, c, t, x, h) \
+	((EdEntryBlock){ ((n) % (t)), (c), 0, (x), (h) })
 
 /**
  * @brief  B+Tree value type for indexing the slab by key
@@ -1281,6 +1643,9 @@ struct EdEntryKey {
 	EdBlkno      vno;              /**< Virtual block number for the entry */
 	EdPgno       count;            /**< Number of blocks used by the entry */
 	EdTime       exp;              /**< Expiration of the entry */
+	uint32_t     tag;              /**< Fingerprint of the key from #ed_hash_tag() */
+	uint16_t     keylen;           /**< Length of the key */
+	uint16_t     _pad;
 };
 
 /**
@@ -1289,9 +1654,61 @@ struct EdEntryKey {
  * @param  n  Virtual block number
  * @param  c  Number of blocks in the entry
  * @param  e  Internal expiration time
+ * @param  t  Fingerprint of the key
+ * @param  l  Length of the key
+ */
+#define ed_entry_key_make(h, n, c, e, t, l) \
+	((EdEntryKey){ (h), (n), (c), (e), (t), (l), 0 })
+
+/**
+ * @brief  Checks if a key entry may hold a key
+ *
+ * Entries that fail this check cannot hold the key, so the slab need not be
+ * read to resolve the collision.
+ *
+ * @param  ent  Key entry
+ * @param  t  Fingerprint of the key
+ * @param  l  Length of the key
+ */
+#define ed_entry_key_match(ent, t, l) \
+	((ent)->tag == (t) && (ent)->keylen == (l))
+
+/**
+ * @brief  B+Tree value type for indexing keys by expiration
+ *
+ * The tree key places the expiration in the high bits so that entries are
+ * ordered by time. The low bits hold the virtual block number to keep keys
+ * unique for objects expiring in the same second.
+ */
+struct EdEntryExpiry {
+	uint64_t     key;              /**< Expiration and truncated virtual block number */
+	uint64_t     hash;             /**< Hash of the key */
+	EdBlkno      vno;              /**< Virtual block number for the entry */
+};
+
+/**
+ * @brief  Creates the tree key for an expiry entry
+ * @param  n  Virtual block number
+ * @param  e  Internal expiration time
+ */
+#define ed_entry_expiry_key(n, e) \
+	(((uint64_t)(e) << 32) | ((uint64_t)(n) & 0xffffffffULL))
+
+/**
+ * @brief  Creates a new entry expiry value
+ * @param  h  Hash value of the key
+ * @param  n  Virtual block number
+ * @param  e  Internal expiration time
+ */
+#define ed_entry_expiry_make(h, n, e) \
+	((EdEntryExpiry){ ed_entry_expiry_key(n, e), (h), (n) })
+
+/**
+ * @brief  Gets the internal expiration time of an expiry entry
+ * @param  ent  Expiry entry
  */
-#define ed_entry_key_make(h, n, c, e) \
-	((EdEntryKey){ (h), (n), (c), (e) })
+#define ed_entry_expiry_time(ent) \
+	((EdTime)((ent)->key >> 32))
 
 #pragma GCC diagnostic pop
 
@@ -22,7 +22,7 @@
 #define ED_FCREATE       UINT64_C(0x0000001000000000) /** Create a new index if missing. */
 #define ED_FALLOCATE     UINT64_C(0x0000002000000000) /** Allocate slab space when opening. */
 #define ED_FREPLACE      UINT64_C(0x0000004000000000) /** Replace an existing index. */
-#define ED_FREPAIR       UINT64_C(0x0000008000000000) /** Attempt to repair problems in the index (not yet supported). */
+#define ED_FREPAIR       UINT64_C(0x0000008000000000) /** Rebuild the index from a scan of the slab. */
 #define ED_FMLOCK        UINT64_C(0x0000010000000000) /** Hint for mlocking the index. */
 #define ED_FNOSYNC       UINT64_C(0x0000020000000000) /** Don't perform file syncing. */
 #define ED_FASYNC        UINT64_C(0x0000040000000000) /** Use asynchronous syncing. */
@@ -30,6 +30,10 @@
 #define ED_FNOBLOCK      UINT64_C(0x0000100000000000) /** May return EAGAIN for open or create. */
 #define ED_FRDONLY       UINT64_C(0x0000200000000000) /** The operation does not need to write. */
 #define ED_FNOVERIFY     UINT64_C(0x0000400000000000) /** Disable verifying checksums if they are enabled. */
+#define ED_FMAPINDEX     UINT64_C(0x0000800000000000) /** Map the index once into a reserved address range. */
+#define ED_FMAPSLAB      UINT64_C(0x0001000000000000) /** Map the whole slab once rather than per object. */
+#define ED_FGROUPSYNC    UINT64_C(0x0002000000000000) /** Share file syncs between concurrent commits. */
+#define ED_FDIRECT       UINT64_C(0x0004000000000000) /** Write new objects with O_DIRECT through staging buffers. */
 #define ED_FRESET        UINT64_C(0x8000000000000000) /** Reset the transaction when closing. */
 /** @} */
 
@@ -37,6 +41,7 @@
  * @{
  */
 #define ED_OID           (1<<0) /** Open using an object ID instead of key. */
+#define ED_ONOMAP        (1<<1) /** Read the object with ed_read() rather than mapping it. */
 /** @} */
 
 /** @brief  Seconds in UNIX time */
@@ -50,6 +55,7 @@ typedef struct EdCache EdCache;
 typedef struct EdObject EdObject;
 typedef struct EdObjectAttr EdObjectAttr;
 typedef struct EdList EdList;
+typedef struct EdBatch EdBatch;
 
 struct EdConfig {
 	const char * index_path;
@@ -59,6 +65,7 @@ struct EdConfig {
 	uint64_t     flags;
 	long long    slab_size;
 	uint16_t     slab_block_size;
+	unsigned     nshards;
 };
 
 struct EdObjectAttr {
@@ -86,11 +93,18 @@ ed_cache_ref(EdCache *cache);
 ED_EXPORT int
 ed_cache_stat(EdCache *cache, FILE *out, uint64_t flags);
 
+ED_EXPORT int
+ed_cache_purge_expired(EdCache *cache, size_t budget);
+
 
 
 ED_EXPORT int
 ed_open(EdCache *cache, EdObject **objp, const void *key, size_t len, int flags);
 
+ED_EXPORT int
+ed_open_many(EdCache *cache, EdObject **objs, const void *const *keys, const size_t *lens,
+		size_t n, int flags);
+
 ED_EXPORT int
 ed_create(EdCache *cache, EdObject **objp, const EdObjectAttr *attr);
 
@@ -106,6 +120,9 @@ ed_unlink(EdCache *cache, const void *key, size_t len);
 ED_EXPORT int64_t
 ed_write(EdObject *obj, const void *buf, size_t len);
 
+ED_EXPORT ssize_t
+ed_read(EdObject *obj, void *buf, size_t len, off_t off);
+
 ED_EXPORT ssize_t
 ed_splice(EdObject *obj, int s, size_t len);
 
@@ -124,6 +141,15 @@ ed_close(EdObject **objp);
 ED_EXPORT void
 ed_discard(EdObject **objp);
 
+ED_EXPORT int
+ed_batch_begin(EdCache *cache, EdBatch **batchp, const EdObjectAttr *attrs, size_t n);
+
+ED_EXPORT int
+ed_batch_create(EdBatch *batch, EdObject **objp);
+
+ED_EXPORT int
+ed_batch_commit(EdBatch **batchp);
+
 ED_EXPORT int
 ed_set_ttl(EdObject *obj, EdTimeTTL ttl);
 
@@ -240,6 +266,7 @@ ed_list_close(EdList **list);
 
 #define ED_ECONFIG_SLAB_NAME     ed_econfig(0) /** Error code for an invalid slab path. */
 #define ED_ECONFIG_INDEX_NAME    ed_econfig(1) /** Error code for an invalid index path. */
+#define ED_ECONFIG_SHARDS        ed_econfig(2) /** Error code for an unsupported shard count. */
 
 #define ED_EINDEX_MODE           ed_eindex(0)  /** Error code when the index file mode is invalid. */
 #define ED_EINDEX_SIZE           ed_eindex(1)  /** Error code when the index size requested is invalid. */
@@ -265,6 +292,7 @@ ed_list_close(EdList **list);
 #define ED_ESLAB_BLOCK_SIZE      ed_eslab(2)   /** Error code when the slab sector size is not supported. */
 #define ED_ESLAB_BLOCK_COUNT     ed_eslab(3)   /** Error code when the slab block count changed. */
 #define ED_ESLAB_INODE           ed_eslab(4)   /** Error code when the slab inode changed. */
+#define ED_ESLAB_FULL            ed_eslab(5)   /** Error code when a reservation can never fit in the slab. */
 
 #define ED_EKEY_LENGTH           ed_ekey(0)    /** Error code when the key is too long. */
 
@@ -274,6 +302,7 @@ ed_list_close(EdList **list);
 #define ED_EOBJECT_ID            ed_eobject(3) /** Error code for invalid object ids */
 #define ED_EOBJECT_METACRC       ed_eobject(4) /** Error code when meta data crc doesn't match */
 #define ED_EOBJECT_DATACRC       ed_eobject(5) /** Error code when body data crc doesn't match */
+#define ED_EOBJECT_WRONLY        ed_eobject(6) /** Error code when attempting to send an object that is being written */
 
 #define ED_EMIME_FILE            ed_emime(0)   /** Error code when the mime.cache file can't be loaded. */
 
@@ -3,6 +3,7 @@
 static const char *const econfig[] = {
 	[ed_ecode(ED_ECONFIG_SLAB_NAME)]    = "slab name is too long",
 	[ed_ecode(ED_ECONFIG_INDEX_NAME)]    = "index name is too long",
+	[ed_ecode(ED_ECONFIG_SHARDS)]        = "shard count is not supported",
 };
 
 static const char *const eindex[] = {
@@ -36,6 +37,7 @@ static const char *const eslab[] = {
 	[ed_ecode(ED_ESLAB_BLOCK_SIZE)]      = "slab file block/sector size is not supported",
 	[ed_ecode(ED_ESLAB_BLOCK_COUNT)]     = "slab file block/sector count has changed",
 	[ed_ecode(ED_ESLAB_INODE)]           = "slab inode reference invalid",
+	[ed_ecode(ED_ESLAB_FULL)]            = "reservation exceeds the slab size",
 };
 
 static const char *const eobject[] = {
@@ -45,6 +47,7 @@ static const char *const eobject[] = {
 	[ed_ecode(ED_EOBJECT_ID)]            = "object id is invalid",
 	[ed_ecode(ED_EOBJECT_METACRC)]       = "object meta-data CRC32c doesn't match",
 	[ed_ecode(ED_EOBJECT_DATACRC)]       = "object data CRC32c doesn't match",
+	[ed_ecode(ED_EOBJECT_WRONLY)]        = "object is write-only",
 };
 
 static const char *const emime[] = {
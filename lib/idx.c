@@ -1,15 +1,19 @@
 #include "eddy-private.h"
 
-_Static_assert(sizeof(EdPgIdx) <= PAGESIZE,
+_Static_assert(ED_PG_SIZE % PAGESIZE == 0,
+		"ED_PG_SIZE must be a multiple of PAGESIZE");
+_Static_assert(sizeof(EdPgIdx) <= ED_PG_SIZE,
 		"EdPgIdx too big");
 _Static_assert(offsetof(EdPgIdx, tree) % 16 == 0,
 		"EdPgIdx tree member is not 16-bytes aligned");
-_Static_assert(sizeof(EdBpt) + ED_ENTRY_BLOCK_COUNT*sizeof(EdEntryBlock) <= PAGESIZE,
+_Static_assert(sizeof(EdBpt) + ED_ENTRY_BLOCK_COUNT*sizeof(EdEntryBlock) <= ED_PG_SIZE,
 		"ED_PAGE_BLOCK_COUNT is too high");
-_Static_assert(sizeof(EdBpt) + ED_ENTRY_KEY_COUNT*sizeof(EdEntryKey) <= PAGESIZE,
+_Static_assert(sizeof(EdBpt) + ED_ENTRY_KEY_COUNT*sizeof(EdEntryKey) <= ED_PG_SIZE,
 		"ED_ENTRY_KEY_COUNT is too high");
+_Static_assert(sizeof(EdBpt) + ED_ENTRY_EXPIRY_COUNT*sizeof(EdEntryExpiry) <= ED_PG_SIZE,
+		"ED_ENTRY_EXPIRY_COUNT is too high");
 
-#define PG_ROOT_GC 1
+#define PG_ROOT_GC(nconns) ED_IDX_PAGES(nconns)
 #define PG_NEXTRA 1
 #define PG_NINIT(nconns) (ED_IDX_PAGES(nconns) + PG_NEXTRA)
 
@@ -27,10 +31,11 @@ static const EdPgIdx INDEX_DEFAULT = {
 # error Unkown byte order
 #endif
 	.mark = 0xfc,
-	.version = 2,
-	.size_page = PAGESIZE,
+	.version = 12,
+	.size_page = ED_PG_SIZE,
 	.slab_block_size = PAGESIZE,
 	.nconns = 32,
+	.xmin_gen = 1,
 	.xid = 1,
 	.gc_head = ED_PG_NONE,
 	.gc_tail = ED_PG_NONE,
@@ -165,6 +170,85 @@ slab_init(int fd, const EdConfig *cfg, const struct stat *s)
 #define OPEN(path, f, ifset) \
 	open(path, (O_CLOEXEC|O_RDWR | (((f) & (ifset)) ? O_CREAT : 0)), 0600)
 
+/**
+ * @brief  Releases every slab lock table entry held by a connection
+ * @param  tbl  Slab lock table in the header pages
+ * @param  conn  Connection index
+ */
+static void
+rlck_clear(EdRlckTable *tbl, uint32_t conn)
+{
+	EdRlckConn *c = &tbl->conns[conn];
+	for (int i = 0; i < ED_RLCK_READERS; i++) {
+		if (__atomic_exchange_n(&c->readers[i].state, ED_RLCK_FREE,
+					__ATOMIC_ACQ_REL) == ED_RLCK_XF) {
+			__atomic_sub_fetch(&tbl->nwflck, 1, __ATOMIC_SEQ_CST);
+		}
+	}
+	__atomic_store_n(&c->nheld, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&c->nflck, 0, __ATOMIC_RELEASE);
+
+	for (int i = 0; i < ED_RLCK_WRITERS; i++) {
+		EdRlck *w = &tbl->writers[i];
+		uint32_t state = ED_RLCK_EX;
+		if (w->conn == conn && __atomic_compare_exchange_n(&w->state, &state, ED_RLCK_FREE,
+					false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__atomic_sub_fetch(&tbl->nwriters, 1, __ATOMIC_SEQ_CST);
+		}
+	}
+}
+
+/**
+ * @brief  Counts the transaction ids held by a connection
+ * @param  c  Connection object
+ * @param  xmin  Lowered to the oldest transaction id held
+ * @return  Number of transaction ids held
+ */
+static uint32_t
+conn_snapshots(const EdConn *c, EdTxnId *xmin)
+{
+	uint32_t n = 0;
+	EdTxnId xid = c->xid;
+	if (xid > 0) {
+		n++;
+		if (xid < *xmin) { *xmin = xid; }
+	}
+	uint32_t mask = __atomic_load_n(&c->rmask, __ATOMIC_ACQUIRE);
+	while (mask) {
+		int i = __builtin_ctz(mask);
+		mask &= mask - 1;
+		xid = c->readers[i];
+		if (xid > 0) {
+			n++;
+			if (xid < *xmin) { *xmin = xid; }
+		}
+	}
+	return n;
+}
+
+/**
+ * @brief  Drops every transaction id held by a connection
+ *
+ * This is only used for connections that are closing or whose process has
+ * exited, so nothing races with the slots being cleared.
+ *
+ * @param  hdr  Memmory mapped index header
+ * @param  c  Connection object
+ */
+static void
+conn_clear_snapshots(EdPgIdx *hdr, EdConn *c)
+{
+	EdTxnId xmin = UINT64_MAX;
+	uint32_t n = conn_snapshots(c, &xmin);
+	c->xid = 0;
+	c->rmask = 0;
+	memset((void *)c->readers, 0, sizeof(c->readers));
+	if (n > 0) {
+		__atomic_sub_fetch(&hdr->nsnapshots, n, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&hdr->xmin_gen, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
 /**
  * @brief  Locks the next available process connection slot
  *
@@ -175,6 +259,7 @@ slab_init(int fd, const EdConfig *cfg, const struct stat *s)
  * closed slot.
  *
  * @param  hdr  Memmory mapped index header
+ * @param  tbl  Slab lock table in the header pages
  * @param  connp  Target connection reference
  * @param  fd  An open file descriptor to the file containing #hdr
  * @param  xmin  Attempt lock recovery if holding a transaction id less than this id
@@ -182,7 +267,7 @@ slab_init(int fd, const EdConfig *cfg, const struct stat *s)
  * @return 0 on success, <0 on error
  */
 static int
-conn_acquire(EdPgIdx *hdr, EdConn **connp, int fd, EdTxnId xmin, int pid)
+conn_acquire(EdPgIdx *hdr, EdRlckTable *tbl, EdConn **connp, int fd, EdTxnId xmin, int pid)
 {
 	int nconns = (int)hdr->nconns;
 	int rc = ed_esys(EAGAIN);
@@ -195,8 +280,10 @@ conn_acquire(EdPgIdx *hdr, EdConn **connp, int fd, EdTxnId xmin, int pid)
 					offsetof(EdPgIdx, conns) + i*sizeof(*hdr->conns), sizeof(*hdr->conns),
 					ED_FNOBLOCK);
 			if (rc == 0) {
+				// Any slab locks left in the table belong to a dead process.
+				rlck_clear(tbl, (uint32_t)i);
+				conn_clear_snapshots(hdr, c);
 				c->pid = pid;
-				c->xid = 0;
 				*connp = c;
 				return 0;
 			}
@@ -212,18 +299,21 @@ conn_acquire(EdPgIdx *hdr, EdConn **connp, int fd, EdTxnId xmin, int pid)
 /**
  * @brief  Unmarks and unlocks the process connection
  * @param  hdr  Memmory mapped index header
+ * @param  tbl  Slab lock table in the header pages
  * @param  connp  Current connection reference
  * @param  fd  An open file descriptor to the file containing #hdr
  */
 static void
-conn_release(EdPgIdx *hdr, EdConn **connp, int fd)
+conn_release(EdPgIdx *hdr, EdRlckTable *tbl, EdConn **connp, int fd)
 {
 	EdConn *conn = *connp;
 	if (conn == NULL) { return; }
 	*connp = NULL;
+	// Like file locks, slab locks do not outlive the connection.
+	rlck_clear(tbl, (uint32_t)(conn - hdr->conns));
+	conn_clear_snapshots(hdr, conn);
 	conn->pid = 0;
 	conn->active = 0;
-	conn->xid = 0;
 	assert(conn->npending <= ed_len(conn->pending));
 	ed_flck(fd, ED_LCK_UN, (uint8_t *)conn - (uint8_t *)hdr, sizeof(*conn), ED_FNOBLOCK);
 }
@@ -235,6 +325,7 @@ ed_idx_clear(EdIdx *idx)
 	idx->path = NULL;
 	idx->fd = -1;
 	idx->slabfd = -1;
+	idx->slabdfd = -1;
 	idx->gc_head = NULL;
 	idx->gc_tail = NULL;
 	idx->flags = 0;
@@ -250,6 +341,7 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 {
 	ed_idx_clear(idx);
 	ed_lck_init(&idx->lck, ED_IDX_LCK_WRITE_OFF, ED_IDX_LCK_WRITE_LEN);
+	ed_lck_init(&idx->sync, ED_IDX_LCK_SYNC_OFF, ED_IDX_LCK_SYNC_LEN);
 
 	EdPgIdx *hdr = MAP_FAILED, hdrnew = INDEX_DEFAULT;
 	struct stat stat;
@@ -273,8 +365,8 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 	}
 	hdrnew.epoch = ed_now_unix();
 	hdrnew.flags = ed_fsave(flags);
-	hdrnew.gc_head = PG_ROOT_GC;
-	hdrnew.gc_tail = PG_ROOT_GC;
+	hdrnew.gc_head = PG_ROOT_GC(nconns);
+	hdrnew.gc_tail = PG_ROOT_GC(nconns);
 	hdrnew.tail_start = PG_NINIT(nconns);
 	hdrnew.tail_count = ED_ALLOC_COUNT;
 	if (cfg->slab_block_size > 0) {
@@ -303,7 +395,7 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 	idx->hdr = hdr = ed_pg_map(fd, 0, PG_NINIT(nconns), false);
 	if (hdr == MAP_FAILED) { rc = ED_ERRNO; goto error; }
 
-	EdPgGc *gc = (EdPgGc *)((uint8_t *)hdr + PG_ROOT_GC*PAGESIZE);
+	EdPgGc *gc = (EdPgGc *)((uint8_t *)hdr + PG_ROOT_GC(nconns)*ED_PG_SIZE);
 	idx->gc_head = idx->gc_tail = gc;
 
 	rc = ed_flck(fd, ED_LCK_EX, ED_IDX_LCK_OPEN_OFF, ED_IDX_LCK_OPEN_LEN, cfg->flags);
@@ -329,7 +421,21 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 
 			if (!(flags & ED_FREPLACE)) {
 				rc = hdr_verify_slab(hdr, slab_size, stat.st_ino);
-				break;
+				if (rc < 0 || !(flags & ED_FREPAIR)) { break; }
+
+				// Repairing reinitializes the index pages, but the identity of the
+				// slab contents must carry over: the seed for the key hashes, the
+				// epoch for the expiry times, and the transaction and block
+				// positions that objects were written under. The trees are then
+				// rebuilt from a scan of the slab.
+				hdrnew.seed = hdr->seed;
+				hdrnew.epoch = hdr->epoch;
+				hdrnew.flags = hdr->flags;
+				hdrnew.slab_block_size = hdr->slab_block_size;
+				hdrnew.xid = hdr->xid;
+				hdrnew.vno = hdr->vno;
+				hdrnew.sync_xid = hdr->xid;
+				memcpy(hdrnew.slab_path, hdr->slab_path, sizeof(hdrnew.slab_path));
 			}
 
 			hdrnew.slab_block_count = (EdBlkno)(slab_size/hdrnew.slab_block_size);
@@ -340,15 +446,15 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 				break;
 			}
 
-			size_t size = PG_NINIT(nconns) * PAGESIZE;
-			rc = allocate_file(flags, fd, size + (ED_ALLOC_COUNT * PAGESIZE), "index");
+			size_t size = PG_NINIT(nconns) * ED_PG_SIZE;
+			rc = allocate_file(flags, fd, size + (ED_ALLOC_COUNT * ED_PG_SIZE), "index");
 			if (rc < 0) { break; }
 
 			memcpy(hdr, &hdrnew, sizeof(hdrnew));
 			for (uint16_t i = 0; i < nconns; i++) {
 				memcpy(&hdr->conns[i], &CONN_DEFAULT, sizeof(CONN_DEFAULT));
 			}
-			gc->base.no = PG_ROOT_GC;
+			gc->base.no = PG_ROOT_GC(nconns);
 			gc->base.type = ED_PG_GC;
 			gc->next = ED_PG_NONE;
 
@@ -359,13 +465,41 @@ ed_idx_open(EdIdx *idx, const EdConfig *cfg)
 
 		if (rc >= 0) {
 			EdTxnId xmin = hdr->xid > 16 ? hdr->xid - 16 : 0;
-			rc = conn_acquire(hdr, &idx->conn, fd, xmin, pid);
+			rc = conn_acquire(hdr, ed_idx_rlck(idx), &idx->conn, fd, xmin, pid);
 		}
 
 		ed_flck(fd, ED_LCK_UN, ED_IDX_LCK_OPEN_OFF, ED_IDX_LCK_OPEN_LEN, cfg->flags);
 	}
 	if (rc < 0) { goto error; }
 
+	// Failing to reserve the index or slab mappings is not fatal. Pages will be
+	// mapped individually instead, and the flag is cleared to reflect that.
+	if ((flags & ED_FMAPINDEX) && (fstat(fd, &stat) < 0 ||
+				ed_pg_reserve(fd, ED_IDX_MAP_SIZE, (size_t)stat.st_size) < 0)) {
+		flags &= ~ED_FMAPINDEX;
+	}
+	if (flags & ED_FMAPSLAB) {
+		uint64_t slab_size = hdr->slab_block_count * hdr->slab_block_size;
+		if (slab_size > ED_SLAB_MAP_MAX ||
+				ed_pg_reserve(sfd, (size_t)slab_size, (size_t)slab_size) < 0) {
+			flags &= ~ED_FMAPSLAB;
+		}
+	}
+
+	// Direct writes require block positions that satisfy the O_DIRECT alignment
+	// rules. Without them, or if the file system refuses O_DIRECT, objects are
+	// written through the mapping as usual.
+	if (flags & ED_FDIRECT) {
+#ifdef O_DIRECT
+		if (hdr->slab_block_size % PAGESIZE != 0 ||
+				(idx->slabdfd = open(hdr->slab_path, O_CLOEXEC|O_RDWR|O_DIRECT)) < 0) {
+			flags &= ~ED_FDIRECT;
+		}
+#else
+		flags &= ~ED_FDIRECT;
+#endif
+	}
+
 	idx->flags = ed_idx_flags(hdr->flags | ed_fopen(flags));
 	idx->pid = pid;
 	idx->path = strdup(index_path);
@@ -388,10 +522,7 @@ ed_idx_close(EdIdx *idx)
 
 	if (idx == NULL) { return; }
 	if (idx->pid == getpid()) {
-		conn_release(idx->hdr, &idx->conn, idx->fd);
-		if (idx->fd > -1) { close(idx->fd); }
-		if (idx->slabfd > -1) { close(idx->slabfd); }
-		ed_lck_final(&idx->lck);
+		conn_release(idx->hdr, ed_idx_rlck(idx), &idx->conn, idx->fd);
 	}
 	if (idx->gc_tail && idx->gc_tail != MAP_FAILED && idx->gc_tail != idx->gc_head) {
 		ed_pg_unmap(idx->gc_tail, 1);
@@ -399,6 +530,22 @@ ed_idx_close(EdIdx *idx)
 	if (idx->gc_head && idx->gc_head != MAP_FAILED) {
 		ed_pg_unmap(idx->gc_head, 1);
 	}
+	if (idx->fd > -1) {
+		ed_pg_release(idx->fd);
+	}
+	if (idx->slabfd > -1) {
+		ed_pg_release(idx->slabfd);
+	}
+	// A forked child shares the open file descriptions of the parent. Closing
+	// its copies leaves the locks of the parent in place, but keeping them open
+	// would hold the parent connection lock after the parent exits.
+	if (idx->fd > -1) { close(idx->fd); }
+	if (idx->slabfd > -1) { close(idx->slabfd); }
+	if (idx->slabdfd > -1) { close(idx->slabdfd); }
+	if (idx->pid == getpid()) {
+		ed_lck_final(&idx->lck);
+		ed_lck_final(&idx->sync);
+	}
 	if (idx->hdr && idx->hdr != MAP_FAILED) {
 		ed_pg_unmap(idx->hdr, ED_IDX_PAGES(idx->nconns));
 	}
@@ -406,32 +553,70 @@ ed_idx_close(EdIdx *idx)
 	ed_idx_clear(idx);
 }
 
+/**
+ * @brief  Gets the oldest transaction id that may still be read
+ *
+ * Every acquired transaction id is counted in the header, so when the current
+ * connection holds all of them no other connection needs to be scanned.
+ * Otherwise the oldest id of all connections is cached in the header. New ids
+ * are never older than the transaction id at the time of the scan, so commits
+ * do not invalidate the cache. Only releasing an id at or below the cached
+ * value, or dropping the ids of a connection, does. Scanning for stale
+ * connections costs a file lock per suspect slot, so it is only attempted once
+ * every #ED_IDX_RECOVER_INTERVAL, which also refreshes the cache.
+ */
 EdTxnId
 ed_idx_xmin(EdIdx *idx, EdTime now)
 {
+	EdPgIdx *hdr = idx->hdr;
+	EdConn *c = hdr->conns, *conn = idx->conn;
+	const EdTxnId hxid = hdr->xid;
+	EdTxnId xid = hxid - 1;
+
+	// Ids are counted before they are stored, so counting the slots of this
+	// connection first can only overestimate the ids held elsewhere.
+	uint32_t nown = conn_snapshots(conn, &xid);
+	if (__atomic_load_n(&hdr->nsnapshots, __ATOMIC_SEQ_CST) <= nown) {
+		return xid;
+	}
+
 	if (now == 0) {
 		now = ed_time_from_unix(idx->epoch, ed_now_unix());
 	}
 
-	EdTxnId xid = idx->hdr->xid - 1;
-	EdTxnId xmin = xid > 16 ? xid - 16 : 0;
+	bool recover = now < hdr->xmin_recover || now - hdr->xmin_recover >= ED_IDX_RECOVER_INTERVAL;
+	uint64_t gen = __atomic_load_n(&hdr->xmin_gen, __ATOMIC_ACQUIRE);
+	if (!recover && __atomic_load_n(&hdr->xmin_valid, __ATOMIC_ACQUIRE) == gen) {
+		EdTxnId cached = hdr->xmin;
+		return cached < xid ? cached : xid;
+	}
+	if (recover) { hdr->xmin_recover = now; }
+
+	EdTxnId xmin = hxid > 17 ? hxid - 17 : 0;
 	EdTime tmin = now - 10;
-	EdConn *c = idx->hdr->conns, *conn = idx->conn;
+	EdTxnId min = hxid;
 	int nconns = idx->nconns;
 
 	for (int i = 0; i < nconns; i++, c++) {
-		if (c->pid == 0 || c->xid == 0) { continue; }
-		if (c != conn && (c->xid < xmin || (tmin > 0 && c->active > 0 && tmin < c->active))) {
+		if (c->pid == 0) { continue; }
+		EdTxnId cxid = UINT64_MAX;
+		if (conn_snapshots(c, &cxid) == 0) { continue; }
+		if (recover && c != conn &&
+				(cxid < xmin || (tmin > 0 && c->active > 0 && tmin < c->active))) {
 			off_t pos = offsetof(EdPgIdx, conns) + i*sizeof(*c);
 			if (ed_flck(idx->fd, ED_LCK_EX, pos, sizeof(*c), ED_FNOBLOCK) == 0) {
+				conn_clear_snapshots(hdr, c);
 				memset(c, 0, sizeof(*c));
 				ed_flck(idx->fd, ED_LCK_UN, pos, sizeof(*c), ED_FNOBLOCK);
 				continue;
 			}
 		}
-		if (c->xid < xid) { xid = c->xid; }
+		if (cxid < min) { min = cxid; }
 	}
-	return xid;
+
+	hdr->xmin = min;
+	__atomic_store_n(&hdr->xmin_valid, gen, __ATOMIC_RELEASE);
+	return min < xid ? min : xid;
 }
 
 int
@@ -441,32 +626,407 @@ ed_idx_lock(EdIdx *idx, EdLckType type)
 	return ed_lck(&idx->lck, idx->fd, type, idx->flags);
 }
 
+#define rlck_overlap(e, s, l) ((e)->start < (s) + (l) && (s) < (e)->start + (e)->len)
+
+/**
+ * @brief  Checks if the process holding a connection has exited
+ *
+ * The connection lock is held for as long as the process is alive. If it can
+ * be taken, the table entries for the connection are stale and are cleared.
+ *
+ * @param  idx  Index object
+ * @param  conn  Connection index
+ * @return  true if the connection is not held
+ */
+static bool
+rlck_conn_dead(EdIdx *idx, uint32_t conn)
+{
+	if (idx->conn == &idx->hdr->conns[conn]) { return false; }
+	off_t pos = offsetof(EdPgIdx, conns) + conn*sizeof(EdConn);
+	if (ed_flck(idx->fd, ED_LCK_EX, pos, sizeof(EdConn), ED_FNOBLOCK) < 0) {
+		return false;
+	}
+	rlck_clear(ed_idx_rlck(idx), conn);
+	ed_flck(idx->fd, ED_LCK_UN, pos, sizeof(EdConn), ED_FNOBLOCK);
+	return true;
+}
+
+/**
+ * @brief  Checks for a published exclusive lock overlapping a range
+ *
+ * Exclusive locks that fell back to file locks are only checked for the
+ * current connection, as a file lock does not exclude other locks on the same
+ * descriptor. Use #rlck_has_flck() for those held by other connections.
+ *
+ * @param  idx  Index object
+ * @param  skip  Writer entry to ignore or NULL
+ * @param  start  Byte offset in the slab
+ * @param  len  Number of bytes
+ * @return  true if the range conflicts with a live writer
+ */
+static bool
+rlck_has_writer(EdIdx *idx, const EdRlck *skip, uint64_t start, uint64_t len)
+{
+	EdRlckTable *tbl = ed_idx_rlck(idx);
+	if (__atomic_load_n(&tbl->nwriters, __ATOMIC_SEQ_CST) > 0) {
+		for (int i = 0; i < ED_RLCK_WRITERS; i++) {
+			EdRlck *w = &tbl->writers[i];
+			if (w == skip || __atomic_load_n(&w->state, __ATOMIC_SEQ_CST) != ED_RLCK_EX) {
+				continue;
+			}
+			if (rlck_overlap(w, start, len) && !rlck_conn_dead(idx, w->conn)) {
+				return true;
+			}
+		}
+	}
+	if (__atomic_load_n(&tbl->nwflck, __ATOMIC_SEQ_CST) > 0) {
+		EdRlckConn *c = &tbl->conns[idx->conn - idx->hdr->conns];
+		for (int i = 0; i < ED_RLCK_READERS; i++) {
+			EdRlck *w = &c->readers[i];
+			if (w != skip && __atomic_load_n(&w->state, __ATOMIC_SEQ_CST) == ED_RLCK_XF &&
+					rlck_overlap(w, start, len)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief  Checks for an exclusive file lock held by another connection
+ *
+ * This only tests the file lock when some writer has fallen back to one.
+ *
+ * @param  idx  Index object
+ * @param  start  Byte offset in the slab
+ * @param  len  Number of bytes
+ * @return  true if the range conflicts with a file lock
+ */
+static bool
+rlck_has_flck(EdIdx *idx, uint64_t start, uint64_t len)
+{
+	EdRlckTable *tbl = ed_idx_rlck(idx);
+	return __atomic_load_n(&tbl->nwflck, __ATOMIC_SEQ_CST) > 0 &&
+		ed_flck_test(idx->slabfd, ED_LCK_SH, (off_t)start, (off_t)len) < 0;
+}
+
+/**
+ * @brief  Checks for a published shared lock overlapping a range
+ * @param  idx  Index object
+ * @param  start  Byte offset in the slab
+ * @param  len  Number of bytes
+ * @param  flck  Set if any connection has fallen back to fcntl locks
+ * @return  true if the range conflicts with a live reader
+ */
+static bool
+rlck_has_reader(EdIdx *idx, uint64_t start, uint64_t len, bool *flck)
+{
+	EdRlckTable *tbl = ed_idx_rlck(idx);
+	EdConn *conn = idx->hdr->conns;
+	for (int i = 0; i < idx->nconns; i++, conn++) {
+		if (conn->pid == 0) { continue; }
+		EdRlckConn *c = &tbl->conns[i];
+		if (__atomic_load_n(&c->nflck, __ATOMIC_SEQ_CST) > 0) { *flck = true; }
+		if (__atomic_load_n(&c->nheld, __ATOMIC_SEQ_CST) == 0) { continue; }
+		for (int j = 0; j < ED_RLCK_READERS; j++) {
+			EdRlck *r = &c->readers[j];
+			if (__atomic_load_n(&r->state, __ATOMIC_SEQ_CST) != ED_RLCK_SH ||
+					!rlck_overlap(r, start, len)) {
+				continue;
+			}
+			if (rlck_conn_dead(idx, (uint32_t)i)) { break; }
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief  Claims a free entry by moving it into the busy state
+ * @param  ents  Array of entries
+ * @param  n  Number of entries in #ents
+ * @return  Claimed entry or NULL if all are in use
+ */
+static EdRlck *
+rlck_claim(EdRlck *ents, int n)
+{
+	for (int i = 0; i < n; i++) {
+		uint32_t state = ED_RLCK_FREE;
+		if (__atomic_load_n(&ents[i].state, __ATOMIC_RELAXED) == ED_RLCK_FREE &&
+				__atomic_compare_exchange_n(&ents[i].state, &state, ED_RLCK_BUSY,
+					false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return &ents[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief  Releases the first entry in a given state that matches a range
+ * @param  ents  Array of entries
+ * @param  n  Number of entries in #ents
+ * @param  state  Expected state of the entry
+ * @param  start  Byte offset of the range
+ * @param  len  Number of bytes in the range
+ * @param  conn  Connection index of the holder
+ * @return  Released entry or NULL if not found
+ */
+static EdRlck *
+rlck_release(EdRlck *ents, int n, uint32_t state, uint64_t start, uint64_t len, uint32_t conn)
+{
+	for (int i = 0; i < n; i++) {
+		EdRlck *e = &ents[i];
+		uint32_t expect = state;
+		if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) == state &&
+				e->start == start && e->len == len && e->conn == conn &&
+				__atomic_compare_exchange_n(&e->state, &expect, ED_RLCK_FREE,
+					false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief  Publishes a shared lock in the entries for the connection
+ *
+ * When every entry is in use, the lock falls back to a file lock.
+ */
+static int
+rlck_lock_sh(EdIdx *idx, uint32_t conn, uint64_t start, uint64_t len, uint64_t flags)
+{
+	EdRlckConn *c = &ed_idx_rlck(idx)->conns[conn];
+	EdRlck *e = rlck_claim(c->readers, ED_RLCK_READERS);
+	if (e == NULL) {
+		// Every entry is in use, so fall back to a file lock. Writers see the
+		// count and take a file lock as well.
+		__atomic_add_fetch(&c->nflck, 1, __ATOMIC_SEQ_CST);
+		int rc = ed_flck(idx->slabfd, ED_LCK_SH, (off_t)start, (off_t)len, flags);
+		if (rc == 0 && rlck_has_writer(idx, NULL, start, len)) {
+			ed_flck(idx->slabfd, ED_LCK_UN, (off_t)start, (off_t)len, flags);
+			rc = ed_esys(EAGAIN);
+		}
+		if (rc < 0) {
+			__atomic_sub_fetch(&c->nflck, 1, __ATOMIC_SEQ_CST);
+		}
+		return rc;
+	}
+
+	e->start = start;
+	e->len = len;
+	e->conn = conn;
+	__atomic_add_fetch(&c->nheld, 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&e->state, ED_RLCK_SH, __ATOMIC_SEQ_CST);
+
+	// Publishing before checking for writers means that either this check sees
+	// the writer or the writer sees this entry.
+	if (rlck_has_writer(idx, NULL, start, len) || rlck_has_flck(idx, start, len)) {
+		__atomic_store_n(&e->state, ED_RLCK_FREE, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&c->nheld, 1, __ATOMIC_SEQ_CST);
+		return ed_esys(EAGAIN);
+	}
+	return 0;
+}
+
+/**
+ * @brief  Takes an exclusive file lock when every writer entry is in use
+ *
+ * The range is recorded in an entry for the connection, so that unlocking can
+ * tell it from a shared file lock, and so that other locks taken through this
+ * connection see it. Readers test the file lock while any such entry exists.
+ */
+static int
+rlck_lock_xf(EdIdx *idx, uint32_t conn, uint64_t start, uint64_t len, uint64_t flags)
+{
+	EdRlckTable *tbl = ed_idx_rlck(idx);
+	EdRlck *e = rlck_claim(tbl->conns[conn].readers, ED_RLCK_READERS);
+	if (e == NULL) { return ed_esys(ENOLCK); }
+
+	e->start = start;
+	e->len = len;
+	e->conn = conn;
+	__atomic_add_fetch(&tbl->nwflck, 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&e->state, ED_RLCK_XF, __ATOMIC_SEQ_CST);
+
+	bool flck = false;
+	int rc = ed_flck(idx->slabfd, ED_LCK_EX, (off_t)start, (off_t)len, flags);
+	if (rc == 0 && (rlck_has_writer(idx, e, start, len) ||
+				rlck_has_reader(idx, start, len, &flck))) {
+		ed_flck(idx->slabfd, ED_LCK_UN, (off_t)start, (off_t)len, flags);
+		rc = ed_esys(EAGAIN);
+	}
+	if (rc < 0) {
+		__atomic_store_n(&e->state, ED_RLCK_FREE, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&tbl->nwflck, 1, __ATOMIC_SEQ_CST);
+	}
+	return rc;
+}
+
+/**
+ * @brief  Publishes an exclusive lock and checks for overlapping holders
+ *
+ * File locks are only taken when some connection has readers or writers that
+ * fell back to file locks.
+ */
+static int
+rlck_lock_ex(EdIdx *idx, uint32_t conn, uint64_t start, uint64_t len, uint64_t flags)
+{
+	EdRlckTable *tbl = ed_idx_rlck(idx);
+	EdRlck *e = rlck_claim(tbl->writers, ED_RLCK_WRITERS);
+	if (e == NULL) { return rlck_lock_xf(idx, conn, start, len, flags); }
+
+	e->start = start;
+	e->len = len;
+	e->conn = conn;
+	__atomic_add_fetch(&tbl->nwriters, 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&e->state, ED_RLCK_EX, __ATOMIC_SEQ_CST);
+
+	bool flck = false;
+	int rc = 0;
+	if (rlck_has_writer(idx, e, start, len) || rlck_has_reader(idx, start, len, &flck)) {
+		rc = ed_esys(EAGAIN);
+	}
+	else if (flck || __atomic_load_n(&tbl->nwflck, __ATOMIC_SEQ_CST) > 0) {
+		rc = ed_flck(idx->slabfd, ED_LCK_EX, (off_t)start, (off_t)len, flags);
+	}
+	if (rc < 0) {
+		__atomic_store_n(&e->state, ED_RLCK_FREE, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&tbl->nwriters, 1, __ATOMIC_SEQ_CST);
+	}
+	return rc;
+}
+
+int
+ed_idx_slab_lck(EdIdx *idx, EdLckType type, off_t start, off_t len, uint64_t flags)
+{
+	ed_idx_assert(idx);
+	EdRlckTable *tbl = ed_idx_rlck(idx);
+	const uint32_t conn = (uint32_t)(idx->conn - idx->hdr->conns);
+	const uint64_t s = (uint64_t)start, l = (uint64_t)len;
+
+	switch (type) {
+	case ED_LCK_SH: return rlck_lock_sh(idx, conn, s, l, flags);
+	case ED_LCK_EX: return rlck_lock_ex(idx, conn, s, l, flags);
+	case ED_LCK_UN: break;
+	}
+
+	EdRlckConn *c = &tbl->conns[conn];
+	if (rlck_release(c->readers, ED_RLCK_READERS, ED_RLCK_SH, s, l, conn) != NULL) {
+		__atomic_sub_fetch(&c->nheld, 1, __ATOMIC_SEQ_CST);
+		return 0;
+	}
+	if (rlck_release(tbl->writers, ED_RLCK_WRITERS, ED_RLCK_EX, s, l, conn) != NULL) {
+		__atomic_sub_fetch(&tbl->nwriters, 1, __ATOMIC_SEQ_CST);
+		// The writer may have taken a file lock too, and unlocking is harmless
+		// when it did not.
+		return ed_flck(idx->slabfd, ED_LCK_UN, start, len, flags);
+	}
+	if (rlck_release(c->readers, ED_RLCK_READERS, ED_RLCK_XF, s, l, conn) != NULL) {
+		__atomic_sub_fetch(&tbl->nwflck, 1, __ATOMIC_SEQ_CST);
+		return ed_flck(idx->slabfd, ED_LCK_UN, start, len, flags);
+	}
+
+	// Otherwise this was a shared lock that fell back to a file lock.
+	int rc = ed_flck(idx->slabfd, ED_LCK_UN, start, len, flags);
+	if (__atomic_load_n(&c->nflck, __ATOMIC_ACQUIRE) > 0) {
+		__atomic_sub_fetch(&c->nflck, 1, __ATOMIC_SEQ_CST);
+	}
+	return rc;
+}
+
+int
+ed_idx_sync(EdIdx *idx, EdTxnId xid, uint64_t flags)
+{
+	ed_idx_assert(idx);
+	EdPgIdx *hdr = idx->hdr;
+
+	// Another committer may have already synced past this transaction.
+	if (hdr->sync_xid >= xid) { return 0; }
+
+	// The first committer to take the lock syncs on behalf of every transaction
+	// committed so far. Anyone waiting here is released once that finishes.
+	int rc = ed_lck(&idx->sync, idx->fd, ED_LCK_EX, flags & ~ED_FNOBLOCK);
+	if (rc < 0) { return rc; }
+
+	if (hdr->sync_xid < xid) {
+		EdTxnId target = hdr->xid;
+		if (fsync(idx->slabfd) < 0 || fsync(idx->fd) < 0) {
+			rc = ED_ERRNO;
+		}
+		else if (hdr->sync_xid < target) {
+			hdr->sync_xid = target;
+		}
+	}
+
+	ed_lck(&idx->sync, idx->fd, ED_LCK_UN, flags & ~ED_FNOBLOCK);
+	return rc;
+}
+
+int
+ed_idx_acquire_reader(EdIdx *idx)
+{
+	ed_idx_assert(idx);
+	EdConn *conn = idx->conn;
+	uint32_t mask = __atomic_load_n(&conn->rmask, __ATOMIC_RELAXED);
+	while (mask != UINT32_MAX) {
+		int slot = __builtin_ctz(~mask);
+		if (__atomic_compare_exchange_n(&conn->rmask, &mask, mask | (UINT32_C(1) << slot),
+					false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			conn->readers[slot] = 0;
+			return slot;
+		}
+	}
+	return ed_esys(EAGAIN);
+}
+
+void
+ed_idx_release_reader(EdIdx *idx, int slot)
+{
+	ed_idx_assert(idx);
+	if (slot < 0) { return; }
+	EdConn *conn = idx->conn;
+	conn->readers[slot] = 0;
+	__atomic_and_fetch(&conn->rmask, ~(UINT32_C(1) << slot), __ATOMIC_RELEASE);
+}
+
 EdTxnId
-ed_idx_acquire_xid(EdIdx *idx)
+ed_idx_acquire_xid(EdIdx *idx, int slot)
 {
 	ed_idx_assert(idx);
 	EdConn *conn = idx->conn;
-	conn->xid = idx->hdr->xid;
-	conn->active = ed_time_from_unix(idx->epoch, ed_now_unix());
-	return conn->xid;
+	EdTxnIdV *xid = ed_idx_xid_slot(idx, slot);
+	if (*xid == 0) {
+		__atomic_add_fetch(&idx->hdr->nsnapshots, 1, __ATOMIC_SEQ_CST);
+	}
+	*xid = idx->hdr->xid;
+	// Threads sharing the connection race to store the same time.
+	__atomic_store_n(&conn->active, ed_time_from_unix(idx->epoch, ed_now_unix()), __ATOMIC_RELAXED);
+	return *xid;
 }
 
 void
-ed_idx_release_xid(EdIdx *idx)
+ed_idx_release_xid(EdIdx *idx, int slot)
 {
 	ed_idx_assert(idx);
 	EdConn *conn = idx->conn;
-	if (conn->xid > 0) {
-		conn->xid = 0;
-		conn->active = ed_time_from_unix(idx->epoch, ed_now_unix());
+	EdTxnIdV *xid = ed_idx_xid_slot(idx, slot);
+	EdTxnId old = *xid;
+	if (old > 0) {
+		*xid = 0;
+		__atomic_store_n(&conn->active, ed_time_from_unix(idx->epoch, ed_now_unix()), __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&idx->hdr->nsnapshots, 1, __ATOMIC_SEQ_CST);
+		// Releasing the oldest snapshot allows the cached minimum to advance.
+		if (old <= idx->hdr->xmin) {
+			__atomic_add_fetch(&idx->hdr->xmin_gen, 1, __ATOMIC_SEQ_CST);
+		}
 	}
 }
 
 int
-ed_idx_acquire_snapshot(EdIdx *idx, EdBpt **trees)
+ed_idx_acquire_snapshot(EdIdx *idx, EdBpt **trees, int slot)
 {
 	ed_idx_assert(idx);
-	ed_idx_acquire_xid(idx);
+	ed_idx_acquire_xid(idx, slot);
 	for (int i = 0; i < ED_NDB; i++) {
 		if (ed_pg_load(idx->fd, (EdPg **)&trees[i], idx->hdr->tree[i], true)
 				== MAP_FAILED) {
@@ -474,7 +1034,7 @@ ed_idx_acquire_snapshot(EdIdx *idx, EdBpt **trees)
 			for (; i >= 0; i--) {
 				if (trees[i]) { ed_pg_unmap(trees[i], 1); }
 			}
-			ed_idx_release_xid(idx);
+			ed_idx_release_xid(idx, slot);
 			return rc;
 		}
 	}
@@ -482,7 +1042,7 @@ ed_idx_acquire_snapshot(EdIdx *idx, EdBpt **trees)
 }
 
 void
-ed_idx_release_snapshot(EdIdx *idx, EdBpt **trees)
+ed_idx_release_snapshot(EdIdx *idx, EdBpt **trees, int slot)
 {
 	for (size_t i = 0; i < ED_NDB; i++) {
 		if (trees[i]) {
@@ -490,7 +1050,7 @@ ed_idx_release_snapshot(EdIdx *idx, EdBpt **trees)
 			trees[i] = NULL;
 		}
 	}
-	ed_idx_release_xid(idx);
+	ed_idx_release_xid(idx, slot);
 }
 
 int
@@ -3,6 +3,19 @@
 #define ed_lck_thread(flags) (!((flags) & ED_FNOTLCK))
 #define ed_lck_wait(type, flags) ((type) == ED_LCK_UN || !((flags) & ED_FNOBLOCK))
 
+// Open file description locks are owned by the descriptor rather than the
+// process, so separate handles within a process exclude each other, and
+// closing one handle does not drop the locks of another.
+#ifdef F_OFD_SETLK
+# define ED_F_GETLK F_OFD_GETLK
+# define ED_F_SETLK F_OFD_SETLK
+# define ED_F_SETLKW F_OFD_SETLKW
+#else
+# define ED_F_GETLK F_GETLK
+# define ED_F_SETLK F_SETLK
+# define ED_F_SETLKW F_SETLKW
+#endif
+
 void
 ed_lck_init(EdLck *lck, off_t start, off_t len)
 {
@@ -52,8 +65,20 @@ ed_flck(int fd, EdLckType type, off_t start, off_t len, uint64_t flags)
 		.l_start = start,
 		.l_len = len,
 	};
-	int rc = 0, op = ed_lck_wait(type, flags) ? F_SETLKW : F_SETLK;
+	int rc = 0, op = ed_lck_wait(type, flags) ? ED_F_SETLKW : ED_F_SETLK;
 	while (fcntl(fd, op, &f) < 0 && (rc = ED_ERRNO) == ed_esys(EINTR)) {}
 	return rc;
 }
 
+int
+ed_flck_test(int fd, EdLckType type, off_t start, off_t len)
+{
+	struct flock f = {
+		.l_type = (short)type,
+		.l_whence = SEEK_SET,
+		.l_start = start,
+		.l_len = len,
+	};
+	if (fcntl(fd, ED_F_GETLK, &f) < 0) { return ED_ERRNO; }
+	return f.l_type == F_UNLCK ? 0 : ed_esys(EAGAIN);
+}
@@ -1,28 +1,256 @@
 #include "eddy-private.h"
 
-_Static_assert(sizeof(EdPgGc) == PAGESIZE,
+_Static_assert(sizeof(EdPgGc) == ED_PG_SIZE,
 		"EdPgGc size invalid");
 _Static_assert(offsetof(EdPgGc, data) % ed_alignof(EdPgGcList) == 0,
 		"EdPgGc data not properly aligned");
 
+#ifndef MAP_NORESERVE
+# define MAP_NORESERVE 0
+#endif
+
+#ifndef ED_PG_NFIXED
+# define ED_PG_NFIXED 16
+#endif
+
+#ifndef ED_PG_FIXED_GROW
+# define ED_PG_FIXED_GROW (1024*1024)
+#endif
+
+_Static_assert(ED_PG_FIXED_GROW % PAGESIZE == 0,
+		"ED_PG_FIXED_GROW must be a multiple of PAGESIZE");
+
+/**
+ * @brief  Persistent mapping of a file into a reserved address range
+ *
+ * The #base is published last when registering and cleared first when
+ * releasing, so a non-NULL #base indicates the remaining fields are valid.
+ */
+typedef struct {
+	uint8_t *    base;             /**< Start of the reserved address range or NULL */
+	size_t       size;             /**< Number of bytes reserved */
+	size_t       len;              /**< Number of bytes currently mapped from the file */
+	int          fd;               /**< File descriptor that is mapped */
+} PgFixed;
+
+static PgFixed pg_fixed[ED_PG_NFIXED];
+static unsigned pg_nfixed = 0;
+static pthread_mutex_t pg_fixed_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static PgFixed *
+pg_fixed_find(int fd)
+{
+	for (PgFixed *f = pg_fixed; f < pg_fixed + ED_PG_NFIXED; f++) {
+		if (__atomic_load_n(&f->base, __ATOMIC_ACQUIRE) != NULL && f->fd == fd) {
+			return f;
+		}
+	}
+	return NULL;
+}
+
+static bool
+pg_fixed_contains(const void *p)
+{
+	for (PgFixed *f = pg_fixed; f < pg_fixed + ED_PG_NFIXED; f++) {
+		const uint8_t *base = __atomic_load_n(&f->base, __ATOMIC_ACQUIRE);
+		if (base != NULL && (const uint8_t *)p >= base && (const uint8_t *)p < base + f->size) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief  Gets a pointer to a byte range within a persistent mapping
+ *
+ * If the range extends past the currently mapped length, the mapping is
+ * grown in place over the reserved address range. This covers both local
+ * growth of the file and growth from other processes.
+ *
+ * @param  f  Persistent mapping
+ * @param  off  Starting byte offset, aligned to #PAGESIZE
+ * @param  len  Number of bytes, aligned to #PAGESIZE
+ * @return  Pointer to the start of the range or NULL if it cannot be mapped
+ */
+static void *
+pg_fixed_map(PgFixed *f, size_t off, size_t len)
+{
+	size_t end = off + len;
+	if (end > f->size) { return NULL; }
+
+	if (end > __atomic_load_n(&f->len, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&pg_fixed_mutex);
+		size_t len = f->len;
+		if (end > len) {
+			size_t grow = ED_ALIGN_SIZE(end, ED_PG_FIXED_GROW);
+			if (grow > f->size) { grow = f->size; }
+			void *p = mmap(f->base + len, grow - len, PROT_READ|PROT_WRITE,
+					MAP_SHARED|MAP_FIXED, f->fd, (off_t)len);
+			if (p == MAP_FAILED) {
+				pthread_mutex_unlock(&pg_fixed_mutex);
+				return NULL;
+			}
+			__atomic_store_n(&f->len, grow, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&pg_fixed_mutex);
+	}
+	return f->base + off;
+}
+
+int
+ed_pg_reserve(int fd, size_t size, size_t len)
+{
+	size = ed_align_pg(size);
+	len = ed_align_pg(len);
+	if (len > size) { len = size; }
+
+	uint8_t *base = mmap(NULL, size, PROT_NONE,
+			MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED) { return ED_ERRNO; }
+	if (len > 0 && mmap(base, len, PROT_READ|PROT_WRITE,
+				MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED) {
+		int rc = ED_ERRNO;
+		munmap(base, size);
+		return rc;
+	}
+
+	int rc = ed_esys(ENOSPC);
+	pthread_mutex_lock(&pg_fixed_mutex);
+	for (PgFixed *f = pg_fixed; f < pg_fixed + ED_PG_NFIXED; f++) {
+		if (f->base == NULL) {
+			f->size = size;
+			f->len = len;
+			f->fd = fd;
+			__atomic_store_n(&f->base, base, __ATOMIC_RELEASE);
+			__atomic_add_fetch(&pg_nfixed, 1, __ATOMIC_RELEASE);
+			rc = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pg_fixed_mutex);
+
+	if (rc < 0) { munmap(base, size); }
+	return rc;
+}
+
+void
+ed_pg_release(int fd)
+{
+	if (__atomic_load_n(&pg_nfixed, __ATOMIC_ACQUIRE) == 0) { return; }
+
+	pthread_mutex_lock(&pg_fixed_mutex);
+	PgFixed *f = pg_fixed_find(fd);
+	if (f != NULL) {
+		uint8_t *base = f->base;
+		__atomic_store_n(&f->base, NULL, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&pg_nfixed, 1, __ATOMIC_RELEASE);
+		munmap(base, f->size);
+	}
+	pthread_mutex_unlock(&pg_fixed_mutex);
+}
+
+/**
+ * @brief  Maps a byte range of a file
+ *
+ * Index pages and slab blocks are both mapped through here. The range must be
+ * aligned to #PAGESIZE, which may be smaller than #ED_PG_SIZE.
+ *
+ * @param  fd  File descriptor to map
+ * @param  off  Starting byte offset
+ * @param  len  Number of bytes to map
+ * @param  need  Hint that the range will be needed soon
+ * @return  Pointer to the mapping or MAP_FAILED on error
+ */
+static void *
+pg_map(int fd, size_t off, size_t len, bool need)
+{
+	if (__atomic_load_n(&pg_nfixed, __ATOMIC_ACQUIRE) > 0) {
+		PgFixed *f = pg_fixed_find(fd);
+		if (f != NULL) {
+			void *p = pg_fixed_map(f, off, len);
+			if (p != NULL) { return p; }
+		}
+	}
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	if (need) { flags |= MAP_POPULATE; }
+#else
+	(void)need;
+#endif
+	void *p = mmap(NULL, len, PROT_READ|PROT_WRITE, flags, fd, (off_t)off);
+#ifdef ED_MMAP_DEBUG
+	if (p != MAP_FAILED) { ed_pg_track(off / PAGESIZE, p, len / PAGESIZE); }
+#endif
+	return p;
+}
+
+static int
+pg_unmap(void *p, size_t len)
+{
+	if (__atomic_load_n(&pg_nfixed, __ATOMIC_ACQUIRE) > 0 && pg_fixed_contains(p)) {
+		return 0;
+	}
+#ifdef ED_MMAP_DEBUG
+	ed_pg_untrack(p, len / PAGESIZE);
+#endif
+	return munmap(p, len);
+}
+
 void *
 ed_blk_map(int fd, EdBlkno no, EdBlkno count, uint16_t size, bool need)
 {
 	off_t off = no * size;
-	EdPgno pgno = off / PAGESIZE;
-	off_t diff = off - (pgno * PAGESIZE);
-	EdPgno pgcount = ed_count_pg((count * size) + diff);
-	uint8_t *p = ed_pg_map(fd, pgno, pgcount, need);
+	off_t diff = off % PAGESIZE;
+	uint8_t *p = pg_map(fd, off - diff, ed_align_pg((count * size) + diff), need);
 	if (p != MAP_FAILED) { p += diff; }
 	return p;
 }
 
+void *
+ed_blk_map_ring(int fd, EdBlkno no, EdBlkno count, uint16_t size, EdBlkno total, bool need)
+{
+	const size_t end = (size_t)total * size;
+	if (no + count <= total || count > total || end % PAGESIZE != 0) {
+		return ed_blk_map(fd, no, count, size, need);
+	}
+
+	// Map the range up to the end of the file followed by the wrapped range from
+	// the start of the file. The end is page aligned, so the two mappings are
+	// contiguous within a single reserved address range. Unmapping the result
+	// with #ed_blk_unmap() covers both.
+	off_t off = no * size;
+	EdPgno pgno = off / PAGESIZE;
+	off_t diff = off - (pgno * PAGESIZE);
+	size_t tail = end - (size_t)pgno * PAGESIZE;
+	size_t head = ed_align_pg((size_t)(no + count - total) * size);
+	int flags = MAP_SHARED|MAP_FIXED;
+#ifdef MAP_POPULATE
+	if (need) { flags |= MAP_POPULATE; }
+#else
+	(void)need;
+#endif
+
+	uint8_t *p = mmap(NULL, tail + head, PROT_NONE,
+			MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) { return MAP_FAILED; }
+	if (mmap(p, tail, PROT_READ|PROT_WRITE, flags, fd, (off_t)pgno*PAGESIZE) == MAP_FAILED ||
+			mmap(p + tail, head, PROT_READ|PROT_WRITE, flags, fd, 0) == MAP_FAILED) {
+		int err = errno;
+		munmap(p, tail + head);
+		errno = err;
+		return MAP_FAILED;
+	}
+#ifdef ED_MMAP_DEBUG
+	ed_pg_track(pgno, p, (tail + head) / PAGESIZE);
+#endif
+	return p + diff;
+}
+
 int
 ed_blk_unmap(void *p, EdBlkno count, uint16_t size)
 {
 	uint8_t *m = (uint8_t *)p - ((uintptr_t)p % PAGESIZE);
-	EdPgno pgcount = ed_count_pg((count * size) + ((uint8_t *)p - m));
-	return ed_pg_unmap(m, pgcount);
+	return pg_unmap(m, ed_align_pg((count * size) + ((uint8_t *)p - m)));
 }
 
 void *
@@ -32,27 +260,33 @@ ed_pg_map(int fd, EdPgno no, EdPgno count, bool need)
 		errno = EINVAL;
 		return MAP_FAILED;
 	}
-	int flags = MAP_SHARED;
-#ifdef MAP_POPULATE
-	if (need) { flags |= MAP_POPULATE; }
-#else
-	(void)need;
-#endif
-	void *p = mmap(NULL, (size_t)count*PAGESIZE, PROT_READ|PROT_WRITE, flags,
-			fd, (off_t)no*PAGESIZE);
-#ifdef ED_MMAP_DEBUG
-	if (p != MAP_FAILED) { ed_pg_track(no, p, count); }
-#endif
-	return p;
+	return pg_map(fd, (size_t)no*ED_PG_SIZE, (size_t)count*ED_PG_SIZE, need);
 }
 
 int
 ed_pg_unmap(void *p, EdPgno count)
 {
-#ifdef ED_MMAP_DEBUG
-	ed_pg_untrack(p, count);
+	return pg_unmap(p, (size_t)count*ED_PG_SIZE);
+}
+
+void
+ed_pg_prefetch(int fd, EdPgno no, EdPgno count)
+{
+	if (no == ED_PG_NONE || count == 0) { return; }
+	size_t off = (size_t)no*ED_PG_SIZE, len = (size_t)count*ED_PG_SIZE;
+	if (__atomic_load_n(&pg_nfixed, __ATOMIC_ACQUIRE) > 0) {
+		PgFixed *f = pg_fixed_find(fd);
+		if (f != NULL) {
+			void *p = pg_fixed_map(f, off, len);
+			if (p != NULL) {
+				madvise(p, len, MADV_WILLNEED);
+				return;
+			}
+		}
+	}
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(fd, (off_t)off, (off_t)len, POSIX_FADV_WILLNEED);
 #endif
-	return munmap(p, (size_t)count*PAGESIZE);
 }
 
 void *
@@ -99,7 +333,7 @@ map_live_pages(EdIdx *idx, EdPgno no, EdPg **p, EdPgno n)
 
 	uint8_t *pages = ed_pg_map(idx->fd, no, n, true);
 	if (pages == MAP_FAILED) { return ED_ERRNO; }
-	for (EdPgno i = 0; i < n; i++, pages += PAGESIZE) {
+	for (EdPgno i = 0; i < n; i++, pages += ED_PG_SIZE) {
 		EdPg *live = (EdPg *)pages;
 		live->no = no + i;
 		p[i] = live;
@@ -128,7 +362,7 @@ map_sorted_pages(EdIdx *idx, EdPgno *no, EdPg **p, EdPgno n, bool need)
 		if (i == n || no[i] != no[i-1] + 1) {
 			uint8_t *pages = ed_pg_map(idx->fd, no[mapped], i - mapped, need);
 			if (pages == MAP_FAILED) { rc = ED_ERRNO; goto error; }
-			for (; mapped < i; mapped++, pages += PAGESIZE) {
+			for (; mapped < i; mapped++, pages += ED_PG_SIZE) {
 				p[mapped] = (EdPg *)pages;
 			}
 		}
@@ -136,7 +370,7 @@ map_sorted_pages(EdIdx *idx, EdPgno *no, EdPg **p, EdPgno n, bool need)
 	return (int)n;
 
 error:
-	for (EdPgno i = 0; i < mapped; i++) { munmap(p[i], PAGESIZE); }
+	for (EdPgno i = 0; i < mapped; i++) { ed_pg_unmap(p[i], 1); }
 	return rc;
 }
 
@@ -150,7 +384,7 @@ map_end_pages(EdIdx *idx, EdPg **p, EdPgno n)
 
 	if (n > count) {
 		count += ED_ALIGN_SIZE(n, ED_ALLOC_COUNT);
-		off_t size = (off_t)(start + count) * PAGESIZE;
+		off_t size = (off_t)(start + count) * ED_PG_SIZE;
 		if (ftruncate(idx->fd, size) < 0) { return ED_ERRNO; }
 	}
 
@@ -58,7 +58,7 @@ ed_stat_new(EdStat **statp, EdIdx *idx, uint64_t flags)
 			ED_BIT_SET(stat->vec, p);
 		}
 
-		rc = ed_idx_acquire_snapshot(idx, trees);
+		rc = ed_idx_acquire_snapshot(idx, trees, -1);
 
 		if (rc == 0) {
 			EdConn *conn = idx->hdr->conns;
@@ -92,7 +92,7 @@ ed_stat_new(EdStat **statp, EdIdx *idx, uint64_t flags)
 		}
 	}
 
-	ed_idx_release_snapshot(idx, trees);
+	ed_idx_release_snapshot(idx, trees, -1);
 
 	if (rc < 0) { free(stat); }
 	else { *statp = stat; }
@@ -176,7 +176,7 @@ ed_stat_print(EdStat *stat, FILE *out)
 		sizeof(EdEntryKey),
 		sizeof(EdEntryBlock),
 		sizeof(EdObjectHdr),
-		(size_t)PAGESIZE,
+		(size_t)ED_PG_SIZE,
 		(size_t)ED_MAX_ALIGN,
 		stat->seed,
 		created_at,
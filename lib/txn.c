@@ -36,6 +36,118 @@ node_alloc(EdTxnNode **head, unsigned nslot)
 	return 0;
 }
 
+static inline unsigned
+map_hash(EdPgno no)
+{
+	return (unsigned)(((uint64_t)no * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+/**
+ * @brief  Finds a node for a page number mapped in the transaction
+ * @param  txn  Transaction object
+ * @param  no  Page number
+ * @return  Node pointer or NULL if the page is not mapped
+ */
+static EdNode *
+map_get(const EdTxn *txn, EdPgno no)
+{
+	const unsigned mask = txn->nmap - 1;
+	for (unsigned i = map_hash(no) & mask; ; i = (i + 1) & mask) {
+		const EdTxnSlot *slot = &txn->map[i];
+		if (slot->gen != txn->mapgen) { return NULL; }
+		if (slot->no == no) { return slot->node; }
+	}
+}
+
+/**
+ * @brief  Adds a node to the page table
+ *
+ * A node already set for the page number is replaced. There must be room in
+ * the table, which is ensured by #map_reserve().
+ *
+ * @param  txn  Transaction object
+ * @param  node  Node to add
+ */
+static void
+map_put(EdTxn *txn, EdNode *node)
+{
+	assert(txn->nmapused < txn->nmap);
+	const EdPgno no = node->page->no;
+	const unsigned mask = txn->nmap - 1;
+	for (unsigned i = map_hash(no) & mask; ; i = (i + 1) & mask) {
+		EdTxnSlot *slot = &txn->map[i];
+		if (slot->gen != txn->mapgen) {
+			*slot = (EdTxnSlot){ no, txn->mapgen, node };
+			txn->nmapused++;
+			return;
+		}
+		if (slot->no == no) {
+			slot->node = node;
+			return;
+		}
+	}
+}
+
+/**
+ * @brief  Grows the page table if needed to fit another node
+ *
+ * The table is kept at most half full to keep probe sequences short.
+ *
+ * @param  txn  Transaction object
+ * @param  nslot  Minimum number of nodes the table should fit
+ * @return  0 on success, <0 on error
+ */
+static int
+map_reserve(EdTxn *txn, unsigned nslot)
+{
+	if (nslot*2 <= txn->nmap) { return 0; }
+
+	EdTxnSlot *old = txn->map;
+	unsigned nold = txn->nmap, gen = txn->mapgen;
+	unsigned nmap = ed_power2(nslot*2);
+	EdTxnSlot *map = calloc(nmap, sizeof(*map));
+	if (map == NULL) { return ED_ERRNO; }
+
+	txn->map = map;
+	txn->nmap = nmap;
+	txn->nmapused = 0;
+	txn->mapgen = 1;
+	for (unsigned i = 0; i < nold; i++) {
+		if (old[i].gen == gen) { map_put(txn, old[i].node); }
+	}
+	free(old);
+	return 0;
+}
+
+/**
+ * @brief  Clears all nodes from the page table
+ * @param  txn  Transaction object
+ */
+static void
+map_reset(EdTxn *txn)
+{
+	if (++txn->mapgen == 0) {
+		memset(txn->map, 0, txn->nmap*sizeof(txn->map[0]));
+		txn->mapgen = 1;
+	}
+	txn->nmapused = 0;
+}
+
+/**
+ * @brief  Ensures there is room to wrap another node
+ * @param  txn  Transaction object
+ * @return  0 on success, <0 on error
+ */
+static int
+node_reserve(EdTxn *txn)
+{
+	if (txn->nodes->nused == txn->nodes->nslot) {
+		int rc = node_alloc(&txn->nodes, txn->nodes->nslot+1);
+		if (rc < 0) { return rc; }
+	}
+	return map_reserve(txn, txn->nmapused+1);
+}
+
 /**
  * @brief   Wraps a mapped page into a node.
  *
@@ -54,6 +166,7 @@ node_wrap(EdTxn *txn, EdPg *pg, EdNode *par, uint16_t pidx)
 	n->page = pg;
 	n->parent = par;
 	n->pindex = pidx;
+	map_put(txn, n);
 	return n;
 }
 
@@ -77,11 +190,18 @@ ed_txn_new(EdTxn **txnp, EdIdx *idx)
 	}
 
 	txn->idx = idx;
+	txn->rslot = -1;
 	txn->nodes = (EdTxnNode *)((uint8_t *)txn + offnodes);
 	txn->nodes->nslot = nslot;
 
+	// The table always fits the first node array, which is all that is used
+	// when wrapping the roots of a newly opened transaction.
+	rc = map_reserve(txn, nslot);
+	if (rc < 0) { goto error; }
+
 	txn->db[ED_DB_KEYS].entry_size = sizeof(EdEntryKey);
 	txn->db[ED_DB_BLOCKS].entry_size = sizeof(EdEntryBlock);
+	txn->db[ED_DB_EXPIRY].entry_size = sizeof(EdEntryExpiry);
 
 	for (unsigned i = 0; i < ed_len(txn->db); i++) {
 		EdPgno *no = &idx->hdr->tree[i];
@@ -117,12 +237,14 @@ ed_txn_open(EdTxn *txn, uint64_t flags)
 		if (rc < 0) { return rc; }
 	}
 
-	rc = ed_idx_acquire_snapshot(txn->idx, txn->roots);
+	rc = ed_idx_acquire_snapshot(txn->idx, txn->roots, txn->rslot);
 	if (rc < 0) { return rc; };
 
 	for (int i = 0; i < ED_NDB; i++) {
 		txn->db[i].find = txn->db[i].root = txn->roots[i] ?
 			node_wrap(txn, (EdPg *)txn->roots[i], NULL, 0) : NULL;
+		txn->db[i].seek = NULL;
+		txn->db[i].prefetch_no = ED_PG_NONE;
 		txn->roots[i] = NULL;
 	}
 
@@ -228,7 +350,11 @@ ed_txn_commit(EdTxn **txnp, uint64_t flags)
 
 	// Updating the tree pages first means a reader could hold an xid that is
 	// older than the committed tree pages. This is still a valid state, however,
-	// the opposite is not.
+	// the opposite is not. Trees past the atomic pair are only searched by
+	// writers, so they are stored ahead of it.
+	for (unsigned i = 2; i < ed_len(txn->db); i++) {
+		hdr->tree[i] = update.tree[i];
+	}
 	hdr->vtree = update.vtree;
 	ed_fault_trigger(UPDATE_TREE);
 	hdr->xid = txn->xid;
@@ -306,11 +432,11 @@ ed_txn_close(EdTxn **txnp, uint64_t flags)
 
 	if (flags & ED_FRESET) {
 		if (txn->state ) {
-			ed_idx_release_xid(txn->idx);
+			ed_idx_release_xid(txn->idx, txn->rslot);
 		}
 	}
 	else {
-		ed_idx_release_snapshot(txn->idx, txn->roots);
+		ed_idx_release_snapshot(txn->idx, txn->roots, txn->rslot);
 	}
 
 	if (locked) {
@@ -339,7 +465,12 @@ ed_txn_close(EdTxn **txnp, uint64_t flags)
 
 		ed_lck(&txn->idx->lck, txn->idx->fd, ED_LCK_UN, flags);
 		if (!(flags & ED_FNOSYNC)) {
-			fsync(txn->idx->fd);
+			if (state == ED_TXN_COMMITTED && (flags & ED_FGROUPSYNC)) {
+				ed_idx_sync(txn->idx, xid, flags);
+			}
+			else {
+				fsync(txn->idx->fd);
+			}
 		}
 	}
 
@@ -348,12 +479,13 @@ ed_txn_close(EdTxn **txnp, uint64_t flags)
 		txn->ngcused = 0;
 		txn->nodes->nused = 0;
 		memset(txn->nodes->nodes, 0, txn->nodes->nslot*sizeof(txn->nodes->nodes[0]));
+		map_reset(txn);
 		txn->xid = 0;
 		txn->state = ED_TXN_CLOSED;
 		txn->error = 0;
 		for (int i = 0; i < ED_NDB; i++) {
 			EdTxnDb *dbp = &txn->db[i];
-			dbp->find = dbp->root = NULL;
+			dbp->find = dbp->root = dbp->seek = NULL;
 			dbp->key = 0;
 			dbp->kmin = 0;
 			dbp->kmax = 0;
@@ -369,13 +501,23 @@ ed_txn_close(EdTxn **txnp, uint64_t flags)
 		}
 	}
 	else {
+		ed_idx_release_reader(txn->idx, txn->rslot);
 		free(txn->pg);
 		free(txn->gc);
+		free(txn->map);
 		free(txn);
 		*txnp = NULL;
 	}
 }
 
+EdTxnId
+ed_txn_snapshot(const EdTxn *txn)
+{
+	ED_TXN_CHECK_RD(txn);
+
+	return *ed_idx_xid_slot(txn->idx, txn->rslot);
+}
+
 EdBlkno
 ed_txn_vno(const EdTxn *txn)
 {
@@ -416,21 +558,16 @@ ed_txn_map(EdTxn *txn, EdPgno no, EdNode *par, uint16_t pidx, EdNode **out)
 {
 	ED_TXN_CHECK(txn);
 
-	for (EdTxnNode *node = txn->nodes; node != NULL; node = node->next) {
-		for (int i = (int)node->nused-1; i >= 0; i--) {
-			if (node->nodes[i].page->no == no) {
-				node->nodes[i].parent = par;
-				node->nodes[i].pindex = pidx;
-				*out = &node->nodes[i];
-				return 0;
-			}
-		}
+	EdNode *node = map_get(txn, no);
+	if (node != NULL) {
+		node->parent = par;
+		node->pindex = pidx;
+		*out = node;
+		return 0;
 	}
 
-	if (txn->nodes->nused == txn->nodes->nslot) {
-		int rc = node_alloc(&txn->nodes, txn->nodes->nslot+1);
-		if (rc < 0) { return (txn->error = rc); }
-	}
+	int rc = node_reserve(txn);
+	if (rc < 0) { return (txn->error = rc); }
 
 	EdPg *pg = ed_pg_map(txn->idx->fd, no, 1, true);
 	if (pg == MAP_FAILED) { return (txn->error = ED_ERRNO); }
@@ -486,10 +623,8 @@ ed_txn_alloc(EdTxn *txn, EdNode *par, uint16_t pidx, EdNode **out)
 	}
 
 	assert(txn->nodes != NULL);
-	if (txn->nodes->nused == txn->nodes->nslot) {
-		int rc = node_alloc(&txn->nodes, txn->nodes ? txn->nodes->nslot + 1 : npg);
-		if (rc < 0) { return (txn->error = rc); }
-	}
+	int rc = node_reserve(txn);
+	if (rc < 0) { return (txn->error = rc); }
 
 	EdNode *node = node_wrap(txn, txn->pg[txn->npgused++], par, pidx);
 	node->tree->xid = txn->xid;
@@ -0,0 +1,108 @@
+/**
+ * Compares reading objects through a mapping with ed_value() against copying
+ * them out with ed_read() and #ED_ONOMAP. Each size is measured by opening,
+ * reading into a reused buffer, and closing the same set of objects.
+ */
+#include "../lib/eddy-private.h"
+
+#include <err.h>
+
+#define NOBJECTS 64
+#define NROUNDS 200
+
+static EdConfig cfg = {
+	.index_path = "./test/tmp/bench_read",
+	.slab_path = "./test/tmp/bench_read-slab",
+	.slab_size = 128*1024*1024,
+	.flags = ED_FNOSYNC|ED_FCREATE|ED_FALLOCATE|ED_FREPLACE,
+};
+
+static const size_t sizes[] = {
+	512, 4*1024, 16*1024, 64*1024, 256*1024, 1024*1024,
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+populate(EdCache *cache, size_t size, uint8_t *buf)
+{
+	memset(buf, 'x', size);
+	for (int i = 0; i < NOBJECTS; i++) {
+		char key[64];
+		int klen = snprintf(key, sizeof(key), "%zu-%d", size, i);
+		EdObject *obj;
+		EdObjectAttr attr = { .key = key, .keylen = klen, .datalen = size };
+		int rc = ed_create(cache, &obj, &attr);
+		if (rc < 0) { errx(1, "failed to create: %s", ed_strerror(rc)); }
+		ed_write(obj, buf, size);
+		rc = ed_close(&obj);
+		if (rc < 0) { errx(1, "failed to close: %s", ed_strerror(rc)); }
+	}
+}
+
+static double
+run(EdCache *cache, size_t size, uint8_t *buf, bool copy)
+{
+	double start = now();
+	for (int r = 0; r < NROUNDS; r++) {
+		for (int i = 0; i < NOBJECTS; i++) {
+			char key[64];
+			int klen = snprintf(key, sizeof(key), "%zu-%d", size, i);
+			EdObject *obj;
+			int rc = ed_open(cache, &obj, key, klen, copy ? ED_ONOMAP : 0);
+			if (rc <= 0) { errx(1, "failed to open: %s", ed_strerror(rc)); }
+			if (copy) {
+				ed_read(obj, buf, size, 0);
+			}
+			else {
+				size_t len;
+				const void *data = ed_value(obj, &len);
+				memcpy(buf, data, len);
+			}
+			ed_close(&obj);
+		}
+	}
+	return (now() - start) * 1e9 / (NROUNDS * NOBJECTS);
+}
+
+int
+main(void)
+{
+	uint8_t *buf = malloc(sizes[ed_len(sizes)-1]);
+	if (buf == NULL) { err(1, "malloc"); }
+
+	for (int i = 0; i < 2; i++) {
+		EdCache *cache;
+		int rc = ed_cache_open(&cache, &cfg);
+		if (rc < 0) { errx(1, "failed to open cache: %s", ed_strerror(rc)); }
+
+		if (i == 0) {
+			printf("%10s %14s %14s\n", "size", "map ns/op", "read ns/op");
+			cfg.flags &= ~ED_FREPLACE;
+		}
+		else {
+			printf("\nwith ED_FMAPSLAB\n");
+		}
+
+		for (size_t s = 0; s < ed_len(sizes); s++) {
+			if (i == 0) { populate(cache, sizes[s], buf); }
+			double map = run(cache, sizes[s], buf, false);
+			double read = run(cache, sizes[s], buf, true);
+			printf("%10zu %14.0f %14.0f\n", sizes[s], map, read);
+		}
+
+		ed_cache_close(&cache);
+		cfg.flags |= ED_FMAPSLAB;
+	}
+
+	unlink(cfg.index_path);
+	unlink(cfg.slab_path);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,202 @@
+#include "../lib/eddy-private.h"
+#include "mu.h"
+
+#if ED_AIO
+
+#include "../lib/eddy-aio.h"
+
+#include <poll.h>
+
+static EdConfig cfg = {
+	.index_path = "./test/tmp/test_aio",
+	.slab_path = "./test/tmp/test_aio-slab",
+	.slab_size = 16*1024*1024,
+	.flags = ED_FNOSYNC|ED_FCREATE|ED_FALLOCATE|ED_FCHECKSUM,
+};
+
+static void
+cleanup(void)
+{
+	unlink(cfg.index_path);
+	unlink(cfg.slab_path);
+#if ED_MMAP_DEBUG
+	mu_assert_int_eq(ed_pg_check(), 0);
+#endif
+}
+
+static bool
+open_aio(EdAio **aio, EdCache *cache, unsigned depth, size_t bufsize)
+{
+	int rc = ed_aio_open(aio, cache, depth, bufsize);
+	if (rc == ed_esys(ENOSYS) || rc == ed_esys(EPERM)) {
+		fprintf(stderr, "io_uring is not available: %s\n", ed_strerror(rc));
+		return false;
+	}
+	mu_assert_msg(rc >= 0, "failed to open aio: %s\n", ed_strerror(rc));
+	return true;
+}
+
+static void
+test_write_read(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	EdAio *aio = NULL;
+	if (!open_aio(&aio, cache, 4, 4096)) {
+		ed_cache_close(&cache);
+		return;
+	}
+	mu_assert_int_ge(ed_aio_fd(aio), 0);
+
+	// Write each object in chunks, leaving more chunks than buffer slots.
+	uint8_t chunk[4096];
+	EdAioEvent ev[8];
+	for (int i = 0; i < 10; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "aio-%d", i);
+		EdObject *obj = NULL;
+		EdObjectAttr attr = {
+			.datalen = 10000 + i,
+			.key = key,
+			.keylen = klen,
+		};
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+
+		size_t off = 0;
+		unsigned inflight = 0;
+		while (off < attr.datalen) {
+			size_t len = attr.datalen - off;
+			if (len > sizeof(chunk)) { len = sizeof(chunk); }
+			for (size_t j = 0; j < len; j++) {
+				chunk[j] = (uint8_t)(off + j + i);
+			}
+			ssize_t n = ed_aio_write(aio, obj, chunk, len, obj);
+			if (n == ed_esys(EAGAIN)) {
+				mu_assert_int_ge(ed_aio_submit(aio), 0);
+				rc = ed_aio_reap(aio, ev, ed_len(ev), 1);
+				mu_assert_int_gt(rc, 0);
+				for (int k = 0; k < rc; k++) {
+					mu_assert_int_gt(ev[k].res, 0);
+					mu_assert_ptr_eq(ev[k].udata, obj);
+					mu_assert_ptr_eq(ev[k].buf, NULL);
+				}
+				inflight -= rc;
+				continue;
+			}
+			mu_assert_int_eq(n, len);
+			off += len;
+			inflight++;
+		}
+		mu_assert_int_ge(ed_aio_submit(aio), 0);
+		while (inflight > 0) {
+			rc = ed_aio_reap(aio, ev, ed_len(ev), inflight);
+			mu_assert_int_gt(rc, 0);
+			inflight -= rc;
+		}
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+
+	// Read everything back, waiting for completions on the event descriptor.
+	for (int i = 0; i < 10; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "aio-%d", i);
+		EdObject *obj = NULL;
+
+		// A mapped open verifies the checksum computed while writing.
+		mu_assert_int_eq(ed_open(cache, &obj, key, klen, 0), 1);
+		ed_close(&obj);
+
+		mu_assert_int_eq(ed_open(cache, &obj, key, klen, ED_ONOMAP), 1);
+		mu_assert_int_eq(ed_aio_write(aio, obj, chunk, 1, NULL), ED_EOBJECT_RDONLY);
+
+		size_t off = 0, total = 10000 + i;
+		while (off < total) {
+			ssize_t n = ed_aio_read(aio, obj, total, off, (void *)off);
+			mu_assert_int_gt(n, 0);
+			mu_assert_int_eq(ed_aio_submit(aio), 1);
+
+			struct pollfd pfd = { .fd = ed_aio_fd(aio), .events = POLLIN };
+			mu_assert_int_eq(poll(&pfd, 1, 5000), 1);
+
+			mu_assert_int_eq(ed_aio_reap(aio, ev, ed_len(ev), 0), 1);
+			mu_assert_ptr_eq(ev[0].obj, obj);
+			mu_assert_uint_eq((uintptr_t)ev[0].udata, off);
+			mu_assert_int_eq(ev[0].res, n);
+			const uint8_t *p = ev[0].buf;
+			for (ssize_t j = 0; j < n; j++) {
+				if (p[j] != (uint8_t)(off + j + i)) {
+					mu_fail("invalid byte at %zu", off + j);
+				}
+			}
+			ed_aio_release(aio, &ev[0]);
+			off += n;
+		}
+		mu_assert_int_eq(ed_aio_read(aio, obj, 100, off, NULL), 0);
+		ed_close(&obj);
+	}
+
+	ed_aio_close(&aio);
+	mu_assert_ptr_eq(aio, NULL);
+	ed_cache_close(&cache);
+}
+
+static void
+test_full(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	EdObject *obj = NULL;
+	EdObjectAttr attr = { .datalen = 100, .key = "full", .keylen = 4 };
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+	uint8_t buf[100] = { 0 };
+	mu_assert_int_eq(ed_write(obj, buf, sizeof(buf)), sizeof(buf));
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	EdAio *aio = NULL;
+	if (!open_aio(&aio, cache, 2, 1)) {
+		ed_cache_close(&cache);
+		return;
+	}
+
+	mu_assert_int_eq(ed_open(cache, &obj, "full", 4, ED_ONOMAP), 1);
+
+	// Read buffers are held until released.
+	mu_assert_int_eq(ed_aio_read(aio, obj, 10, 0, NULL), 10);
+	mu_assert_int_eq(ed_aio_read(aio, obj, 10, 10, NULL), 10);
+	mu_assert_int_eq(ed_aio_read(aio, obj, 10, 20, NULL), ed_esys(EAGAIN));
+	mu_assert_int_eq(ed_aio_submit(aio), 2);
+
+	EdAioEvent ev[2];
+	mu_assert_int_eq(ed_aio_reap(aio, ev, 2, 2), 2);
+	mu_assert_int_eq(ed_aio_read(aio, obj, 10, 20, NULL), ed_esys(EAGAIN));
+	ed_aio_release(aio, &ev[0]);
+	mu_assert_int_eq(ed_aio_read(aio, obj, 10, 20, NULL), 10);
+
+	// Closing waits for the outstanding read.
+	ed_aio_close(&aio);
+	ed_close(&obj);
+	ed_cache_close(&cache);
+}
+
+#endif
+
+int
+main(void)
+{
+	mu_init("aio");
+#if ED_AIO
+	mu_run(test_write_read);
+	mu_run(test_full);
+#endif
+}
+
@@ -6,7 +6,7 @@
 #include "mu.h"
 #include "rnd.c"
 
-// Enough entries to get to depth 3.
+// Enough entries to get to depth 3 with 4 KB pages.
 // The entry size is bloated to get there in fewer ops.
 #define LARGE 22000
 #define SMALL 162
@@ -99,13 +99,93 @@ finish(EdTxn **txn)
 	ed_idx_close(&idx);
 }
 
+/**
+ * Sets the keys from #start up to (or down to) #end by #step, named with
+ * #prefix and the key. Keys are committed in batches so that filling a full
+ * tree of large pages stays quick.
+ */
+static void
+fill(EdTxn **txn, long start, long end, long step, char prefix, int found)
+{
+	long n = 0;
+	mu_assert_int_eq(ed_txn_open(*txn, FOPEN), 0);
+	for (long i = start; step > 0 ? i < end : i > end; i += step, n++) {
+		if (n > 0 && n % 256 == 0) {
+			mu_assert_int_eq(ed_txn_commit(txn, FRESET), 0);
+			mu_assert_int_eq(ed_txn_open(*txn, FOPEN), 0);
+		}
+		Entry ent = { .key = i };
+		snprintf(ent.name, sizeof(ent.name), "%c%ld", prefix, i);
+		mu_assert_int_eq(ed_bpt_find(*txn, 0, ent.key, NULL), found);
+		mu_assert_int_eq(ed_bpt_set(*txn, 0, &ent, false), 0);
+	}
+	mu_assert_int_eq(ed_txn_commit(txn, FRESET), 0);
+}
+
 static void
 test_capacity(void)
 {
-	mu_assert_uint_eq(ed_bpt_capacity(sizeof(Entry), 1),         63);
-	mu_assert_uint_eq(ed_bpt_capacity(sizeof(Entry), 2),      21420);
-	mu_assert_uint_eq(ed_bpt_capacity(sizeof(Entry), 3),    7282800);
-	mu_assert_uint_eq(ed_bpt_capacity(sizeof(Entry), 4), 2476152000);
+	size_t leaf = ed_leaf_order(sizeof(Entry));
+	size_t branch = ed_branch_order();
+
+	mu_assert_uint_eq(leaf, ED_BPT_DATA / sizeof(Entry));
+	mu_assert_uint_eq(branch, (ED_BPT_DATA - sizeof(EdPgno)) / (sizeof(EdPgno) + 8) + 1);
+#if ED_PG_SIZE == 4096
+	mu_assert_uint_eq(leaf, 63);
+	mu_assert_uint_eq(branch, 340);
+#endif
+
+	mu_assert_uint_eq(ed_bpt_capacity(sizeof(Entry), 1), leaf);
+	mu_assert_uint_eq(ed_bpt_capacity(sizeof(Entry), 2), branch * leaf);
+	mu_assert_uint_eq(ed_bpt_capacity(sizeof(Entry), 3), branch * branch * leaf);
+	mu_assert_uint_eq(ed_bpt_capacity(sizeof(Entry), 4), branch * branch * branch * leaf);
+}
+
+static void
+test_key_count(void)
+{
+	static const uint64_t vals[] = {
+		0, 1, 2, 1000, INT64_MAX - 1, INT64_MAX,
+		(uint64_t)INT64_MAX + 1, UINT64_MAX - 1, UINT64_MAX,
+	};
+	static const int kernels[] = { ED_BPT_COUNT_SSE42, ED_BPT_COUNT_AVX2 };
+	const size_t strides[] = { 8, 12, sizeof(Entry) };
+	const uint32_t fulls[] = {
+		(uint32_t)ed_leaf_order(8),
+		(uint32_t)ed_branch_order() - 1,
+		(uint32_t)ed_leaf_order(sizeof(Entry)),
+	};
+	static uint8_t keys[ED_PG_SIZE];
+
+	for (size_t s = 0; s < ed_len(strides); s++) {
+		const uint32_t counts[] = { 0, 1, 2, 3, 5, 7, 8, 9, fulls[s] };
+		for (size_t c = 0; c < ed_len(counts); c++) {
+			const uint32_t n = counts[c];
+			mu_assert_uint_le(n * strides[s], sizeof(keys));
+
+			// Sorted keys spread over the values, so each one repeats.
+			memset(keys, 0xa5, sizeof(keys));
+			for (uint32_t i = 0; i < n; i++) {
+				uint64_t v = vals[(size_t)i * ed_len(vals) / n];
+				memcpy(keys + i*strides[s], &v, sizeof(v));
+			}
+
+			for (size_t v = 0; v < ed_len(vals); v++) {
+				const uint64_t probe[] = { vals[v] - 1, vals[v], vals[v] + 1 };
+				for (size_t p = 0; p < ed_len(probe); p++) {
+					int exp = ed_bpt_count(ED_BPT_COUNT_SCALAR, keys, strides[s], n, probe[p]);
+					mu_assert_int_ge(exp, 0);
+					for (size_t k = 0; k < ed_len(kernels); k++) {
+						int rc = ed_bpt_count(kernels[k], keys, strides[s], n, probe[p]);
+						if (rc == ed_esys(ENOTSUP)) { continue; }
+						mu_assert_msg(rc == exp,
+								"kernel %d stride %zu n %u key %" PRIu64 ": %d != %d\n",
+								kernels[k], strides[s], n, probe[p], rc, exp);
+					}
+				}
+			}
+		}
+	}
 }
 
 static void
@@ -451,59 +531,31 @@ test_split_branch_left0(void)
 	setup(&txn);
 
 	// The leaf order is odd, so we'll so this funky business to get a full tree
-	int branch_order = ed_branch_order();
-	int leaf_order = ed_leaf_order(sizeof(Entry)) - 1;
-	int n = branch_order * leaf_order;
-	int final = 0;
-	for (int i = 0; i < n; i += 2) {
-		Entry ent = { .key = i };
-		snprintf(ent.name, sizeof(ent.name), "a%" PRIu64, ent.key);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
-	for (int i = n-1; i > 0; i -= 2) {
-		Entry ent = { .key = i };
-		snprintf(ent.name, sizeof(ent.name), "b%" PRIu64, ent.key);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
-	for (int i = 0; i < n; i += leaf_order) {
-		Entry ent = { .key = i };
-		snprintf(ent.name, sizeof(ent.name), "c%" PRIu64, ent.key);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 1);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
-	{
-		Entry ent = { .key = final };
-		snprintf(ent.name, sizeof(ent.name), "d%" PRIu64, ent.key);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 1);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
+	long branch_order = ed_branch_order();
+	long leaf_order = ed_leaf_order(sizeof(Entry)) - 1;
+	long n = branch_order * leaf_order;
+	long final = 0;
+	fill(&txn, 0, n, 2, 'a', 0);
+	fill(&txn, n-1, 0, -2, 'b', 0);
+	fill(&txn, 0, n, leaf_order, 'c', 1);
+	fill(&txn, final, final+1, 1, 'd', 1);
 
 	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
 
-	for (int i = 0; i < n; i++) {
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+	for (long i = 0; i < n; i++) {
 		Entry *ent;
-		mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
 		mu_assert_int_eq(ed_bpt_find(txn, 0, i, (void **)&ent), 1);
 		char name[64], ch;
 		if (i == final) { ch = 'd'; }
 		else if (i % leaf_order == 0) { ch = 'c'; }
 		else if (i % 2) { ch = 'b'; }
 		else { ch = 'a'; }
-		snprintf(name, sizeof(name), "%c%d", ch, i);
+		snprintf(name, sizeof(name), "%c%ld", ch, i);
 		mu_assert_int_eq(ent->key, i);
 		mu_assert_str_eq(ent->name, name);
-		ed_txn_close(&txn, FRESET);
 	}
+	ed_txn_close(&txn, FRESET);
 
 	finish(&txn);
 }
@@ -519,59 +571,31 @@ test_split_branch_right0(void)
 	setup(&txn);
 
 	// The leaf order is odd, so we'll so this funky business to get a full tree
-	int branch_order = ed_branch_order();
-	int leaf_order = ed_leaf_order(sizeof(Entry)) - 1;
-	int n = branch_order * leaf_order;
-	int final = (branch_order/2) * leaf_order;
-	for (int i = 0; i < n; i += 2) {
-		Entry ent = { .key = i };
-		snprintf(ent.name, sizeof(ent.name), "a%" PRIu64, ent.key);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
-	for (int i = n-1; i > 0; i -= 2) {
-		Entry ent = { .key = i };
-		snprintf(ent.name, sizeof(ent.name), "b%" PRIu64, ent.key);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
-	for (int i = 0; i < n; i += leaf_order) {
-		Entry ent = { .key = i };
-		snprintf(ent.name, sizeof(ent.name), "c%" PRIu64, ent.key);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 1);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
-	{
-		Entry ent = { .key = final };
-		snprintf(ent.name, sizeof(ent.name), "d%" PRIu64, ent.key);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 1);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
+	long branch_order = ed_branch_order();
+	long leaf_order = ed_leaf_order(sizeof(Entry)) - 1;
+	long n = branch_order * leaf_order;
+	long final = (branch_order/2) * leaf_order;
+	fill(&txn, 0, n, 2, 'a', 0);
+	fill(&txn, n-1, 0, -2, 'b', 0);
+	fill(&txn, 0, n, leaf_order, 'c', 1);
+	fill(&txn, final, final+1, 1, 'd', 1);
 
 	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
 
-	for (int i = 0; i < n; i++) {
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+	for (long i = 0; i < n; i++) {
 		Entry *ent;
-		mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
 		mu_assert_int_eq(ed_bpt_find(txn, 0, i, (void **)&ent), 1);
 		char name[64], ch;
 		if (i == final) { ch = 'd'; }
 		else if (i % leaf_order == 0) { ch = 'c'; }
 		else if (i % 2) { ch = 'b'; }
 		else { ch = 'a'; }
-		snprintf(name, sizeof(name), "%c%d", ch, i);
+		snprintf(name, sizeof(name), "%c%ld", ch, i);
 		mu_assert_int_eq(ent->key, i);
 		mu_assert_str_eq(ent->name, name);
-		ed_txn_close(&txn, FRESET);
 	}
+	ed_txn_close(&txn, FRESET);
 
 	finish(&txn);
 }
@@ -586,38 +610,25 @@ test_split_middle_branch(void)
 
 	setup(&txn);
 
-	size_t mid = LARGE / 2;
-	for (size_t i = 0; i <= LARGE; i++) {
-		if (i == mid) { i++; }
-		Entry ent = { .key = i };
-		snprintf(ent.name, sizeof(ent.name), "a%zu", i);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
-
-	{
-		Entry ent = { .key = mid };
-		snprintf(ent.name, sizeof(ent.name), "a%zu", mid);
-		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
-		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
-		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
-		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
-	}
+	// One more entry than a two level tree can hold forces the root to split.
+	long n = ed_bpt_capacity(sizeof(Entry), 2);
+	long mid = n / 2;
+	fill(&txn, 0, mid, 1, 'a', 0);
+	fill(&txn, mid+1, n+1, 1, 'a', 0);
+	fill(&txn, mid, mid+1, 1, 'a', 0);
 
 	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
 
-	for (size_t i = 0; i <= LARGE; i++) {
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+	for (long i = 0; i <= n; i++) {
 		Entry *ent;
-		mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
 		mu_assert_int_eq(ed_bpt_find(txn, 0, i, (void **)&ent), 1);
 		char name[64];
-		snprintf(name, sizeof(name), "a%zu", i);
+		snprintf(name, sizeof(name), "a%ld", i);
 		mu_assert_int_eq(ent->key, i);
 		mu_assert_str_eq(ent->name, name);
-		ed_txn_close(&txn, FRESET);
 	}
+	ed_txn_close(&txn, FRESET);
 
 	finish(&txn);
 }
@@ -760,6 +771,164 @@ test_remove_large(void)
 	finish(&txn);
 }
 
+static int
+tree_depth(int fd, EdPgno no)
+{
+	int depth = 0;
+	while (no != ED_PG_NONE) {
+		EdBpt *bt = NULL;
+		if (ed_pg_load(fd, (EdPg **)&bt, no, true) == MAP_FAILED) {
+			return ED_ERRNO;
+		}
+		depth++;
+		no = bt->base.type == ED_PG_BRANCH ? ed_fetch32(bt->data) : ED_PG_NONE;
+		ed_pg_unload((EdPg **)&bt);
+	}
+	return depth;
+}
+
+static void
+test_remove_rebalance(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+	Entry *ent;
+
+	setup(&txn);
+
+	for (unsigned seed = 0, i = 0; i < LARGE; i++) {
+		Entry ent = { .key = get_random(&seed) };
+		snprintf(ent.name, sizeof(ent.name), "a%u", i);
+		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
+		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
+		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+	}
+
+	int depth = tree_depth(idx.fd, idx.hdr->tree[0]);
+	mu_assert_int_gt(depth, 1);
+
+	// Delete all but every 100th entry while iterating. The cursor must stay
+	// in order as the leaves and branches are merged around it.
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	mu_assert_int_eq(ed_bpt_first(txn, 0, (void **)&ent), 0);
+	uint64_t last = ent->key;
+	for (int i = 1; i <= LARGE; i++) {
+		if (i % 100 != 1) {
+			mu_assert_int_eq(ed_bpt_del(txn, 0), 1);
+		}
+		mu_assert_int_eq(ed_bpt_next(txn, 0, (void **)&ent), 0);
+		if (i < LARGE) {
+			mu_assert_uint_lt(last, ent->key);
+			last = ent->key;
+		}
+	}
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
+	mu_assert_int_eq(tree_depth(idx.fd, idx.hdr->tree[0]), depth - 1);
+
+	int n = 0;
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+	mu_assert_int_eq(ed_bpt_first(txn, 0, NULL), 0);
+	for (; ed_bpt_loop(txn, 0) == 0; n++) {
+		mu_assert_int_eq(ed_bpt_next(txn, 0, NULL), 0);
+	}
+	ed_txn_close(&txn, FRESET);
+	mu_assert_int_eq(n, LARGE/100);
+
+	// Removing the rest collapses the tree to an empty root leaf.
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	mu_assert_int_eq(ed_bpt_first(txn, 0, NULL), 0);
+	for (int i = 0; i < n; i++) {
+		mu_assert_int_eq(ed_bpt_del(txn, 0), 1);
+		mu_assert_int_eq(ed_bpt_next(txn, 0, NULL), 0);
+	}
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
+	mu_assert_int_eq(tree_depth(idx.fd, idx.hdr->tree[0]), 1);
+
+	for (unsigned seed = 0, i = 0; i < LARGE; i++) {
+		int key = get_random(&seed);
+		mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+		mu_assert_int_eq(ed_bpt_find(txn, 0, key, NULL), 0);
+		ed_txn_close(&txn, FRESET);
+	}
+
+	finish(&txn);
+}
+
+static void
+test_load(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+	Entry *ent;
+
+	setup(&txn);
+
+	// Every third key is repeated to check that runs are kept within a leaf.
+	static Entry ents[LARGE];
+	size_t n = 0;
+	for (unsigned i = 0; n < LARGE; i++) {
+		for (unsigned k = 0; k < (i%3 == 0 ? 3 : 1) && n < LARGE; k++, n++) {
+			ents[n].key = (uint64_t)i * 10;
+			snprintf(ents[n].name, sizeof(ents[n].name), "a%zu", n);
+		}
+	}
+
+	EdPgno root;
+	EdTxnId xid = idx.hdr->xid + 1;
+	mu_assert_int_eq(ed_bpt_load(&idx, xid, ents, n, sizeof(Entry), &root), 0);
+	idx.hdr->tree[0] = root;
+	idx.hdr->xid = xid;
+
+	// The loaded leaves are packed, so the tree is as shallow as it can be.
+	int depth = 1;
+	while (ed_bpt_capacity(sizeof(Entry), depth) < n) { depth++; }
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
+	mu_assert_int_eq(tree_depth(idx.fd, idx.hdr->tree[0]), depth);
+
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY|FOPEN), 0);
+	mu_assert_int_eq(ed_bpt_first(txn, 0, (void **)&ent), 0);
+	for (size_t i = 0; i < n; i++) {
+		mu_assert_uint_eq(ent->key, ents[i].key);
+		mu_assert_str_eq(ent->name, ents[i].name);
+		mu_assert_int_eq(ed_bpt_next(txn, 0, (void **)&ent), 0);
+	}
+	for (size_t i = 0; i < n; i++) {
+		mu_assert_int_eq(ed_bpt_find(txn, 0, ents[i].key, (void **)&ent), 1);
+		mu_assert_uint_eq(ent->key, ents[i].key);
+	}
+	ed_txn_close(&txn, FRESET);
+
+	// Packed leaves are split when inserting between the loaded keys.
+	for (unsigned i = 0; i < SMALL; i++) {
+		Entry e = { .key = (uint64_t)i * 10 + 5 };
+		snprintf(e.name, sizeof(e.name), "b%u", i);
+		mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+		mu_assert_int_eq(ed_bpt_find(txn, 0, e.key, NULL), 0);
+		mu_assert_int_eq(ed_bpt_set(txn, 0, &e, false), 0);
+		mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+	}
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
+
+	// More repeats of one key than fit in a leaf cannot be loaded.
+	size_t dups = ed_leaf_order(sizeof(Entry)) + 1;
+	for (size_t i = 0; i < dups; i++) {
+		ents[i].key = 1;
+	}
+	mu_assert_int_eq(ed_bpt_load(&idx, xid, ents, dups, sizeof(Entry), &root),
+			ED_EINDEX_DUPKEY);
+
+	finish(&txn);
+}
+
 static void
 test_multi(void)
 {
@@ -1116,6 +1285,18 @@ compare_key(const void *a, const void *b)
 	return 0;
 }
 
+/**
+ * Gets the key range maximum expected for a key that sorts just before #next.
+ * This is #next within the same leaf, but when #next begins the following leaf
+ * the maximum comes from the branch key instead.
+ */
+static uint64_t
+range_max(EdTxn *txn, uint64_t next)
+{
+	mu_assert_int_eq(ed_bpt_find(txn, 0, next, NULL), 1);
+	return txn->db[0].entry_index == 0 ? next - 1 : next;
+}
+
 static void
 test_key_range(void)
 {
@@ -1220,11 +1401,12 @@ test_key_range_set(void)
 
 	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
 	{
+		uint64_t kmax = range_max(txn, 738826);
 		Entry ent = { .key = 728500 };
 		snprintf(ent.name, sizeof(ent.name), "a%u", i++);
 		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
 		mu_assert_uint_eq(txn->db[0].kmin, 728458);
-		mu_assert_uint_eq(txn->db[0].kmax, 738825);
+		mu_assert_uint_eq(txn->db[0].kmax, kmax);
 		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
 		mu_assert_uint_eq(txn->db[0].kmin, 728458);
 		mu_assert_uint_eq(txn->db[0].kmax, ent.key);
@@ -1332,6 +1514,7 @@ test_key_range_del(void)
 
 	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
 	{
+		uint64_t kmax = range_max(txn, 738826);
 		Entry ent = { .key = 728458 };
 		snprintf(ent.name, sizeof(ent.name), "a%u", i++);
 		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 1);
@@ -1339,7 +1522,7 @@ test_key_range_del(void)
 		mu_assert_uint_eq(txn->db[0].kmax, 728458);
 		mu_assert_int_eq(ed_bpt_del(txn, 0), 1);
 		mu_assert_uint_eq(txn->db[0].kmin, 723841);
-		mu_assert_uint_eq(txn->db[0].kmax, 738825);
+		mu_assert_uint_eq(txn->db[0].kmax, kmax);
 	}
 	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
 
@@ -1456,6 +1639,77 @@ test_no_find(void)
 	finish(&txn);
 }
 
+static int
+cmp_key(const void *a, const void *b)
+{
+	uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+	return ka < kb ? -1 : ka > kb;
+}
+
+static void
+test_seek(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+	setup(&txn);
+
+	uint64_t keys[5000];
+
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	for (unsigned seed = 0, i = 0; i < ed_len(keys); i++) {
+		Entry ent = { .key = get_random(&seed) };
+		snprintf(ent.name, sizeof(ent.name), "a%" PRIu64, ent.key);
+		mu_assert_int_eq(ed_bpt_find(txn, 0, ent.key, NULL), 0);
+		mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
+		keys[i] = ent.key;
+	}
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
+
+	qsort(keys, ed_len(keys), sizeof(keys[0]), cmp_key);
+
+	// Seeking in key order must give the same position as a full find.
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN|ED_FRDONLY), 0);
+	for (unsigned i = 0; i < ed_len(keys); i++) {
+		Entry *ent, *fent;
+		for (uint64_t key = keys[i] ? keys[i] - 1 : 0; key <= keys[i]; key++) {
+			int rc = ed_bpt_seek(txn, 0, key, (void **)&ent);
+			EdNode *find = txn->db[0].find;
+			uint64_t kmin = txn->db[0].kmin, kmax = txn->db[0].kmax;
+			int nsplits = txn->db[0].nsplits;
+
+			mu_assert_int_eq(ed_bpt_find(txn, 0, key, (void **)&fent), rc);
+			mu_assert_ptr_eq(ent, fent);
+			mu_assert_ptr_eq(find->tree, txn->db[0].find->tree);
+			mu_assert_uint_eq(kmin, txn->db[0].kmin);
+			mu_assert_uint_eq(kmax, txn->db[0].kmax);
+			mu_assert_int_eq(nsplits, txn->db[0].nsplits);
+		}
+		char name[64];
+		snprintf(name, sizeof(name), "a%" PRIu64, keys[i]);
+		mu_assert_str_eq(ent->name, name);
+	}
+	ed_txn_close(&txn, FRESET);
+
+	// Inserting must invalidate the remembered leaf.
+	mu_assert_int_eq(ed_txn_open(txn, FOPEN), 0);
+	for (unsigned i = 0; i < ed_len(keys); i += 10) {
+		Entry ent = { .key = keys[i] + 1 };
+		snprintf(ent.name, sizeof(ent.name), "b%" PRIu64, ent.key);
+		if (ed_bpt_seek(txn, 0, ent.key, NULL) == 0) {
+			mu_assert_int_eq(ed_bpt_set(txn, 0, &ent, false), 0);
+		}
+	}
+	mu_assert_int_eq(ed_txn_commit(&txn, FRESET), 0);
+
+	mu_assert_int_eq(verify_tree(idx.fd, idx.hdr->tree[0], true), 0);
+
+	finish(&txn);
+}
+
 int
 main(void)
 {
@@ -1470,6 +1724,7 @@ main(void)
 	close(fd);
 
 	mu_run(test_capacity);
+	mu_run(test_key_count);
 	mu_run(test_basic);
 	mu_run(test_repeat);
 	mu_run(test_large);
@@ -1482,6 +1737,8 @@ main(void)
 	mu_run(test_split_middle_branch);
 	mu_run(test_remove_small);
 	mu_run(test_remove_large);
+	mu_run(test_remove_rebalance);
+	mu_run(test_load);
 	mu_run(test_multi);
 	mu_run(test_iter);
 	mu_run(test_iter_reverse);
@@ -1492,6 +1749,7 @@ main(void)
 	mu_run(test_key_range_set_less);
 	mu_run(test_key_range_del);
 	mu_run(test_no_find);
+	mu_run(test_seek);
 	return 0;
 }
 
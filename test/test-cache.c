@@ -17,6 +17,22 @@ cleanup(void)
 #endif
 }
 
+static size_t
+count_entries(EdCache *cache, unsigned db)
+{
+	EdTxn *txn = cache->txn;
+	void *ent;
+	size_t n = 0;
+	mu_assert_int_eq(ed_txn_open(txn, ED_FRDONLY), 0);
+	for (int rc = ed_bpt_first(txn, db, &ent);
+			rc >= 0 && ent != NULL && ed_bpt_loop(txn, db) == 0;
+			rc = ed_bpt_next(txn, db, &ent)) {
+		n++;
+	}
+	ed_txn_close(&cache->txn, ED_FRESET);
+	return n;
+}
+
 static void
 test_create(void)
 {
@@ -48,11 +64,922 @@ test_create(void)
 	ed_cache_close(&cache);
 }
 
+static void
+test_create_many(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	EdObject *obj = NULL;
+	EdObjectAttr base = { .datalen = 4, .key = "base", .keylen = 4 };
+	mu_assert_int_eq(ed_create(cache, &obj, &base), 0);
+	mu_assert_int_eq(ed_write(obj, "base", 4), 4);
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	// Holding more writers open than the lock table has entries for falls back
+	// to file locks for the rest.
+	EdObject *objs[ED_RLCK_WRITERS + 16];
+	char key[32];
+	int klen;
+	for (size_t i = 0; i < ed_len(objs); i++) {
+		klen = snprintf(key, sizeof(key), "create-%zu", i);
+		EdObjectAttr attr = { .datalen = klen, .key = key, .keylen = klen };
+		objs[i] = NULL;
+		rc = ed_create(cache, &objs[i], &attr);
+		mu_assert_msg(rc == 0, "failed to create %s: %s\n", key, ed_strerror(rc));
+		mu_assert_int_eq(ed_write(objs[i], key, klen), klen);
+	}
+	mu_assert_uint_eq(ed_idx_rlck(&cache->idx)->nwflck, ed_len(objs) - ED_RLCK_WRITERS);
+
+	// Readers check the file locks while any writer holds one.
+	size_t len;
+	mu_assert_int_eq(ed_open(cache, &obj, "base", 4, 0), 1);
+	mu_assert_int_eq(memcmp(ed_value(obj, &len), "base", 4), 0);
+	ed_close(&obj);
+
+	for (size_t i = 0; i < ed_len(objs); i++) {
+		mu_assert_int_eq(ed_close(&objs[i]), 0);
+	}
+	mu_assert_uint_eq(ed_idx_rlck(&cache->idx)->nwriters, 0);
+	mu_assert_uint_eq(ed_idx_rlck(&cache->idx)->nwflck, 0);
+
+	mu_assert_int_eq(ed_open(cache, &obj, key, klen, 0), 1);
+	const void *data = ed_value(obj, &len);
+	mu_assert_int_eq(len, klen);
+	mu_assert_int_eq(memcmp(data, key, len), 0);
+	ed_close(&obj);
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_send(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	char data[3000], buf[3000];
+	for (size_t i = 0; i < sizeof(data); i++) {
+		data[i] = 'a' + (i % 26);
+	}
+
+	EdObject *obj = NULL;
+	EdObjectAttr attr = {
+		.datalen = sizeof(data),
+		.key = "bar",
+		.keylen = 3,
+		.meta = "meta",
+		.metalen = 4,
+	};
+
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+	mu_assert_int_eq(ed_sendfile(obj, STDOUT_FILENO, 1), ED_EOBJECT_WRONLY);
+	mu_assert_int_eq(ed_write(obj, data, sizeof(data)), sizeof(data));
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	int p[2];
+	mu_assert_int_eq(pipe(p), 0);
+
+	mu_assert_int_eq(ed_open(cache, &obj, "bar", 3, 0), 1);
+	mu_assert_int_eq(ed_sendfile(obj, p[1], 1000), 1000);
+	mu_assert_int_eq(ed_sendfile(obj, p[1], SIZE_MAX), sizeof(data) - 1000);
+	mu_assert_int_eq(ed_sendfile(obj, p[1], SIZE_MAX), 0);
+	ed_close(&obj);
+
+	mu_assert_int_eq(read(p[0], buf, sizeof(buf)), sizeof(buf));
+	mu_assert_int_eq(memcmp(data, buf, sizeof(buf)), 0);
+
+	mu_assert_int_eq(ed_open(cache, &obj, "bar", 3, 0), 1);
+	mu_assert_int_eq(ed_splice(obj, p[1], 2000), 2000);
+	mu_assert_int_eq(ed_splice(obj, p[1], SIZE_MAX), sizeof(data) - 2000);
+	mu_assert_int_eq(ed_splice(obj, p[1], SIZE_MAX), 0);
+	ed_close(&obj);
+
+	mu_assert_int_eq(read(p[0], buf, sizeof(buf)), sizeof(buf));
+	mu_assert_int_eq(memcmp(data, buf, sizeof(buf)), 0);
+
+	close(p[0]);
+	close(p[1]);
+	ed_cache_close(&cache);
+}
+
+static void
+test_read(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	static char meta[5000], data[10000], buf[10000];
+	for (size_t i = 0; i < sizeof(meta); i++) { meta[i] = 'A' + (i % 26); }
+	for (size_t i = 0; i < sizeof(data); i++) { data[i] = 'a' + (i % 26); }
+
+	EdObject *obj = NULL;
+	EdObjectAttr attr = {
+		.datalen = sizeof(data),
+		.key = "baz",
+		.keylen = 3,
+		.meta = meta,
+		.metalen = sizeof(meta),
+	};
+
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+	mu_assert_int_eq(ed_read(obj, buf, 1, 0), ED_EOBJECT_WRONLY);
+	mu_assert_int_eq(ed_write(obj, data, sizeof(data)), sizeof(data));
+	mu_assert_int_eq(ed_close(&obj), 0);
+
+	for (int oflags = 0; oflags <= ED_ONOMAP; oflags += ED_ONOMAP) {
+		size_t len;
+		mu_assert_int_eq(ed_open(cache, &obj, "baz", 3, oflags), 1);
+		if (oflags & ED_ONOMAP) {
+			mu_assert_ptr_eq(ed_value(obj, &len), NULL);
+		}
+		const void *m = ed_meta(obj, &len);
+		mu_assert_int_eq(len, sizeof(meta));
+		mu_assert_int_eq(memcmp(m, meta, len), 0);
+
+		memset(buf, 0, sizeof(buf));
+		mu_assert_int_eq(ed_read(obj, buf, 100, 0), 100);
+		mu_assert_int_eq(ed_read(obj, buf+100, sizeof(buf), 100), sizeof(data) - 100);
+		mu_assert_int_eq(ed_read(obj, buf, sizeof(buf), sizeof(data)), 0);
+		mu_assert_int_eq(memcmp(buf, data, sizeof(data)), 0);
+		mu_assert_int_eq(ed_read(obj, buf, 10, 9995), 5);
+		mu_assert_int_eq(memcmp(buf, data + 9995, 5), 0);
+		ed_close(&obj);
+	}
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_map(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig mcfg = cfg;
+	mcfg.flags |= ED_FMAPINDEX|ED_FMAPSLAB;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &mcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert(cache->idx.flags & ED_FMAPINDEX);
+	mu_assert(cache->idx.flags & ED_FMAPSLAB);
+
+	for (int i = 0; i < 2000; i++) {
+		char key[32], val[64];
+		int klen = snprintf(key, sizeof(key), "key-%d", i);
+		int vlen = snprintf(val, sizeof(val), "value-%d", i);
+		EdObject *obj = NULL;
+		EdObjectAttr attr = {
+			.datalen = vlen,
+			.key = key,
+			.keylen = klen,
+		};
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+		mu_assert_int_eq(ed_write(obj, val, vlen), vlen);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+
+	ed_cache_close(&cache);
+
+	rc = ed_cache_open(&cache, &mcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	for (int i = 0; i < 2000; i++) {
+		char key[32], val[64];
+		int klen = snprintf(key, sizeof(key), "key-%d", i);
+		int vlen = snprintf(val, sizeof(val), "value-%d", i);
+		EdObject *obj = NULL;
+		size_t len;
+		mu_assert_int_eq(ed_open(cache, &obj, key, klen, 0), 1);
+		const void *data = ed_value(obj, &len);
+		mu_assert_int_eq(len, vlen);
+		mu_assert_int_eq(memcmp(data, val, len), 0);
+		ed_close(&obj);
+	}
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_batch(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	char keys[500][32];
+	EdObjectAttr attrs[500];
+	for (int i = 0; i < (int)ed_len(attrs); i++) {
+		attrs[i] = ed_object_attr_make();
+		attrs[i].key = keys[i];
+		attrs[i].keylen = snprintf(keys[i], sizeof(keys[i]), "batch-%d", i);
+		attrs[i].meta = "meta";
+		attrs[i].metalen = 4;
+		attrs[i].datalen = attrs[i].keylen * (i%3 + 1);
+	}
+
+	EdTxnId xid = cache->idx.hdr->xid;
+	EdBatch *batch = NULL;
+	mu_assert_int_eq(ed_batch_begin(cache, &batch, attrs, ed_len(attrs)), 0);
+
+	EdObject *obj;
+	for (int i = 0; ed_batch_create(batch, &obj) == 1; i++) {
+		if (i == 0) {
+			// The batch cannot be committed while an object is still open.
+			mu_assert_int_eq(ed_batch_commit(&batch), ed_esys(EBUSY));
+			mu_assert_ptr_ne(batch, NULL);
+		}
+		if (i == 10) {
+			ed_discard(&obj);
+			continue;
+		}
+		for (int j = 0; j < i%3 + 1; j++) {
+			mu_assert_int_eq(ed_write(obj, keys[i], attrs[i].keylen), attrs[i].keylen);
+		}
+		if (i != 20) {
+			mu_assert_int_eq(ed_set_ttl(obj, 100), 0);
+		}
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+	mu_assert_ptr_eq(obj, NULL);
+
+	// The reservation and the inserts are one transaction each.
+	mu_assert_int_eq(ed_batch_commit(&batch), ed_len(attrs) - 1);
+	mu_assert_ptr_eq(batch, NULL);
+	mu_assert_int_eq(cache->idx.hdr->xid, xid + 2);
+
+	for (int i = 0; i < (int)ed_len(attrs); i++) {
+		rc = ed_open(cache, &obj, keys[i], attrs[i].keylen, 0);
+		if (i == 10) {
+			mu_assert_int_eq(rc, 0);
+			continue;
+		}
+		mu_assert_int_eq(rc, 1);
+
+		size_t len;
+		const uint8_t *data = ed_value(obj, &len);
+		mu_assert_int_eq(len, attrs[i].datalen);
+		mu_assert_int_eq(memcmp(data, keys[i], attrs[i].keylen), 0);
+		mu_assert_int_eq(memcmp(ed_meta(obj, &len), "meta", 4), 0);
+		if (i == 20) {
+			mu_assert_int_eq(ed_expiry(obj), -1);
+		}
+		else {
+			mu_assert_int_gt(ed_expiry(obj), 0);
+		}
+		ed_close(&obj);
+	}
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_open_many(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	for (int i = 0; i < 1000; i += 2) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "many-%d", i);
+		EdObject *obj = NULL;
+		EdObjectAttr attr = {
+			.datalen = klen,
+			.key = key,
+			.keylen = klen,
+		};
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+		mu_assert_int_eq(ed_write(obj, key, klen), klen);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+
+	// Every other key is missing, and the last key repeats the first.
+	char keybuf[101][32];
+	const void *keys[101];
+	size_t lens[101];
+	EdObject *objs[101];
+	for (int i = 0; i < 100; i++) {
+		lens[i] = snprintf(keybuf[i], sizeof(keybuf[i]), "many-%d", i*7 % 1000);
+		keys[i] = keybuf[i];
+	}
+	keys[100] = keys[0];
+	lens[100] = lens[0];
+
+	mu_assert_int_eq(ed_open_many(cache, objs, keys, lens, 101, 0), 51);
+
+	for (int i = 0; i < 101; i++) {
+		EdObject *obj = NULL;
+		rc = ed_open(cache, &obj, keys[i], lens[i], 0);
+		if (rc == 0) {
+			mu_assert_ptr_eq(objs[i], NULL);
+			continue;
+		}
+		mu_assert_int_eq(rc, 1);
+		mu_assert_ptr_ne(objs[i], NULL);
+		mu_assert_str_eq(ed_id(objs[i]), ed_id(obj));
+
+		size_t len;
+		const void *data = ed_value(objs[i], &len);
+		mu_assert_int_eq(len, lens[i]);
+		mu_assert_int_eq(memcmp(data, keys[i], len), 0);
+		ed_close(&obj);
+		ed_close(&objs[i]);
+	}
+
+	ed_cache_close(&cache);
+}
+
+static void *
+open_thread(void *cache)
+{
+	intptr_t failed = 0;
+	for (int i = 0; i < 2000; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "thread-%d", i % 64);
+		EdObject *obj = NULL;
+		if (ed_open(cache, &obj, key, klen, 0) != 1) {
+			failed++;
+			continue;
+		}
+		size_t len;
+		const void *data = ed_value(obj, &len);
+		if (len != (size_t)klen || memcmp(data, key, len) != 0) { failed++; }
+		ed_close(&obj);
+	}
+	return (void *)failed;
+}
+
+static void
+test_open_threads(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	for (int i = 0; i < 64; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "thread-%d", i);
+		EdObject *obj = NULL;
+		EdObjectAttr attr = {
+			.datalen = klen,
+			.key = key,
+			.keylen = klen,
+		};
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+		mu_assert_int_eq(ed_write(obj, key, klen), klen);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+
+	// More threads than the connection has reader slots share the one handle.
+	// Past the pool, threads take their own transactions, and past the reader
+	// slots they wait for a release.
+	pthread_t threads[ED_CONN_READERS + 16];
+	for (size_t i = 0; i < ed_len(threads); i++) {
+		mu_assert_int_eq(pthread_create(&threads[i], NULL, open_thread, cache), 0);
+	}
+	for (size_t i = 0; i < ed_len(threads); i++) {
+		void *failed;
+		mu_assert_int_eq(pthread_join(threads[i], &failed), 0);
+		mu_assert_int_eq((intptr_t)failed, 0);
+	}
+	mu_assert_uint_eq(cache->rbusy, 0);
+	mu_assert_uint_eq(cache->rwaiters, 0);
+	mu_assert_int_le(__builtin_popcount(cache->idx.conn->rmask), ED_CACHE_READERS);
+
+	ed_cache_close(&cache);
+}
+
+static void
+group_sync_write(const EdConfig *gcfg, int id)
+{
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, gcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	for (int i = 0; i < 100; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "key-%d-%d", id, i);
+		EdObject *obj = NULL;
+		EdObjectAttr attr = {
+			.datalen = klen,
+			.key = key,
+			.keylen = klen,
+		};
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+		mu_assert_int_eq(ed_write(obj, key, klen), klen);
+		mu_assert_int_eq(ed_close(&obj), 0);
+		mu_assert(cache->idx.hdr->sync_xid > 0);
+	}
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_direct(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig dcfg = cfg;
+	dcfg.flags |= ED_FDIRECT;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &dcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	if (!(cache->idx.flags & ED_FDIRECT)) {
+		fprintf(stderr, "O_DIRECT is not available, testing the mapped fallback\n");
+	}
+
+	// Sizes cover the head buffer alone, and data spanning several tail fills.
+	static const size_t sizes[] = { 100, 5000, 3*1024*1024 + 777 };
+	uint8_t *buf = malloc(sizes[ed_len(sizes)-1]);
+	mu_assert_ptr_ne(buf, NULL);
+
+	for (size_t i = 0; i < ed_len(sizes); i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "direct-%zu", i);
+		for (size_t j = 0; j < sizes[i]; j++) {
+			buf[j] = (uint8_t)(j * 7 + i);
+		}
+
+		EdObject *obj = NULL;
+		EdObjectAttr attr = {
+			.datalen = sizes[i],
+			.key = key,
+			.keylen = klen,
+			.meta = "meta",
+			.metalen = 4,
+		};
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+		for (size_t off = 0; off < sizes[i]; ) {
+			size_t len = sizes[i] - off < 7001 ? sizes[i] - off : 7001;
+			mu_assert_int_eq(ed_write(obj, buf + off, len), len);
+			off += len;
+		}
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+
+	// A discarded object is never indexed.
+	EdObject *obj = NULL;
+	EdObjectAttr attr = { .datalen = 10, .key = "discard", .keylen = 7 };
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+	mu_assert_int_eq(ed_write(obj, buf, 5), 5);
+	ed_discard(&obj);
+	mu_assert_int_eq(ed_open(cache, &obj, "discard", 7, 0), 0);
+
+	for (size_t i = 0; i < ed_len(sizes); i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "direct-%zu", i);
+
+		// Opening with a mapping verifies the checksums.
+		mu_assert_int_eq(ed_open(cache, &obj, key, klen, 0), 1);
+		size_t len;
+		const uint8_t *data = ed_value(obj, &len);
+		mu_assert_int_eq(len, sizes[i]);
+		for (size_t j = 0; j < len; j++) {
+			if (data[j] != (uint8_t)(j * 7 + i)) {
+				mu_fail("invalid byte at %zu", j);
+			}
+		}
+		const void *meta = ed_meta(obj, &len);
+		mu_assert_int_eq(len, 4);
+		mu_assert_int_eq(memcmp(meta, "meta", 4), 0);
+		ed_close(&obj);
+	}
+
+	free(buf);
+	ed_cache_close(&cache);
+}
+
+static void
+test_wrap(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	// Objects of three blocks do not divide the slab evenly, so each lap ends
+	// with an object that wraps around to the start.
+	EdConfig wcfg = cfg;
+	wcfg.slab_path = "./test/tmp/slab-wrap";
+	wcfg.slab_size = 1024*1024;
+	wcfg.flags |= ED_FREPLACE;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &wcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	const size_t slab_size = (size_t)cache->slab_block_count * cache->slab_block_size;
+	const int nobjs = 200, nkeep = 80;
+	uint8_t buf[10000];
+
+	for (int i = 0; i < nobjs; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "wrap-%d", i);
+		memset(buf, 'a' + i%26, sizeof(buf));
+		EdObject *obj = NULL;
+		EdObjectAttr attr = { .datalen = sizeof(buf), .key = key, .keylen = klen };
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+		mu_assert_int_eq(ed_write(obj, buf, sizeof(buf)), sizeof(buf));
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+
+	// The oldest objects have been replaced, and everything written in the last
+	// lap of the ring is readable whether or not it wraps.
+	EdObject *obj = NULL;
+	mu_assert_int_eq(ed_open(cache, &obj, "wrap-0", 6, 0), 0);
+
+	int nwrapped = 0;
+	for (int i = nobjs - nkeep; i < nobjs; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "wrap-%d", i);
+
+		mu_assert_int_eq(ed_open(cache, &obj, key, klen, 0), 1);
+		if (obj->byte + obj->nbytes > slab_size) { nwrapped++; }
+		size_t len;
+		const uint8_t *data = ed_value(obj, &len);
+		mu_assert_int_eq(len, sizeof(buf));
+		for (size_t j = 0; j < len; j++) {
+			if (data[j] != 'a' + i%26) {
+				mu_fail("invalid byte in %s at %zu", key, j);
+			}
+		}
+		ed_close(&obj);
+
+		// Reads return the full length with and without a mapping.
+		int modes[] = { 0, ED_ONOMAP };
+		for (size_t m = 0; m < ed_len(modes); m++) {
+			mu_assert_int_eq(ed_open(cache, &obj, key, klen, modes[m]), 1);
+			memset(buf, 0, sizeof(buf));
+			mu_assert_int_eq(ed_read(obj, buf, sizeof(buf), 0), sizeof(buf));
+			for (size_t j = 0; j < sizeof(buf); j++) {
+				if (buf[j] != 'a' + i%26) {
+					mu_fail("invalid byte read in %s at %zu", key, j);
+				}
+			}
+			ed_close(&obj);
+		}
+	}
+	mu_assert_int_gt(nwrapped, 0);
+
+	// Every overwritten object took its key with it.
+	mu_assert_uint_eq(count_entries(cache, ED_DB_KEYS), count_entries(cache, ED_DB_BLOCKS));
+
+	ed_cache_close(&cache);
+	unlink(wcfg.slab_path);
+}
+
+static void
+test_group_sync(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdConfig gcfg = cfg;
+	gcfg.flags = (gcfg.flags & ~ED_FNOSYNC) | ED_FGROUPSYNC;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &gcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_int_eq(cache->idx.hdr->sync_xid, 0);
+
+	pid_t pids[3];
+	for (int i = 0; i < (int)ed_len(pids); i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			mu_fail("fork failed '%s'\n", strerror(errno));
+		}
+		if (pids[i] == 0) {
+			group_sync_write(&gcfg, i+1);
+			exit(0);
+		}
+	}
+	group_sync_write(&gcfg, 0);
+
+	for (int i = 0; i < (int)ed_len(pids); i++) {
+		int status;
+		mu_assert_call(waitpid(pids[i], &status, 0));
+		mu_assert_int_eq(WEXITSTATUS(status), 0);
+		mu_assert_int_eq(WTERMSIG(status), 0);
+	}
+
+	// Every commit must be covered by a sync once all writers have returned.
+	mu_assert_int_eq(cache->idx.hdr->sync_xid, cache->idx.hdr->xid);
+
+	for (int id = 0; id <= (int)ed_len(pids); id++) {
+		for (int i = 0; i < 100; i++) {
+			char key[32];
+			int klen = snprintf(key, sizeof(key), "key-%d-%d", id, i);
+			EdObject *obj = NULL;
+			mu_assert_int_eq(ed_open(cache, &obj, key, klen, 0), 1);
+			ed_close(&obj);
+		}
+	}
+
+	ed_cache_close(&cache);
+}
+
+static void
+test_rebuild(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	// Old versions are not expired when replaced, so the rebuild must pick the
+	// newest version of each key by itself. The ring also wraps a few times so
+	// that partially overwritten objects are left in the slab.
+	EdConfig rcfg = cfg;
+	rcfg.slab_path = "./test/tmp/slab-rebuild";
+	rcfg.slab_size = 1024*1024;
+	rcfg.flags |= ED_FREPLACE|ED_FKEEPOLD;
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &rcfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	const int nobjs = 200, nkeys = 40;
+	uint8_t buf[10000];
+	char id[sizeof(((EdObject *)0)->id)];
+
+	for (int i = 0; i < nobjs; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "rebuild-%d", i%nkeys);
+		memset(buf, 'a' + i%26, sizeof(buf));
+		EdObject *obj = NULL;
+		EdObjectAttr attr = { .datalen = sizeof(buf), .key = key, .keylen = klen };
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+		mu_assert_int_eq(ed_write(obj, buf, sizeof(buf)), sizeof(buf));
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+
+	// Each replacement is matched by the key entry alone, leaving one entry
+	// per key.
+	mu_assert_uint_eq(count_entries(cache, ED_DB_KEYS), nkeys);
+
+	EdObject *obj = NULL;
+	mu_assert_int_eq(ed_open(cache, &obj, "rebuild-0", 9, 0), 1);
+	memcpy(id, obj->id, sizeof(id));
+	ed_close(&obj);
+
+	EdTxnId xid = cache->idx.hdr->xid;
+	EdBlkno vno = cache->idx.hdr->vno;
+	ed_cache_close(&cache);
+
+	rcfg.flags = (rcfg.flags & ~ED_FREPLACE) | ED_FREPAIR;
+	rc = ed_cache_open(&cache, &rcfg);
+	mu_assert_msg(rc >= 0, "failed to rebuild cache: %s\n", ed_strerror(rc));
+	mu_assert_uint_eq(cache->idx.hdr->vno, vno);
+	mu_assert_uint_gt(cache->idx.hdr->xid, xid);
+	mu_assert_uint_eq(count_entries(cache, ED_DB_KEYS), nkeys);
+
+	for (int i = nobjs - nkeys; i < nobjs; i++) {
+		char key[32];
+		int klen = snprintf(key, sizeof(key), "rebuild-%d", i%nkeys);
+		mu_assert_int_eq(ed_open(cache, &obj, key, klen, 0), 1);
+		size_t len;
+		const uint8_t *data = ed_value(obj, &len);
+		mu_assert_int_eq(len, sizeof(buf));
+		for (size_t j = 0; j < len; j++) {
+			if (data[j] != 'a' + i%26) {
+				mu_fail("invalid byte in %s at %zu", key, j);
+			}
+		}
+		ed_close(&obj);
+	}
+
+	mu_assert_int_eq(ed_open(cache, &obj, id, strlen(id), ED_OID), 1);
+	ed_close(&obj);
+
+	// The rebuilt trees accept new entries.
+	memset(buf, 'z', sizeof(buf));
+	EdObjectAttr attr = { .datalen = sizeof(buf), .key = "rebuild-0", .keylen = 9 };
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+	mu_assert_int_eq(ed_write(obj, buf, sizeof(buf)), sizeof(buf));
+	mu_assert_int_eq(ed_close(&obj), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "rebuild-0", 9, 0), 1);
+	mu_assert_int_eq(obj->data[0], 'z');
+	ed_close(&obj);
+	mu_assert_uint_eq(count_entries(cache, ED_DB_KEYS), nkeys);
+
+	ed_cache_close(&cache);
+	unlink(rcfg.slab_path);
+}
+
+static void
+purge_put(EdCache *cache, int i, EdTimeUnix now)
+{
+	char key[32];
+	int klen = snprintf(key, sizeof(key), "purge-%d", i);
+	EdObject *obj = NULL;
+	uint8_t buf[100] = { 0 };
+	EdObjectAttr attr = { .datalen = sizeof(buf), .key = key, .keylen = klen };
+	mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+	mu_assert_int_eq(ed_write(obj, buf, sizeof(buf)), sizeof(buf));
+	switch (i%3) {
+	case 0: mu_assert_int_eq(ed_set_expiry(obj, now), 0); break;
+	case 1: mu_assert_int_eq(ed_set_ttl(obj, 1000), 0); break;
+	}
+	mu_assert_int_eq(ed_close(&obj), 0);
+}
+
+static void
+test_purge(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+
+	// A third of the objects expire right away, a third have a ttl, and the
+	// rest never expire and are left out of the expiry tree.
+	EdTimeUnix now = ed_now_unix();
+	for (int i = 0; i < 30; i++) {
+		purge_put(cache, i, now);
+	}
+	mu_assert_uint_eq(count_entries(cache, ED_DB_KEYS), 30);
+	mu_assert_uint_eq(count_entries(cache, ED_DB_EXPIRY), 20);
+
+	// Removing a key moves its expiry entry, and replacing a key drops the
+	// entry for the old version.
+	mu_assert_int_eq(ed_update_ttl(cache, "purge-1", 7, 0, false), 1);
+	purge_put(cache, 4, now);
+	purge_put(cache, 3, now);
+	mu_assert_uint_eq(count_entries(cache, ED_DB_KEYS), 30);
+	mu_assert_uint_eq(count_entries(cache, ED_DB_EXPIRY), 20);
+
+	EdObject *obj = NULL;
+	mu_assert_int_eq(ed_cache_purge_expired(cache, 4), 4);
+	mu_assert_int_eq(ed_cache_purge_expired(cache, 4), 4);
+	mu_assert_int_eq(ed_cache_purge_expired(cache, 4), 3);
+	mu_assert_int_eq(ed_cache_purge_expired(cache, 4), 0);
+	mu_assert_uint_eq(count_entries(cache, ED_DB_KEYS), 19);
+	mu_assert_uint_eq(count_entries(cache, ED_DB_EXPIRY), 9);
+
+	mu_assert_int_eq(ed_open(cache, &obj, "purge-0", 7, 0), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "purge-1", 7, 0), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "purge-2", 7, 0), 1);
+	ed_close(&obj);
+	mu_assert_int_eq(ed_open(cache, &obj, "purge-3", 7, 0), 0);
+	mu_assert_int_eq(ed_open(cache, &obj, "purge-4", 7, 0), 1);
+	ed_close(&obj);
+
+	ed_cache_close(&cache);
+}
+
+static EdConfig shard_cfg = {
+	.index_path = "./test/tmp/test_shard",
+	.slab_path = "./test/tmp/slab_shard",
+	.slab_size = 16*1024*1024,
+	.flags = ED_FNOSYNC|ED_FCREATE|ED_FALLOCATE|ED_FCHECKSUM,
+	.nshards = 4,
+};
+
+static void
+shard_cleanup(void)
+{
+	for (unsigned i = 0; i < shard_cfg.nshards; i++) {
+		char path[64];
+		snprintf(path, sizeof(path), "%s.%u", shard_cfg.index_path, i);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s.%u", shard_cfg.slab_path, i);
+		unlink(path);
+	}
+#if ED_MMAP_DEBUG
+	mu_assert_int_eq(ed_pg_check(), 0);
+#endif
+}
+
+static void
+test_shards(void)
+{
+	mu_teardown = shard_cleanup;
+	shard_cleanup();
+
+	EdCache *cache = NULL;
+	int rc = ed_cache_open(&cache, &shard_cfg);
+	mu_assert_msg(rc >= 0, "failed to open cache: %s\n", ed_strerror(rc));
+	mu_assert_uint_eq(cache->nshards, 4);
+
+	char keys[64][32];
+	char ids[64][40];
+	EdObjectAttr attrs[32];
+	for (int i = 0; i < 64; i++) {
+		snprintf(keys[i], sizeof(keys[i]), "shard-%d", i);
+	}
+
+	// Half of the keys are created singly, and the rest in one batch.
+	for (int i = 0; i < 32; i++) {
+		int klen = strlen(keys[i]);
+		EdObject *obj = NULL;
+		EdObjectAttr attr = { .datalen = klen, .key = keys[i], .keylen = klen };
+		mu_assert_int_eq(ed_create(cache, &obj, &attr), 0);
+		mu_assert_int_eq(ed_write(obj, keys[i], klen), klen);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+	for (int i = 0; i < 32; i++) {
+		attrs[i] = (EdObjectAttr){
+			.key = keys[32+i],
+			.keylen = strlen(keys[32+i]),
+			.datalen = strlen(keys[32+i]),
+		};
+	}
+	EdBatch *batch = NULL;
+	mu_assert_int_eq(ed_batch_begin(cache, &batch, attrs, ed_len(attrs)), 0);
+	EdObject *obj;
+	for (int i = 0; ed_batch_create(batch, &obj) == 1; i++) {
+		mu_assert_int_eq(ed_write(obj, attrs[i].key, attrs[i].keylen), attrs[i].keylen);
+		mu_assert_int_eq(ed_close(&obj), 0);
+	}
+	mu_assert_int_eq(ed_batch_commit(&batch), 32);
+
+	// Every partition receives some of the keys.
+	unsigned used = 0;
+	for (int i = 0; i < 64; i++) {
+		mu_assert_int_eq(ed_open(cache, &obj, keys[i], strlen(keys[i]), 0), 1);
+		size_t len;
+		mu_assert_int_eq(memcmp(ed_value(obj, &len), keys[i], strlen(keys[i])), 0);
+		mu_assert_ptr_eq(obj->cache, cache->shards[obj->cache->shard]);
+		used |= 1u << obj->cache->shard;
+		snprintf(ids[i], sizeof(ids[i]), "%s", ed_id(obj));
+		ed_close(&obj);
+	}
+	mu_assert_uint_eq(used, 0xf);
+
+	for (int i = 0; i < 64; i++) {
+		mu_assert_int_eq(ed_open(cache, &obj, ids[i], strlen(ids[i]), ED_OID), 1);
+		mu_assert_str_eq(ed_id(obj), ids[i]);
+		ed_close(&obj);
+	}
+	mu_assert_int_eq(ed_open(cache, &obj, "9.1:0", 5, ED_OID), ED_EOBJECT_ID);
+
+	const void *kp[64];
+	size_t lens[64];
+	EdObject *objs[64];
+	for (int i = 0; i < 64; i++) {
+		kp[i] = keys[i];
+		lens[i] = strlen(keys[i]);
+	}
+	mu_assert_int_eq(ed_open_many(cache, objs, kp, lens, 64, 0), 64);
+	for (int i = 0; i < 64; i++) {
+		size_t len;
+		mu_assert_int_eq(memcmp(ed_value(objs[i], &len), keys[i], lens[i]), 0);
+		ed_close(&objs[i]);
+	}
+
+	EdList *list = NULL;
+	const EdObject *lobj;
+	int n = 0;
+	mu_assert_int_eq(ed_list_open(cache, &list, NULL), 0);
+	while ((rc = ed_list_next(list, &lobj)) == 1) { n++; }
+	mu_assert_int_eq(rc, 0);
+	ed_list_close(&list);
+	mu_assert_int_eq(n, 64);
+
+	ed_cache_close(&cache);
+}
+
 int
 main(void)
 {
 	mu_init("cache");
 
 	mu_run(test_create);
+	mu_run(test_create_many);
+	mu_run(test_send);
+	mu_run(test_read);
+	mu_run(test_map);
+	mu_run(test_batch);
+	mu_run(test_open_many);
+	mu_run(test_open_threads);
+	mu_run(test_wrap);
+	mu_run(test_group_sync);
+	mu_run(test_direct);
+	mu_run(test_rebuild);
+	mu_run(test_purge);
+	mu_run(test_shards);
 }
 
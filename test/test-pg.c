@@ -68,13 +68,13 @@ test_gc(void)
 	copy_pgno(pages, pgno, ed_len(pages));
 
 	idx.hdr->xid = 1;
-	ed_idx_acquire_xid(&idx);
+	ed_idx_acquire_xid(&idx, -1);
 
 	mu_assert_int_eq(ed_free(&idx, 1, pages, ed_len(pages)/2), 0);
 	mu_assert_int_eq(ed_free(&idx, 2, pages+ed_len(pages)/2, ed_len(pages)/2), 0);
 
 	idx.hdr->xid = 2;
-	ed_idx_acquire_xid(&idx);
+	ed_idx_acquire_xid(&idx, -1);
 
 	mu_assert_int_eq(ed_alloc(&idx, pages, ed_len(pages), false), ed_len(pages));
 	for (size_t i = 0; i < ed_len(pages); i++) {
@@ -97,6 +97,90 @@ test_gc(void)
 	mu_assert_int_eq(ed_free(&idx, 4, pages, ed_len(pages)), 0);
 }
 
+static void
+test_readers(void)
+{
+	mu_teardown = cleanup;
+
+	unlink(cfg.index_path);
+	mu_assert_int_eq(ed_idx_open(&idx, &cfg), 0);
+
+	int a = ed_idx_acquire_reader(&idx);
+	int b = ed_idx_acquire_reader(&idx);
+	mu_assert_int_ge(a, 0);
+	mu_assert_int_ge(b, 0);
+	mu_assert_int_ne(a, b);
+
+	idx.hdr->xid = 5;
+	mu_assert_uint_eq(ed_idx_acquire_xid(&idx, a), 5);
+	idx.hdr->xid = 9;
+	mu_assert_uint_eq(ed_idx_acquire_xid(&idx, b), 9);
+	mu_assert_uint_eq(idx.hdr->nsnapshots, 2);
+	mu_assert_uint_eq(ed_idx_xmin(&idx, 0), 5);
+
+	ed_idx_release_xid(&idx, a);
+	mu_assert_uint_eq(ed_idx_xmin(&idx, 0), 8);
+
+	ed_idx_release_xid(&idx, b);
+	ed_idx_release_reader(&idx, a);
+	ed_idx_release_reader(&idx, b);
+	mu_assert_uint_eq(idx.conn->rmask, 0);
+	mu_assert_uint_eq(idx.hdr->nsnapshots, 0);
+}
+
+#ifdef F_OFD_SETLK
+
+static void
+test_xmin_cache(void)
+{
+	mu_teardown = cleanup;
+
+	unlink(cfg.index_path);
+	mu_assert_int_eq(ed_idx_open(&idx, &cfg), 0);
+
+	// A second handle gets its own connection, so its snapshots are only found
+	// by scanning.
+	EdIdx other;
+	mu_assert_int_eq(ed_idx_open(&other, &cfg), 0);
+	mu_assert(other.conn != idx.conn);
+
+	int a = ed_idx_acquire_reader(&other);
+	int b = ed_idx_acquire_reader(&other);
+	idx.hdr->xid = 5;
+	mu_assert_uint_eq(ed_idx_acquire_xid(&other, a), 5);
+	idx.hdr->xid = 9;
+	mu_assert_uint_eq(ed_idx_acquire_xid(&other, b), 9);
+
+	EdTime now = ed_time_from_unix(idx.epoch, ed_now_unix());
+	mu_assert_uint_eq(ed_idx_xmin(&idx, now), 5);
+	mu_assert_uint_eq(idx.hdr->xmin_valid, idx.hdr->xmin_gen);
+
+	// Clear the oldest slot behind the back of the index. Commits in between do
+	// not cause a rescan, so the cached value is still returned.
+	other.conn->readers[a] = 0;
+	for (int i = 0; i < 4; i++) {
+		idx.hdr->xid++;
+		mu_assert_uint_eq(ed_idx_xmin(&idx, now), 5);
+	}
+
+	// Releasing the oldest id invalidates the cache.
+	other.conn->readers[a] = 5;
+	ed_idx_release_xid(&other, a);
+	mu_assert_uint_ne(idx.hdr->xmin_valid, idx.hdr->xmin_gen);
+	mu_assert_uint_eq(ed_idx_xmin(&idx, now), 9);
+
+	// Without ids held elsewhere, no scan is needed.
+	ed_idx_release_xid(&other, b);
+	mu_assert_uint_eq(ed_idx_xmin(&idx, now), idx.hdr->xid - 1);
+
+	ed_idx_release_reader(&other, a);
+	ed_idx_release_reader(&other, b);
+	ed_idx_close(&other);
+	mu_assert_uint_eq(idx.hdr->nsnapshots, 0);
+}
+
+#endif
+
 
 int
 main(void)
@@ -113,6 +197,10 @@ main(void)
 
 	mu_run(test_basic);
 	mu_run(test_gc);
+	mu_run(test_readers);
+#ifdef F_OFD_SETLK
+	mu_run(test_xmin_cache);
+#endif
 	return 0;
 }
 
@@ -304,6 +304,42 @@ test_write_sequence(void)
 	}
 }
 
+#ifdef F_OFD_SETLK
+static void
+test_multi_handle(void)
+{
+	mu_teardown = cleanup;
+	unlink(cfg.index_path);
+
+	EdTxn *txn;
+	setup(&txn);
+
+	EdIdx other;
+	int rc = ed_idx_open(&other, &cfg);
+	mu_assert_msg(rc >= 0, "failed to open index: %s\n", ed_strerror(rc));
+	mu_assert(other.conn != idx.conn);
+
+	// Both handles are in this process, but the write lock must still exclude.
+	mu_assert_int_eq(ed_lck(&idx.lck, idx.fd, ED_LCK_EX, FOPEN), 0);
+	mu_assert_int_eq(ed_lck(&other.lck, other.fd, ED_LCK_EX, FOPEN|ED_FNOBLOCK),
+			ed_esys(EAGAIN));
+	mu_assert_int_eq(ed_lck(&idx.lck, idx.fd, ED_LCK_UN, FOPEN), 0);
+	mu_assert_int_eq(ed_lck(&other.lck, other.fd, ED_LCK_EX, FOPEN|ED_FNOBLOCK), 0);
+
+	// Closing the second handle must not drop locks held by the first.
+	mu_assert_int_eq(ed_lck(&other.lck, other.fd, ED_LCK_UN, FOPEN), 0);
+	mu_assert_int_eq(ed_lck(&idx.lck, idx.fd, ED_LCK_EX, FOPEN), 0);
+	ed_idx_close(&other);
+	mu_assert_int_eq(ed_idx_open(&other, &cfg), 0);
+	mu_assert_int_eq(ed_lck(&other.lck, other.fd, ED_LCK_EX, FOPEN|ED_FNOBLOCK),
+			ed_esys(EAGAIN));
+	mu_assert_int_eq(ed_lck(&idx.lck, idx.fd, ED_LCK_UN, FOPEN), 0);
+	ed_idx_close(&other);
+
+	finish(&txn);
+}
+#endif
+
 int
 main(void)
 {
@@ -323,4 +359,7 @@ main(void)
 	mu_run(test_no_commit);
 	mu_run(test_read_snapshot);
 	mu_run(test_write_sequence);
+#ifdef F_OFD_SETLK
+	mu_run(test_multi_handle);
+#endif
 }